@@ -0,0 +1,658 @@
+#include "WGBenchmark.h"
+#include "WGGenerator.h"
+#include "WGBlur.h"
+#include "WGImageWriter.h"
+#include "WGWorldFile.h"
+#include "FastNoise.h"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <random>
+#include <cstdio>
+
+using namespace WG;
+
+//Milliseconds since the given start time
+static double elapsedMs(std::chrono::high_resolution_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+//Root mean square difference between two equal sized maps
+static double rmsDifference(FloatData* a, FloatData* b) {
+	double sum = 0.0;
+	for (int i = 0; i < (a->size * a->size); i++) {
+		double d = a->data[i] - b->data[i];
+		sum += d * d;
+	}
+	return sqrt(sum / (double)(a->size * a->size));
+}
+
+//Fraction of cells that still have a neighbor lower then the erosion threshold (ie. would still erode)
+static double unstableFraction(FloatData* data, float thresh) {
+	int count = 0;
+	float samp;
+	for (int x = 0; x < data->size; x++) {
+		for (int y = 0; y < data->size; y++) {
+			samp = data->getValue(x, y);
+			if (samp - data->getValueClamped(x - 1, y) > thresh || samp - data->getValueClamped(x + 1, y) > thresh ||
+				samp - data->getValueClamped(x, y - 1) > thresh || samp - data->getValueClamped(x, y + 1) > thresh)
+				count++;
+		}
+	}
+	return (double)count / (double)(data->size * data->size);
+}
+
+//The original in-place scatter version of Generator::erosionHydraulic, kept to measure the rewrite against
+struct waterCell {
+	float waterAmount = 0.0f;
+	float sedimentAmount = 0.0f;
+};
+
+static void legacyHydraulicErosion(FloatData* dataHeight, FloatData* dataMoist, ByteData* dataWater, int iterations) {
+	int size = dataHeight->size;
+
+	waterCell* water = new waterCell[size * size];
+	for (int y = 0; y < size; y++)
+		for (int x = 0; x < size; x++)
+			water[x * size + y].waterAmount = dataMoist->getValue(x,y) * 0.1f; //Seed buckets
+
+	for (int i = 0; i < iterations; i++) {
+		for (int y = 0; y < size; y++) {
+			for (int x = 0; x < size; x++) {
+				//Add water (Raining still)
+				waterCell* wc = &water[x * size + y];
+				if (wc->waterAmount < 0.9f)
+					wc->waterAmount += dataMoist->getValue(x, y) * 0.01f;
+
+				float c = dataHeight->getValue(x, y);
+				float tl = dataHeight->getValueWrapped(x - 1, y - 1),
+					t = dataHeight->getValueWrapped(x, y - 1),
+					tr = dataHeight->getValueWrapped(x + 1, y - 1);
+				float r = dataHeight->getValueWrapped(x + 1, y),
+					l = dataHeight->getValueWrapped(x - 1, y);
+				float bl = dataHeight->getValueWrapped(x - 1, y + 1),
+					b = dataHeight->getValueWrapped(x, y + 1),
+					br = dataHeight->getValueWrapped(x + 1, y + 1);
+
+				float dt = t - c, dtl = tl - c, dtr = tr - c,
+					db = b - c, dbl = bl - c, dbr = br - c,
+					dr = r - c, dl = l - c;
+
+				float totalDelta = (dt < 0 ? dt : 0) + (dtl < 0 ? dtl : 0) + (dtr < 0 ? dtr : 0) +
+					(db < 0 ? db : 0) + (dbl < 0 ? dbl : 0) + (dbr< 0 ? dbr : 0) +
+					(dr < 0 ? dr : 0) + (dl < 0 ? dl : 0);
+				totalDelta *= -1;
+
+				if (totalDelta > 0.001f) {
+					float deltMax = std::min(totalDelta, 0.9f);
+
+					//Pick-up sediment
+					float sediment = std::min(c*0.5f, (wc->waterAmount * (deltMax * 0.25f)));
+					dataHeight->setValue(c - sediment, x, y); //Reduction in current spot
+
+					float wpick = wc->waterAmount * deltMax;
+					wc->waterAmount -= wpick;
+
+					if (dt < 0) {
+						water[x * size + (y == 0 ? size-1 : y - 1)].sedimentAmount += sediment * (-dt / totalDelta);
+						water[x * size + (y == 0 ? size-1 : y - 1)].waterAmount += sediment * (-dt / totalDelta);
+					}
+					if (dtl < 0) {
+						water[(x == 0 ? size-1 : x - 1) * size + (y == 0 ? size-1 : y - 1)].sedimentAmount += sediment * (-dtl / totalDelta);
+						water[(x == 0 ? size-1 : x - 1) * size + (y == 0 ? size-1 : y - 1)].waterAmount += sediment * (-dtl / totalDelta);
+					}
+					if (dtr < 0) {
+						water[(x == size-1 ? 0 : x + 1) * size + (y == 0 ? size-1 : y - 1)].sedimentAmount += sediment * (-dtr / totalDelta);
+						water[(x == size-1 ? 0 : x + 1) * size + (y == 0 ? size-1 : y - 1)].waterAmount += sediment * (-dtr / totalDelta);
+					}
+
+					if (db < 0) {
+						water[x * size + (y == size-1 ? 0 : y + 1)].sedimentAmount += sediment * (-db / totalDelta);
+						water[x * size + (y == size-1 ? 0 : y + 1)].waterAmount += sediment * (-db / totalDelta);
+					}
+					if (dbl < 0) {
+						water[(x == 0 ? size-1 : x - 1) * size + (y == size-1 ? 0 : y + 1)].sedimentAmount += sediment * (-dbl / totalDelta);
+						water[(x == 0 ? size-1 : x - 1) * size + (y == size-1 ? 0 : y + 1)].waterAmount += sediment * (-dbl / totalDelta);
+					}
+					if (dbr < 0) {
+						water[(x == size-1 ? 0 : x + 1) * size + (y == size-1 ? 0 : y + 1)].sedimentAmount += sediment * (-dbr / totalDelta);
+						water[(x == size-1 ? 0 : x + 1) * size + (y == size-1 ? 0 : y + 1)].waterAmount += sediment * (-dbr / totalDelta);
+					}
+
+					if (dl < 0) {
+						water[(x == 0 ? size-1 : x - 1) * size + y].sedimentAmount += sediment * (-dl / totalDelta);
+						water[(x == 0 ? size-1 : x - 1) * size + y].waterAmount += sediment * (-dl / totalDelta);
+					}
+					if (dr < 0) {
+						water[(x == size-1 ? 0 : x + 1) * size + y].sedimentAmount += sediment * (-dr / totalDelta);
+						water[(x == size-1 ? 0 : x + 1) * size + y].waterAmount += sediment * (-dr / totalDelta);
+					}
+				}
+
+				//Evaporate
+				wc->waterAmount *= 0.1f;
+				if (wc->sedimentAmount > 0.1f) {
+					dataHeight->setValue(dataHeight->getValue(x, y) + (wc->sedimentAmount - 0.1f), x, y);
+					wc->sedimentAmount = 0.1f;
+				}
+			}
+		}
+	}
+
+	waterCell wsamp;
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			dataHeight->setValue(dataHeight->getValue(x, y) + water[x * size + y].sedimentAmount, x, y);
+
+			wsamp = water[x * size + y];
+			if (wsamp.waterAmount > 0.2f)
+				dataWater->setValue(2, x, y);
+		}
+	}
+
+	delete[] water;
+}
+
+//The original smoothing from Generator::calculateTemperature: 100 in-place passes of averaging
+//every cell with its neighbors (the y + 1 neighbor was read as y - 1 by mistake, kept as it was)
+static void legacyTemperatureBlur(FloatData* dataTemp) {
+	int size = dataTemp->size;
+	float samp, t, r, b, l, avg;
+	for (int i = 0; i < 100; i++) {
+		for (int y = 0; y < size; y++) {
+			for (int x = 0; x < size; x++) {
+				samp = dataTemp->getValue(x, y);
+				t = dataTemp->getValueWrapped(x, y - 1);
+				r = dataTemp->getValueWrapped(x + 1, y);
+				b = dataTemp->getValueWrapped(x, y - 1);
+				l = dataTemp->getValueWrapped(x - 1, y);
+				avg = (samp + t + r + b + l) / 5.0f;
+				dataTemp->setValue(((samp*0.5f) + (avg * 0.5f)), x, y);
+			}
+		}
+	}
+}
+
+//What the passes above were meant to do: each pass averages every cell with its four real neighbors,
+//all reading the previous pass. East-west wraps, the poles clamp, same as the box blur
+static void referenceTemperatureBlur(FloatData* data) {
+	int size = data->size;
+	std::vector<float> prev(size * size);
+	for (int i = 0; i < 100; i++) {
+		std::copy(data->data, data->data + (size * size), prev.begin());
+		for (int x = 0; x < size; x++) {
+			int xl = (x + size - 1) % size, xr = (x + 1) % size;
+			for (int y = 0; y < size; y++) {
+				int yt = std::max(y - 1, 0), yb = std::min(y + 1, size - 1);
+				float samp = prev[x * size + y];
+				float avg = (samp + prev[x * size + yt] + prev[xr * size + y] + prev[x * size + yb] + prev[xl * size + y]) / 5.0f;
+				data->data[x * size + y] = (samp * 0.5f) + (avg * 0.5f);
+			}
+		}
+	}
+}
+
+bool Benchmark::run(const char* name) {
+	if (strcmp(name, "thermal") == 0)
+		thermalErosion();
+	else if (strcmp(name, "hydraulic") == 0)
+		hydraulicErosion();
+	else if (strcmp(name, "blur") == 0)
+		temperatureBlur();
+	else if (strcmp(name, "biomeindex") == 0)
+		biomeIndex();
+	else if (strcmp(name, "png") == 0)
+		pngEncoding();
+	else if (strcmp(name, "worldfile") == 0)
+		worldFile();
+	else
+		return false;
+	return true;
+}
+
+void Benchmark::thermalErosion() {
+	const int sizes[] = { 256, 512, 1024, 2048 };
+	const int levels[] = { 1, 2, 3, 4 };
+	const int iterations = 50;
+
+	Settings config;
+	config.seed = 1337;
+	config.heightModifier = NONE;
+	config.seaLevel = 0.15f;
+	config.thermalErosionIterations = iterations;
+	config.thermalErosionThreshold = 0.0005f;
+	config.thermalErosionCoefficient = 0.5f;
+	config.thermalErosionTolerance = 0.0f;
+	config.thermalErosionFineIterations = 2;
+	config.hydraulicErosionIterations = 0;
+
+	struct Result {
+		int size;
+		int levels;
+		double ms;
+		double rms;
+		double relative;
+		double unstable;
+	};
+	std::vector<Result> results;
+
+	for (int size : sizes) {
+		config.worldSize = size;
+		Generator gen(config);
+		gen.getInstrumentation()->setLogSink(NULL); //Keep the stage logs out of the timings
+		gen.generateHeight();
+		FloatData base(*gen.dataHeight);
+		FloatData* reference = NULL;
+		double refChange = 0.0;
+
+		for (int lvl : levels) {
+			std::copy(base.data, base.data + (size * size), gen.dataHeight->data);
+			gen.settings.thermalErosionLevels = lvl;
+
+			auto start = std::chrono::high_resolution_clock::now();
+			gen.erosionThermal();
+			double ms = elapsedMs(start);
+
+			//The single level run is what everything else is measured against
+			if (reference == NULL) {
+				reference = new FloatData(*gen.dataHeight);
+				refChange = rmsDifference(reference, &base);
+			}
+
+			Result res;
+			res.size = size;
+			res.levels = lvl;
+			res.ms = ms;
+			res.rms = rmsDifference(gen.dataHeight, reference);
+			res.relative = refChange > 0.0 ? res.rms / refChange : 0.0;
+			res.unstable = unstableFraction(gen.dataHeight, config.thermalErosionThreshold);
+			results.push_back(res);
+		}
+
+		delete reference;
+	}
+
+	//Rel. error is the RMS difference divided by how much the reference run changed the map. For scale, running
+	//10% fewer or more full resolution iterations than the reference comes out around 0.09
+	std::cout << std::endl << "Thermal erosion, " << iterations << " iterations (levels 1 = full resolution reference)" << std::endl;
+	std::cout << std::setw(8) << "Size" << std::setw(8) << "Levels" << std::setw(12) << "Time (ms)"
+		<< std::setw(10) << "Speedup" << std::setw(14) << "RMS vs ref" << std::setw(12) << "Rel. error" << std::setw(12) << "Unstable %" << std::endl;
+	double refMs = 0.0;
+	for (const Result& res : results) {
+		if (res.levels == 1)
+			refMs = res.ms;
+		std::cout << std::setw(8) << res.size << std::setw(8) << res.levels
+			<< std::setw(12) << std::fixed << std::setprecision(1) << res.ms
+			<< std::setw(9) << std::setprecision(2) << (refMs / res.ms) << "x"
+			<< std::setw(14) << std::scientific << std::setprecision(3) << res.rms
+			<< std::setw(12) << std::fixed << std::setprecision(3) << res.relative
+			<< std::setw(12) << std::fixed << std::setprecision(2) << (res.unstable * 100.0) << std::endl;
+	}
+}
+
+void Benchmark::hydraulicErosion() {
+	const int sizes[] = { 256, 512, 1024, 2048 };
+	const int iterations = 20;
+
+	Settings config;
+	config.seed = 1337;
+	config.heightModifier = NONE;
+	config.seaLevel = 0.15f;
+	config.thermalErosionIterations = 0;
+	config.thermalErosionThreshold = 0.0005f;
+	config.thermalErosionCoefficient = 0.5f;
+	config.hydraulicErosionIterations = iterations;
+
+	std::cout << std::endl << "Hydraulic erosion (grid), " << iterations << " iterations, scatter original vs gather rewrite" << std::endl;
+	std::cout << std::setw(8) << "Size" << std::setw(14) << "Scatter (ms)" << std::setw(13) << "Gather (ms)" << std::setw(10) << "Speedup"
+		<< std::setw(14) << "RMS height" << std::setw(14) << "Max height" << std::setw(14) << "Water match %" << std::endl;
+
+	for (int size : sizes) {
+		config.worldSize = size;
+		Generator gen(config);
+		gen.getInstrumentation()->setLogSink(NULL); //Keep the stage logs out of the timings
+		gen.generateHeight();
+		gen.calculateMoisture();
+		FloatData base(*gen.dataHeight);
+
+		std::fill(gen.dataWater->data, gen.dataWater->data + (size * size), 0);
+		auto start = std::chrono::high_resolution_clock::now();
+		legacyHydraulicErosion(gen.dataHeight, gen.dataMoist, gen.dataWater, iterations);
+		double scatterMs = elapsedMs(start);
+		FloatData scatterHeight(*gen.dataHeight);
+		ByteData scatterWater(*gen.dataWater);
+
+		std::copy(base.data, base.data + (size * size), gen.dataHeight->data);
+		std::fill(gen.dataWater->data, gen.dataWater->data + (size * size), 0);
+		start = std::chrono::high_resolution_clock::now();
+		gen.erosionHydraulic();
+		double gatherMs = elapsedMs(start);
+
+		double maxDiff = 0.0;
+		int waterMatch = 0;
+		for (int i = 0; i < (size * size); i++) {
+			maxDiff = std::max(maxDiff, (double)fabsf(scatterHeight.data[i] - gen.dataHeight->data[i]));
+			if (scatterWater.data[i] == gen.dataWater->data[i])
+				waterMatch++;
+		}
+
+		std::cout << std::setw(8) << size << std::setw(14) << std::fixed << std::setprecision(1) << scatterMs
+			<< std::setw(13) << gatherMs << std::setw(9) << std::setprecision(2) << (scatterMs / gatherMs) << "x"
+			<< std::setw(14) << std::scientific << std::setprecision(3) << rmsDifference(&scatterHeight, gen.dataHeight)
+			<< std::setw(14) << maxDiff
+			<< std::setw(14) << std::fixed << std::setprecision(2) << (100.0 * waterMatch / (double)(size * size)) << std::endl;
+	}
+}
+
+
+void Benchmark::temperatureBlur() {
+	const int sizes[] = { 512, 1024, 2048, 4096 };
+
+	Settings config;
+	config.seed = 1337;
+	config.heightModifier = NONE;
+	config.seaLevel = 0.15f;
+	config.thermalErosionIterations = 0;
+	config.thermalErosionThreshold = 0.0005f;
+	config.thermalErosionCoefficient = 0.5f;
+	config.hydraulicErosionIterations = 0;
+
+	std::cout << std::endl << "Temperature smoothing, 100 neighbor averaging passes vs 3 box passes (sigma "
+		<< boxBlurSigma(4, 3) << ")" << std::endl;
+	std::cout << std::setw(8) << "Size" << std::setw(14) << "Passes (ms)" << std::setw(12) << "Box (ms)" << std::setw(10) << "Speedup"
+		<< std::setw(14) << "RMS passes" << std::setw(16) << "RMS reference" << std::endl;
+
+	for (int size : sizes) {
+		//Any rough layer will do, the height map has plenty of detail to smooth out
+		config.worldSize = size;
+		Generator gen(config);
+		gen.getInstrumentation()->setLogSink(NULL);
+		gen.generateHeight();
+		FloatData passes(*gen.dataHeight);
+		FloatData box(*gen.dataHeight);
+		FloatData reference(*gen.dataHeight);
+		referenceTemperatureBlur(&reference);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		legacyTemperatureBlur(&passes);
+		double passesMs = elapsedMs(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		boxBlur(&box, 4, 3, STENCIL_WRAP, STENCIL_CLAMP, resolveThreadCount(config.threadCount));
+		double boxMs = elapsedMs(start);
+
+		std::cout << std::setw(8) << size << std::setw(14) << std::fixed << std::setprecision(1) << passesMs
+			<< std::setw(12) << boxMs << std::setw(9) << std::setprecision(1) << (passesMs / boxMs) << "x"
+			<< std::setw(14) << std::scientific << std::setprecision(3) << rmsDifference(&passes, &box)
+			<< std::setw(16) << rmsDifference(&reference, &box) << std::endl;
+	}
+}
+
+//Biome map of the given size from the default biome table, on climate noise made at 1/16 of the size
+//and upsampled (a full generate at 8192 would take minutes and the index only cares about the biome shapes)
+static ByteData* makeBiomeMap(int size) {
+	int coarse = (size + 15) / 16;
+	FloatData temperature(coarse), moisture(coarse);
+	FastNoise noise(1337);
+	noise.SetNoiseType(FastNoise::NoiseType::SimplexFractal);
+	noise.SetFrequency(0.02f);
+	noise.SetFractalOctaves(4);
+	for (int x = 0; x < coarse; x++) {
+		for (int y = 0; y < coarse; y++) {
+			temperature.setValue((noise.GetNoise((float)x, (float)y) * 0.7f) + 0.5f, x, y);
+			moisture.setValue((noise.GetNoise((float)x + 5000.0f, (float)y) * 0.7f) + 0.5f, x, y);
+		}
+	}
+
+	BiomeTable table;
+	BilinearUpsampler upsampler(coarse, size, 16);
+	ByteData* biomes = new ByteData(size);
+	std::vector<float> tempRow(size), moistRow(size), scratch(size * 2);
+	std::vector<uint8_t> land(size, 0);
+	for (int x = 0; x < size; x++) {
+		upsampler.row(&temperature, x, tempRow.data(), scratch.data());
+		upsampler.row(&moisture, x, moistRow.data(), scratch.data());
+		table.classifyRow(tempRow.data(), moistRow.data(), land.data(), biomes->data + (x * size), size, scratch.data());
+	}
+	return biomes;
+}
+
+void Benchmark::biomeIndex() {
+	const int sizes[] = { 1024, 2048, 4096, 8192 };
+	const int queries = 2000;
+	int threads = resolveThreadCount(0);
+
+	std::cout << std::endl << "Biome index, " << queries << " random queries of each kind, times in microseconds unless noted" << std::endl;
+	std::cout << std::setw(8) << "Size" << std::setw(12) << "Build (ms)" << std::setw(10) << "MB" << std::setw(11) << "Scan (ms)"
+		<< std::setw(10) << "Area avg" << std::setw(10) << "Area max" << std::setw(13) << "Nearest avg" << std::setw(13) << "Nearest max" << std::endl;
+
+	for (int size : sizes) {
+		ByteData* biomes = makeBiomeMap(size);
+		BiomeIndex index;
+		auto start = std::chrono::high_resolution_clock::now();
+		index.build(biomes, threads);
+		double buildMs = elapsedMs(start);
+
+		std::vector<uint8_t> present;
+		for (int id = 0; id < 256; id++)
+			if (index.contains((uint8_t)id))
+				present.push_back((uint8_t)id);
+
+		//What every query costs without the index, a count over the whole map
+		start = std::chrono::high_resolution_clock::now();
+		int64_t scanned = std::count(biomes->data, biomes->data + ((int64_t)size * size), present[0]);
+		double scanMs = elapsedMs(start);
+
+		std::mt19937 rng(1337);
+		std::uniform_int_distribution<int> cell(0, size - 1);
+		std::uniform_int_distribution<int> pick(0, (int)present.size() - 1);
+		double areaTotal = 0.0, areaMax = 0.0, nearestTotal = 0.0, nearestMax = 0.0;
+		volatile int64_t sink = scanned; //Keeps the queries from being optimized out
+		for (int q = 0; q < queries; q++) {
+			int x0 = cell(rng), x1 = cell(rng), y0 = cell(rng), y1 = cell(rng);
+			uint8_t biome = present[pick(rng)];
+			start = std::chrono::high_resolution_clock::now();
+			sink += index.countCells(biome, std::min(x0, x1), std::min(y0, y1), std::max(x0, x1) + 1, std::max(y0, y1) + 1);
+			double us = elapsedMs(start) * 1000.0;
+			areaTotal += us;
+			areaMax = std::max(areaMax, us);
+
+			int nx = 0, ny = 0;
+			start = std::chrono::high_resolution_clock::now();
+			index.findNearest(biome, x0, y0, nx, ny);
+			us = elapsedMs(start) * 1000.0;
+			sink += nx + ny;
+			nearestTotal += us;
+			nearestMax = std::max(nearestMax, us);
+		}
+
+		std::cout << std::setw(8) << size << std::setw(12) << std::fixed << std::setprecision(1) << buildMs
+			<< std::setw(10) << (double)index.getMemoryBytes() / (1024.0 * 1024.0) << std::setw(11) << scanMs
+			<< std::setw(10) << std::setprecision(2) << (areaTotal / queries) << std::setw(10) << areaMax
+			<< std::setw(13) << (nearestTotal / queries) << std::setw(13) << nearestMax << std::endl;
+		delete biomes;
+	}
+}
+
+//Seconds to write a whole PNG through writeRows, and its size
+static double encodePng(const char* path, int size, int channels, const RowSource& source, int threads, uint64_t& bytes) {
+	ImageWriter image;
+	auto start = std::chrono::high_resolution_clock::now();
+	bool written = image.open(path, IMAGE_PNG, size, size, channels) && image.writeRows(source, threads) && image.close();
+	double seconds = elapsedMs(start) / 1000.0;
+	if (!written)
+		std::cout << image.getError() << std::endl;
+	bytes = image.getBytesWritten();
+	return seconds;
+}
+
+void Benchmark::pngEncoding() {
+	const int sizes[] = { 2048, 4096, 8192 };
+	int threads = resolveThreadCount(0);
+#ifdef _WIN32
+	const char* output = "NUL";
+#else
+	const char* output = "/dev/null";
+#endif
+
+	std::cout << std::endl << "PNG encoding at level 6, one stream vs bands on " << threads << " threads, MB/s of raw pixels" << std::endl;
+	std::cout << std::setw(8) << "Size" << std::setw(9) << "Layer" << std::setw(10) << "Raw MB" << std::setw(11) << "1 thread"
+		<< std::setw(11) << "Threaded" << std::setw(10) << "Speedup" << std::setw(12) << "Ratio (%)" << std::setw(12) << "Bands +%" << std::endl;
+
+	for (int size : sizes) {
+		BiomeTable table;
+		uint8_t colors[256][3] = {};
+		for (const BiomeInfo& biome : table.getBiomes()) {
+			colors[biome.id][0] = biome.red;
+			colors[biome.id][1] = biome.green;
+			colors[biome.id][2] = biome.blue;
+		}
+		ByteData* biomes = makeBiomeMap(size);
+
+		//Smooth noise with a little grain on top, about how a height map export compresses
+		int coarse = (size + 15) / 16;
+		FloatData noise(coarse);
+		FastNoise fastNoise(1337);
+		fastNoise.SetNoiseType(FastNoise::NoiseType::SimplexFractal);
+		fastNoise.SetFrequency(0.05f);
+		for (int x = 0; x < coarse; x++) {
+			for (int y = 0; y < coarse; y++)
+				noise.setValue((fastNoise.GetNoise((float)x, (float)y) * 0.5f) + 0.5f, x, y);
+		}
+		ByteData height(size);
+		BilinearUpsampler upsampler(coarse, size, 16);
+		std::vector<float> heightRow(size), scratch(size * 2);
+		std::mt19937 rng(1337);
+		for (int x = 0; x < size; x++) {
+			upsampler.row(&noise, x, heightRow.data(), scratch.data());
+			for (int y = 0; y < size; y++)
+				height.data[(x * size) + y] = (uint8_t)std::max(0.0f, std::min(255.0f, (heightRow[y] * 250.0f) + (float)(rng() % 4)));
+		}
+
+		//Image rows read straight along the map's rows, the orientation doesn't matter here
+		RowSource biomeRows = [&](int y, uint8_t* row) {
+			const uint8_t* cells = biomes->data + ((int64_t)y * size);
+			for (int x = 0; x < size; x++) {
+				row[(x * 3)] = colors[cells[x]][0];
+				row[(x * 3) + 1] = colors[cells[x]][1];
+				row[(x * 3) + 2] = colors[cells[x]][2];
+			}
+		};
+		RowSource heightRows = [&](int y, uint8_t* row) {
+			std::copy(height.data + ((int64_t)y * size), height.data + ((int64_t)(y + 1) * size), row);
+		};
+
+		const char* names[2] = { "biomes", "height" };
+		const RowSource* sources[2] = { &biomeRows, &heightRows };
+		const int channels[2] = { 3, 1 };
+		for (int layer = 0; layer < 2; layer++) {
+			double rawMB = (double)size * size * channels[layer] / (1024.0 * 1024.0);
+			uint64_t singleBytes = 0, threadedBytes = 0;
+			double single = encodePng(output, size, channels[layer], *sources[layer], 1, singleBytes);
+			double threaded = encodePng(output, size, channels[layer], *sources[layer], threads, threadedBytes);
+
+			std::cout << std::setw(8) << size << std::setw(9) << names[layer] << std::setw(10) << std::fixed << std::setprecision(1) << rawMB
+				<< std::setw(11) << (rawMB / single) << std::setw(11) << (rawMB / threaded) << std::setw(9) << std::setprecision(2) << (single / threaded) << "x"
+				<< std::setw(12) << (100.0 * singleBytes / (rawMB * 1024.0 * 1024.0))
+				<< std::setw(12) << std::setprecision(3) << (100.0 * ((double)threadedBytes - (double)singleBytes) / (double)singleBytes) << std::endl;
+		}
+		delete biomes;
+	}
+}
+
+void Benchmark::worldFile() {
+	const int sizes[] = { 2048, 4096, 8192 };
+	const char* path = "benchmark.wgw";
+
+	std::cout << std::endl << "World file with a float height layer and a byte biome layer (the file is in the OS cache when opened)" << std::endl;
+	std::cout << std::setw(8) << "Size" << std::setw(10) << "File MB" << std::setw(12) << "Save MB/s" << std::setw(11) << "Open ms"
+		<< std::setw(11) << "Read ms" << std::setw(12) << "Touch ms" << std::setw(12) << "Verify ms" << std::endl;
+
+	for (int size : sizes) {
+		ByteData* biomes = makeBiomeMap(size);
+		int coarse = (size + 15) / 16;
+		FloatData noise(coarse);
+		FastNoise fastNoise(1337);
+		fastNoise.SetNoiseType(FastNoise::NoiseType::SimplexFractal);
+		fastNoise.SetFrequency(0.05f);
+		for (int x = 0; x < coarse; x++) {
+			for (int y = 0; y < coarse; y++)
+				noise.setValue((fastNoise.GetNoise((float)x, (float)y) * 0.5f) + 0.5f, x, y);
+		}
+		FloatData height(size);
+		BilinearUpsampler upsampler(coarse, size, 16);
+		std::vector<float> scratch(size * 2);
+		for (int x = 0; x < size; x++)
+			upsampler.row(&noise, x, height.data + ((int64_t)x * size), scratch.data());
+
+		std::vector<WorldLayer> layers(2);
+		layers[0].name = "height";
+		layers[0].type = LAYER_FLOAT;
+		layers[0].size = size;
+		layers[0].channels = 1;
+		layers[0].data = height.data;
+		layers[1].name = "biomes";
+		layers[1].type = LAYER_BYTE;
+		layers[1].size = size;
+		layers[1].channels = 1;
+		layers[1].data = biomes->data;
+
+		Settings settings;
+		settings.worldSize = size;
+		std::string error;
+		auto start = std::chrono::high_resolution_clock::now();
+		if (!WorldFile::save(path, settings, layers, error)) {
+			std::cout << error << std::endl;
+			delete biomes;
+			return;
+		}
+		double saveMs = elapsedMs(start);
+		double fileMB = (double)(layers[0].getBytes() + layers[1].getBytes()) / (1024.0 * 1024.0);
+
+		start = std::chrono::high_resolution_clock::now();
+		WorldFile world;
+		bool opened = world.open(path, error);
+		double openMs = elapsedMs(start);
+		if (!opened) {
+			std::cout << error << std::endl;
+			delete biomes;
+			return;
+		}
+
+		//What loading costs when every byte is copied in instead
+		start = std::chrono::high_resolution_clock::now();
+		std::vector<uint8_t> copy((size_t)(fileMB * 1024.0 * 1024.0) + 4096);
+		FILE* file = fopen(path, "rb");
+		size_t read = file != NULL ? fread(copy.data(), 1, copy.size(), file) : 0;
+		if (file != NULL)
+			fclose(file);
+		double readMs = elapsedMs(start);
+
+		//Summing the height view pages the mapping in on first use
+		start = std::chrono::high_resolution_clock::now();
+		FloatData* view = world.getFloatData("height");
+		double sum = 0.0;
+		for (int64_t i = 0; i < (int64_t)size * size; i++)
+			sum += view->data[i];
+		double touchMs = elapsedMs(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		bool verified = world.verify(error);
+		double verifyMs = elapsedMs(start);
+		if (!verified || read == 0 || sum < 0.0)
+			std::cout << (verified ? "Couldn't read " + std::string(path) : error) << std::endl;
+
+		std::cout << std::setw(8) << size << std::setw(10) << std::fixed << std::setprecision(1) << fileMB
+			<< std::setw(12) << (fileMB / (saveMs / 1000.0)) << std::setw(11) << std::setprecision(3) << openMs
+			<< std::setw(11) << std::setprecision(1) << readMs << std::setw(12) << touchMs << std::setw(12) << verifyMs << std::endl;
+
+		world.close();
+		remove(path);
+		delete biomes;
+	}
+}
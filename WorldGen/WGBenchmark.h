@@ -0,0 +1,29 @@
+#pragma once
+
+namespace WG {
+	//Timing and quality comparisons between the different ways a generator stage can run.
+	//Started from the command line with "WorldGen -benchmark <name>", results are printed as a table.
+	class Benchmark {
+	public:
+		//Returns false if the name didn't match any benchmark
+		static bool run(const char* name);
+
+		//Full resolution thermal erosion against the coarse-to-fine pyramid, across world sizes
+		static void thermalErosion();
+
+		//The original scatter grid hydraulic erosion against the gather rewrite: speed and how far the results drift
+		static void hydraulicErosion();
+
+		//The original 100 pass temperature smoothing against the separable box blur that replaced it
+		static void temperatureBlur();
+
+		//Build time, memory and query latency of the biome index against scanning the biome map
+		static void biomeIndex();
+
+		//Throughput of the PNG writer encoding a biome map and a height map as one stream against in bands on every thread
+		static void pngEncoding();
+
+		//Saving a .wgw world file, then opening it by mapping against reading it all in, and checking its layers
+		static void worldFile();
+	};
+}
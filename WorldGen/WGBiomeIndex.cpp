@@ -0,0 +1,283 @@
+#include "WGBiomeIndex.h"
+#include "WGParallel.h"
+
+#include <algorithm>
+#include <queue>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace WG;
+
+//Bits set in a word
+static inline int popCount(uint64_t word) {
+#if defined(_MSC_VER) && defined(_M_X64)
+	return (int)__popcnt64(word);
+#elif defined(_MSC_VER)
+	return (int)(__popcnt((unsigned int)word) + __popcnt((unsigned int)(word >> 32)));
+#else
+	return __builtin_popcountll(word);
+#endif
+}
+
+//Index of the lowest set bit in a non-zero word
+static inline int lowestBit(uint64_t word) {
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long idx;
+	_BitScanForward64(&idx, word);
+	return (int)idx;
+#elif defined(_MSC_VER)
+	unsigned long idx;
+	if (_BitScanForward(&idx, (unsigned long)word))
+		return (int)idx;
+	_BitScanForward(&idx, (unsigned long)(word >> 32));
+	return (int)idx + 32;
+#else
+	return __builtin_ctzll(word);
+#endif
+}
+
+//Index of the highest set bit in a non-zero word
+static inline int highestBit(uint64_t word) {
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long idx;
+	_BitScanReverse64(&idx, word);
+	return (int)idx;
+#elif defined(_MSC_VER)
+	unsigned long idx;
+	if (_BitScanReverse(&idx, (unsigned long)(word >> 32)))
+		return (int)idx + 32;
+	_BitScanReverse(&idx, (unsigned long)word);
+	return (int)idx;
+#else
+	return 63 - __builtin_clzll(word);
+#endif
+}
+
+//Set bits in y0 <= y < y1 of a mask row
+static inline int64_t countRow(const uint64_t* row, int y0, int y1) {
+	if (y0 >= y1)
+		return 0;
+	int w0 = y0 >> 6, w1 = (y1 - 1) >> 6;
+	uint64_t first = ~0ULL << (y0 & 63);
+	uint64_t last = ~0ULL >> (63 - ((y1 - 1) & 63));
+	if (w0 == w1)
+		return popCount(row[w0] & first & last);
+
+	int64_t total = popCount(row[w0] & first) + popCount(row[w1] & last);
+	for (int w = w0 + 1; w < w1; w++)
+		total += popCount(row[w]);
+	return total;
+}
+
+BiomeIndex::BiomeIndex() {
+	this->size = 0;
+	this->blocks = 0;
+	this->rootLevel = 0;
+	std::fill(slots, slots + 256, (int16_t)-1);
+}
+
+void BiomeIndex::build(const ByteData* biomes, int threads) {
+	size = biomes->size;
+	blocks = (size + BLOCK - 1) / BLOCK;
+	rootLevel = 0;
+	while ((1 << rootLevel) < blocks)
+		rootLevel++;
+
+	//Which biomes are on the map at all, counted per block row
+	std::vector<int64_t> rowCounts(blocks * 256, 0);
+	parallelFor(0, blocks, threads, [&](int b0, int b1) {
+		for (int bx = b0; bx < b1; bx++) {
+			int64_t* counts = rowCounts.data() + (bx * 256);
+			int64_t end = (int64_t)std::min((bx + 1) * BLOCK, size) * size;
+			for (int64_t i = (int64_t)bx * BLOCK * size; i < end; i++)
+				counts[biomes->data[i]]++;
+		}
+	});
+
+	masks.clear();
+	std::fill(slots, slots + 256, (int16_t)-1);
+	for (int id = 0; id < 256; id++) {
+		for (int bx = 0; bx < blocks; bx++) {
+			if (rowCounts[bx * 256 + id] > 0) {
+				slots[id] = (int16_t)masks.size();
+				masks.push_back(BitMask(size));
+				break;
+			}
+		}
+	}
+
+	//Mask words a block row at a time, so no two threads add to the same block count
+	int slotCount = (int)masks.size();
+	int sumSize = (blocks + 1) * (blocks + 1);
+	blockSums.assign(slotCount * sumSize, 0);
+	parallelFor(0, blocks, threads, [&](int b0, int b1) {
+		std::vector<uint64_t> words(slotCount);
+		for (int bx = b0; bx < b1; bx++) {
+			int xEnd = std::min((bx + 1) * BLOCK, size);
+			for (int x = bx * BLOCK; x < xEnd; x++) {
+				const uint8_t* row = biomes->data + ((int64_t)x * size);
+				for (int w = 0; w < blocks; w++) {
+					int yEnd = std::min((w + 1) * BLOCK, size);
+					for (int y = w * BLOCK; y < yEnd; y++)
+						words[slots[row[y]]] |= 1ULL << (y & 63);
+
+					for (int s = 0; s < slotCount; s++) {
+						if (words[s] != 0) {
+							masks[s].bits[x * masks[s].stride + w] = words[s];
+							blockSums[(s * sumSize) + ((bx + 1) * (blocks + 1)) + (w + 1)] += popCount(words[s]);
+							words[s] = 0;
+						}
+					}
+				}
+			}
+		}
+	});
+
+	//Block counts into summed-area tables
+	for (int s = 0; s < slotCount; s++) {
+		int64_t* sums = blockSums.data() + (s * sumSize);
+		for (int bx = 1; bx <= blocks; bx++) {
+			for (int by = 1; by <= blocks; by++) {
+				sums[bx * (blocks + 1) + by] += sums[(bx - 1) * (blocks + 1) + by] + sums[bx * (blocks + 1) + (by - 1)]
+					- sums[(bx - 1) * (blocks + 1) + (by - 1)];
+			}
+		}
+	}
+}
+
+int64_t BiomeIndex::blockCount(int slot, int bx0, int by0, int bx1, int by1) const {
+	if (bx0 >= bx1 || by0 >= by1)
+		return 0;
+	const int64_t* sums = blockSums.data() + (slot * (blocks + 1) * (blocks + 1));
+	int stride = blocks + 1;
+	return sums[bx1 * stride + by1] - sums[bx0 * stride + by1] - sums[bx1 * stride + by0] + sums[bx0 * stride + by0];
+}
+
+int64_t BiomeIndex::getCellCount(uint8_t biome) const {
+	return slots[biome] < 0 ? 0 : blockCount(slots[biome], 0, 0, blocks, blocks);
+}
+
+int64_t BiomeIndex::countCells(uint8_t biome, int x0, int y0, int x1, int y1) const {
+	int slot = slots[biome];
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	x1 = std::min(x1, size);
+	y1 = std::min(y1, size);
+	if (slot < 0 || x0 >= x1 || y0 >= y1)
+		return 0;
+
+	//Whole blocks inside the rectangle (the partial last block counts as whole when the rectangle reaches the edge)
+	int bx0 = (x0 + BLOCK - 1) / BLOCK, by0 = (y0 + BLOCK - 1) / BLOCK;
+	int bx1 = x1 == size ? blocks : x1 / BLOCK, by1 = y1 == size ? blocks : y1 / BLOCK;
+	if (bx0 >= bx1 || by0 >= by1)
+		bx0 = bx1 = by0 = by1 = 0;
+	int64_t total = blockCount(slot, bx0, by0, bx1, by1);
+
+	//Rows above and below the blocks count across the rectangle, rows beside them only the ends
+	int ix0 = std::max(bx0 * BLOCK, x0), ix1 = std::min(bx1 * BLOCK, x1);
+	int iy0 = std::max(by0 * BLOCK, y0), iy1 = std::min(by1 * BLOCK, y1);
+	const BitMask& mask = masks[slot];
+	for (int x = x0; x < x1; x++) {
+		const uint64_t* row = mask.bits.data() + (x * mask.stride);
+		if (x < ix0 || x >= ix1)
+			total += countRow(row, y0, y1);
+		else
+			total += countRow(row, y0, iy0) + countRow(row, iy1, y1);
+	}
+	return total;
+}
+
+bool BiomeIndex::findNearest(uint8_t biome, int x, int y, int& nearestX, int& nearestY) const {
+	int slot = slots[biome];
+	if (slot < 0)
+		return false;
+
+	//Quadtree node: blocks (bx << level) up to ((bx + 1) << level) along x, the same along y
+	struct Node {
+		int64_t distance; //Squared distance from the query to the closest cell of the node
+		int level, bx, by;
+		bool operator<(const Node& other) const { return distance > other.distance; } //Closest on top
+	};
+	auto boxDistance = [&](int level, int bx, int by) {
+		int span = BLOCK << level;
+		int cx0 = bx * span, cx1 = std::min(cx0 + span, size) - 1;
+		int cy0 = by * span, cy1 = std::min(cy0 + span, size) - 1;
+		int64_t dx = x < cx0 ? cx0 - x : (x > cx1 ? x - cx1 : 0);
+		int64_t dy = y < cy0 ? cy0 - y : (y > cy1 ? y - cy1 : 0);
+		return (dx * dx) + (dy * dy);
+	};
+
+	const BitMask& mask = masks[slot];
+	int64_t best = INT64_MAX;
+	std::priority_queue<Node> open;
+	open.push(Node{ boxDistance(rootLevel, 0, 0), rootLevel, 0, 0 });
+
+	while (!open.empty() && open.top().distance < best) {
+		Node node = open.top();
+		open.pop();
+
+		if (node.level > 0) {
+			int half = 1 << (node.level - 1);
+			for (int c = 0; c < 4; c++) {
+				int cbx = (node.bx * 2) + (c >> 1), cby = (node.by * 2) + (c & 1);
+				int b0x = cbx * half, b0y = cby * half;
+				if (b0x >= blocks || b0y >= blocks)
+					continue;
+				if (blockCount(slot, b0x, b0y, std::min(b0x + half, blocks), std::min(b0y + half, blocks)) == 0)
+					continue;
+				int64_t distance = boxDistance(node.level - 1, cbx, cby);
+				if (distance < best)
+					open.push(Node{ distance, node.level - 1, cbx, cby });
+			}
+			continue;
+		}
+
+		//A single block: each row's closest bit to y is a bit scan either side of it
+		int base = node.by * BLOCK;
+		int offset = y - base;
+		int xEnd = std::min((node.bx + 1) * BLOCK, size);
+		for (int cx = node.bx * BLOCK; cx < xEnd; cx++) {
+			int64_t dx = cx - x;
+			if (dx * dx >= best)
+				continue;
+			uint64_t word = mask.bits[cx * mask.stride + node.by];
+			if (word == 0)
+				continue;
+
+			int candidates[2];
+			int count = 0;
+			if (offset < 0)
+				candidates[count++] = lowestBit(word);
+			else if (offset >= BLOCK)
+				candidates[count++] = highestBit(word);
+			else {
+				uint64_t above = word & (~0ULL << offset);
+				uint64_t below = word & ((1ULL << offset) - 1);
+				if (above != 0)
+					candidates[count++] = lowestBit(above);
+				if (below != 0)
+					candidates[count++] = highestBit(below);
+			}
+
+			for (int k = 0; k < count; k++) {
+				int64_t dy = base + candidates[k] - y;
+				int64_t distance = (dx * dx) + (dy * dy);
+				if (distance < best) {
+					best = distance;
+					nearestX = cx;
+					nearestY = base + candidates[k];
+				}
+			}
+		}
+	}
+	return true;
+}
+
+size_t BiomeIndex::getMemoryBytes() const {
+	size_t total = blockSums.size() * sizeof(int64_t);
+	for (const BitMask& mask : masks)
+		total += mask.bits.size() * sizeof(uint64_t);
+	return total;
+}
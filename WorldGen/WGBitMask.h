@@ -0,0 +1,82 @@
+#pragma once
+#include "WGParallel.h"
+
+#include <vector>
+#include <cstdint>
+
+namespace WG {
+	// Neighborhood used by the morphology operations
+	enum MorphShape {
+		MORPH_CROSS, //4 neighbors, grows into diamonds
+		MORPH_SQUARE //8 neighbors, grows into squares
+	};
+
+	//Square bit mask with one bit per cell, packed 64 cells to a word along each row (x fixed, y varying),
+	//so it lines up with the x * size + y layout of the data layers.
+	//
+	//The morphology operations work on whole words: moving the mask one cell along a row is a shift with a
+	//carry between words, and moving it along x is just reading the next row. So one word op handles 64 cells,
+	//and the row combines also go two words at a time with SSE2 when it's there. Rows are split over threads.
+	//Cells off the map read as the nearest edge cell, so the edges don't erode or grow on their own.
+	//Operations write into a separate output mask of the same size, never the mask itself.
+	class BitMask {
+	public:
+		int size;
+		int stride; //Words per row
+		std::vector<uint64_t> bits;
+
+		BitMask(int size);
+
+		inline bool get(int x, int y) const { return ((bits[x * stride + (y >> 6)] >> (y & 63)) & 1ULL) != 0; }
+		inline void set(int x, int y, bool value) {
+			uint64_t bit = 1ULL << (y & 63);
+			if (value)
+				bits[x * stride + (y >> 6)] |= bit;
+			else
+				bits[x * stride + (y >> 6)] &= ~bit;
+		}
+
+		//Sets every cell to pred(i), i being the cell's x * size + y index
+		template<typename Pred>
+		void build(Pred pred, int threads) {
+			parallelFor(0, size, threads, [&](int x0, int x1) {
+				for (int x = x0; x < x1; x++) {
+					uint64_t* row = bits.data() + (x * stride);
+					for (int w = 0; w < stride; w++) {
+						uint64_t word = 0;
+						int y0 = w * 64, y1 = y0 + 64 < size ? y0 + 64 : size;
+						for (int y = y0; y < y1; y++)
+							if (pred(x * size + y))
+								word |= 1ULL << (y - y0);
+						row[w] = word;
+					}
+				}
+			});
+		}
+
+		int64_t count() const;
+		void invert();
+		void andNot(const BitMask& other); //Clears every cell set in other
+
+		//One step grows (dilate) or shrinks (erode) the mask by one cell of the shape, radius repeats it
+		void dilate(BitMask& out, MorphShape shape, int radius, int threads) const;
+		void erode(BitMask& out, MorphShape shape, int radius, int threads) const;
+		//Open removes specks and thin spurs smaller then the radius, close fills gaps and inlets of that size
+		void open(BitMask& out, MorphShape shape, int radius, int threads) const;
+		void close(BitMask& out, MorphShape shape, int radius, int threads) const;
+
+		//The cells outside the mask within width steps of it (the land along a coast for a water mask)
+		void shoreBand(BitMask& out, MorphShape shape, int width, int threads) const;
+
+		//Cells whose 3x3 neighborhood has every "hit" neighbor set and every "miss" neighbor clear.
+		//Patterns hold one bit per neighbor, bit (dx + 1) * 3 + (dy + 1), see hitOrMissBit
+		void hitOrMiss(BitMask& out, uint16_t hit, uint16_t miss, int threads) const;
+		static inline uint16_t hitOrMissBit(int dx, int dy) { return (uint16_t)(1 << ((dx + 1) * 3 + (dy + 1))); }
+	private:
+		uint64_t lastMask; //Valid bits of the last word in a row
+
+		void morphStep(BitMask& out, MorphShape shape, bool grow, int threads) const;
+		void repeat(BitMask& out, MorphShape shape, bool grow, int radius, int threads) const;
+		void shiftRow(const uint64_t* row, uint64_t* out, int dy) const;
+	};
+}
@@ -0,0 +1,91 @@
+#include "WGBlur.h"
+#include "WGParallel.h"
+#include "WGSimd.h"
+
+#include <vector>
+#include <algorithm>
+
+using namespace WG;
+
+//Maps a position past the edge back onto the map
+static inline int boundIndex(int i, int size, StencilBoundary boundary) {
+	if (boundary == STENCIL_WRAP)
+		return ((i % size) + size) % size;
+	return std::max(0, std::min(i, size - 1));
+}
+
+//One step of the running sum along x for a run of cells:
+//writes the current window average, then slides the window on by a row
+struct BoxSlideKernel {
+	float* sum;
+	const float* enter;
+	const float* leave;
+	float* out;
+	float scale;
+
+	template<typename V>
+	inline void run(int i) {
+		typedef Lanes<V> Ln;
+		V s = Ln::load(sum + i);
+		Ln::store(out + i, s * V(scale));
+		Ln::store(sum + i, s + Ln::load(enter + i) - Ln::load(leave + i));
+	}
+};
+
+void WG::boxBlur(FloatData* data, int radius, int passes, StencilBoundary alongX, StencilBoundary alongY, int threads) {
+	int size = data->size;
+	if (radius <= 0 || passes <= 0 || size <= 1)
+		return;
+	int width = (2 * radius) + 1;
+	float scale = 1.0f / (float)width;
+
+	//Along y, inside each row
+	parallelFor(0, size, threads, [&](int x0, int x1) {
+		std::vector<float> line(size + (2 * radius));
+		for (int x = x0; x < x1; x++) {
+			float* row = data->data + (x * size);
+			for (int p = 0; p < passes; p++) {
+				for (int i = 0; i < (int)line.size(); i++)
+					line[i] = row[boundIndex(i - radius, size, alongY)];
+
+				float sum = 0.0f;
+				for (int i = 0; i < width; i++)
+					sum += line[i];
+				for (int y = 0; y < size; y++) {
+					row[y] = sum * scale;
+					if (y + 1 < size)
+						sum += line[y + width] - line[y];
+				}
+			}
+		}
+	});
+
+	//Along x, a band of every row at a time, ping-ponging between the layer and a scratch copy
+	std::vector<float> scratch(size * size);
+	float* src = data->data;
+	float* dst = scratch.data();
+	for (int p = 0; p < passes; p++) {
+		parallelFor(0, size, threads, [&](int y0, int y1) {
+			std::vector<float> sum(y1 - y0, 0.0f);
+			for (int i = -radius; i <= radius; i++) {
+				const float* row = src + (boundIndex(i, size, alongX) * size) + y0;
+				for (int y = 0; y < y1 - y0; y++)
+					sum[y] += row[y];
+			}
+
+			BoxSlideKernel kernel;
+			kernel.sum = sum.data();
+			kernel.scale = scale;
+			for (int x = 0; x < size; x++) {
+				kernel.out = dst + (x * size) + y0;
+				kernel.enter = src + (boundIndex(x + radius + 1, size, alongX) * size) + y0;
+				kernel.leave = src + (boundIndex(x - radius, size, alongX) * size) + y0;
+				forEachLane(0, y1 - y0, kernel);
+			}
+		});
+		std::swap(src, dst);
+	}
+
+	if (src != data->data)
+		std::copy(src, src + (size * size), data->data);
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "WGFloatData.h"
+#include "WGStencil.h"
+
+#include <cmath>
+
+namespace WG {
+	//Blurs a layer with a box filter of width (2 * radius + 1) run "passes" times along each axis.
+	//Three passes are already very close to a Gaussian (see boxBlurSigma for its width).
+	//
+	//Every pass is a running sum, so the cost per cell doesn't depend on the radius. Along y (inside a row)
+	//each row is summed on its own. Along x the running sum is kept for a whole band of the row at once,
+	//4 cells at a time, adding the row entering the window and taking away the one leaving it.
+	//Both directions are split over threads. How the edges are read is given per axis.
+	void boxBlur(FloatData* data, int radius, int passes, StencilBoundary alongX, StencilBoundary alongY, int threads);
+
+	//Standard deviation of the blur boxBlur makes (each box adds (w^2 - 1) / 12 to the variance)
+	inline float boxBlurSigma(int radius, int passes) {
+		float width = (float)(2 * radius + 1);
+		return sqrtf((float)passes * ((width * width) - 1.0f) / 12.0f);
+	}
+}
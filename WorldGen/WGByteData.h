@@ -1,6 +1,7 @@
 #pragma once
 #include <memory>
 #include <algorithm>
+#include <cstdint>
 
 using namespace std;
 
@@ -9,24 +10,29 @@ namespace WG {
 	struct ByteData {
 		uint8_t* data;
 		int size;
+		bool owned; //False for views of memory owned elsewhere (a mapped WorldFile), which is never freed here
 
 		ByteData(int size) {
 			this->data = new uint8_t[size * size];
 			this->size = size;
+			this->owned = true;
+		}
+		//A view of size * size values someone else owns, nothing is copied
+		ByteData(uint8_t* data, int size) {
+			this->data = data;
+			this->size = size;
+			this->owned = false;
 		}
 		ByteData(ByteData &copy) {
 			this->size = copy.size;
 			this->data = new uint8_t[size * size];
+			this->owned = true;
 
-			for (int y = 0; y < size; y++) {
-				for (int x = 0; x < size; x++) {
-					this->data[x*size + y] = copy.data[x*size*y];
-				}
-			}
+			std::copy(copy.data, copy.data + (size * size), this->data);
 		}
 
 		~ByteData() {
-			if (data != NULL)
+			if (owned && data != NULL)
 				delete[] data;
 		}
 
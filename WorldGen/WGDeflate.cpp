@@ -0,0 +1,614 @@
+#include "WGDeflate.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace WG;
+
+static const int WINDOW = 32768;
+static const int HASH_BITS = 15;
+static const int MIN_MATCH = 3;
+static const int MAX_MATCH = 258;
+static const int LOOKAHEAD = MAX_MATCH + MIN_MATCH + 1; //Input kept ahead of the match search until the end
+static const int BLOCK_SYMBOLS = 32768; //Symbols per Huffman block
+static const int STORED_BLOCK = 65535; //Largest stored block
+
+//Index of the lowest set bit, word must not be 0
+static inline int lowestBit(uint64_t word) {
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long idx;
+	_BitScanForward64(&idx, word);
+	return (int)idx;
+#elif defined(_MSC_VER)
+	unsigned long idx;
+	if (_BitScanForward(&idx, (unsigned long)word))
+		return (int)idx;
+	_BitScanForward(&idx, (unsigned long)(word >> 32));
+	return (int)idx + 32;
+#else
+	return __builtin_ctzll(word);
+#endif
+}
+
+static const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+//Order the code length code lengths are stored in
+static const uint8_t CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+//Canonical Huffman codes for the lengths, bit reversed since deflate sends them highest bit first
+static void buildCodes(const uint8_t* lengths, int count, uint16_t* codes) {
+	int lengthCount[16] = {};
+	for (int s = 0; s < count; s++)
+		lengthCount[lengths[s]]++;
+	lengthCount[0] = 0;
+
+	uint32_t next[16] = {};
+	uint32_t code = 0;
+	for (int bits = 1; bits < 16; bits++) {
+		code = (code + lengthCount[bits - 1]) << 1;
+		next[bits] = code;
+	}
+	for (int s = 0; s < count; s++) {
+		int length = lengths[s];
+		uint32_t c = length > 0 ? next[length]++ : 0, reversed = 0;
+		for (int b = 0; b < length; b++) {
+			reversed = (reversed << 1) | (c & 1);
+			c >>= 1;
+		}
+		codes[s] = (uint16_t)reversed;
+	}
+}
+
+//Huffman code lengths for the frequencies, none longer than maxLength
+static void buildLengths(const uint32_t* freq, int count, int maxLength, uint8_t* lengths) {
+	std::fill(lengths, lengths + count, (uint8_t)0);
+	int order[288];
+	int n = 0;
+	for (int s = 0; s < count; s++) {
+		if (freq[s] > 0)
+			order[n++] = s;
+	}
+	if (n == 0)
+		return;
+	if (n == 1) {
+		lengths[order[0]] = 1;
+		return;
+	}
+	std::stable_sort(order, order + n, [freq](int a, int b) { return freq[a] < freq[b]; });
+
+	//Optimal lengths in place over the sorted frequencies (Moffat and Katajainen 1995), longest first
+	int a[288];
+	for (int i = 0; i < n; i++)
+		a[i] = (int)freq[order[i]];
+	a[0] += a[1];
+	int root = 0, leaf = 2;
+	for (int next = 1; next < n - 1; next++) {
+		if (leaf >= n || a[root] < a[leaf]) {
+			a[next] = a[root];
+			a[root++] = next;
+		} else
+			a[next] = a[leaf++];
+		if (leaf >= n || (root < next && a[root] < a[leaf])) {
+			a[next] += a[root];
+			a[root++] = next;
+		} else
+			a[next] += a[leaf++];
+	}
+	a[n - 2] = 0;
+	for (int next = n - 3; next >= 0; next--)
+		a[next] = a[a[next]] + 1;
+	int available = 1, used = 0, depth = 0, next = n - 1;
+	root = n - 2;
+	while (available > 0) {
+		while (root >= 0 && a[root] == depth) {
+			used++;
+			root--;
+		}
+		while (available > used) {
+			a[next--] = depth;
+			available--;
+		}
+		available = 2 * used;
+		depth++;
+		used = 0;
+	}
+
+	//Fold anything too long into maxLength, then lengthen the shortest codes that can take it until the
+	//code is complete again
+	int lengthCount[33] = {};
+	for (int i = 0; i < n; i++)
+		lengthCount[std::min(a[i], 32)]++;
+	for (int l = maxLength + 1; l <= 32; l++) {
+		lengthCount[maxLength] += lengthCount[l];
+		lengthCount[l] = 0;
+	}
+	uint32_t total = 0;
+	for (int l = maxLength; l > 0; l--)
+		total += (uint32_t)lengthCount[l] << (maxLength - l);
+	while (total != (1u << maxLength)) {
+		lengthCount[maxLength]--;
+		for (int l = maxLength - 1; l > 0; l--) {
+			if (lengthCount[l] > 0) {
+				lengthCount[l]--;
+				lengthCount[l + 1] += 2;
+				break;
+			}
+		}
+		total--;
+	}
+
+	//Least frequent get the longest
+	int i = 0;
+	for (int l = maxLength; l > 0; l--) {
+		for (int k = 0; k < lengthCount[l]; k++)
+			lengths[order[i++]] = (uint8_t)l;
+	}
+}
+
+//Everything worked out once: checksum tables, symbol lookups and the fixed Huffman codes
+struct DeflateTables {
+	uint32_t crc[8][256];
+	uint8_t lengthCode[256]; //By length - 3
+	uint8_t distanceCodeSmall[512]; //By distance - 1 below 512
+	uint8_t distanceCodeLarge[128]; //By (distance - 1) >> 8 from 512 on
+	uint8_t fixedLiteralLengths[288];
+	uint16_t fixedLiteralCodes[288];
+	uint8_t fixedDistanceLengths[30];
+	uint16_t fixedDistanceCodes[30];
+
+	DeflateTables() {
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; k++)
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : (c >> 1);
+			crc[0][i] = c;
+		}
+		for (int s = 1; s < 8; s++) {
+			for (int i = 0; i < 256; i++)
+				crc[s][i] = (crc[s - 1][i] >> 8) ^ crc[0][crc[s - 1][i] & 0xFF];
+		}
+
+		for (int c = 0; c < 29; c++) {
+			for (int l = LENGTH_BASE[c]; l < LENGTH_BASE[c] + (1 << LENGTH_EXTRA[c]) && l <= 258; l++)
+				lengthCode[l - 3] = (uint8_t)c;
+		}
+		for (int c = 0; c < 30; c++) {
+			for (int d = DISTANCE_BASE[c]; d < DISTANCE_BASE[c] + (1 << DISTANCE_EXTRA[c]); d++) {
+				if (d <= 512)
+					distanceCodeSmall[d - 1] = (uint8_t)c;
+				else
+					distanceCodeLarge[(d - 1) >> 8] = (uint8_t)c;
+			}
+		}
+
+		for (int s = 0; s < 288; s++)
+			fixedLiteralLengths[s] = (uint8_t)(s < 144 ? 8 : (s < 256 ? 9 : (s < 280 ? 7 : 8)));
+		buildCodes(fixedLiteralLengths, 288, fixedLiteralCodes);
+		std::fill(fixedDistanceLengths, fixedDistanceLengths + 30, (uint8_t)5);
+		buildCodes(fixedDistanceLengths, 30, fixedDistanceCodes);
+	}
+
+	inline int distanceCode(uint32_t distance) const {
+		return distance <= 512 ? distanceCodeSmall[distance - 1] : distanceCodeLarge[(distance - 1) >> 8];
+	}
+};
+static const DeflateTables tables;
+
+uint32_t WG::crc32(uint32_t crc, const uint8_t* data, size_t length) {
+	crc = ~crc;
+	//Slicing by 8, two words at a time
+	for (; length >= 8; length -= 8, data += 8) {
+		uint32_t one, two;
+		memcpy(&one, data, 4);
+		memcpy(&two, data + 4, 4);
+		one ^= crc;
+		crc = tables.crc[7][one & 0xFF] ^ tables.crc[6][(one >> 8) & 0xFF] ^ tables.crc[5][(one >> 16) & 0xFF] ^ tables.crc[4][one >> 24] ^
+			tables.crc[3][two & 0xFF] ^ tables.crc[2][(two >> 8) & 0xFF] ^ tables.crc[1][(two >> 16) & 0xFF] ^ tables.crc[0][two >> 24];
+	}
+	for (; length > 0; length--)
+		crc = tables.crc[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+uint32_t WG::adler32(uint32_t adler, const uint8_t* data, size_t length) {
+	uint32_t a = adler & 0xFFFF, b = adler >> 16;
+	while (length > 0) {
+		//The most bytes before b could overflow
+		size_t n = std::min(length, (size_t)5552);
+		length -= n;
+		for (; n > 0; n--) {
+			a += *data++;
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+	}
+	return (b << 16) | a;
+}
+
+uint32_t WG::adler32Combine(uint32_t first, uint32_t second, uint64_t secondLength) {
+	//Every byte of the second piece adds the first piece's sum to b once more
+	const uint32_t BASE = 65521;
+	uint32_t remainder = (uint32_t)(secondLength % BASE);
+	uint32_t a = first & 0xFFFF;
+	uint32_t b = (uint32_t)(((uint64_t)remainder * a) % BASE);
+	a += (second & 0xFFFF) + BASE - 1;
+	b += (first >> 16) + (second >> 16) + BASE - remainder;
+	a %= BASE;
+	b %= BASE;
+	return (b << 16) | a;
+}
+
+static inline uint32_t hashBytes(const uint8_t* p, int bits) {
+	uint32_t v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+	return (v * 2654435761u) >> (32 - bits);
+}
+
+//Bytes a and b have in common, up to limit. Reads up to 7 bytes past the limit
+static inline int matchLength(const uint8_t* a, const uint8_t* b, int limit) {
+	int length = 0;
+	for (; length + 8 <= limit; length += 8) {
+		uint64_t x, y;
+		memcpy(&x, a + length, 8);
+		memcpy(&y, b + length, 8);
+		if (x != y)
+			return length + (lowestBit(x ^ y) >> 3);
+	}
+	while (length < limit && a[length] == b[length])
+		length++;
+	return length;
+}
+
+Deflater::Deflater(int level, DeflateOutput output) {
+	static const int CHAINS[10] = { 0, 4, 8, 16, 32, 32, 64, 128, 256, 1024 };
+	this->level = std::max(0, std::min(level, 9));
+	this->maxChain = CHAINS[this->level];
+	this->niceLength = this->level >= 7 ? MAX_MATCH : 32;
+	this->lazy = this->level >= 4;
+	this->output = output;
+
+	this->window.assign((2 * WINDOW) + 8, 0);
+	if (this->level > 0) {
+		this->head.assign(1 << HASH_BITS, -1);
+		this->prev.assign(WINDOW, -1);
+		this->symbols.reserve(BLOCK_SYMBOLS);
+	}
+	std::fill(literalFreq, literalFreq + 286, 0u);
+	std::fill(distanceFreq, distanceFreq + 30, 0u);
+	this->out.reserve(1 << 16);
+}
+
+bool Deflater::write(const uint8_t* data, size_t length) {
+	if (failed)
+		return false;
+
+	if (level == 0) {
+		//Straight into stored blocks, the window just collects a block's worth
+		while (length > 0) {
+			size_t n = std::min(length, (size_t)(STORED_BLOCK - end));
+			memcpy(window.data() + end, data, n);
+			end += (int32_t)n;
+			data += n;
+			length -= n;
+			if (end == STORED_BLOCK) {
+				writeStored(window.data(), end, false);
+				end = 0;
+				if (!drain())
+					return false;
+			}
+		}
+		return true;
+	}
+
+	while (length > 0) {
+		if (end == 2 * WINDOW)
+			slide();
+		size_t n = std::min(length, (size_t)((2 * WINDOW) - end));
+		memcpy(window.data() + end, data, n);
+		end += (int32_t)n;
+		data += n;
+		length -= n;
+		compress(false);
+	}
+	return drain();
+}
+
+bool Deflater::flush() {
+	if (failed)
+		return false;
+	if (level == 0) {
+		if (end > 0)
+			writeStored(window.data(), end, false);
+		end = 0;
+	} else {
+		compress(true);
+		if (!symbols.empty())
+			writeBlock(false);
+	}
+	writeStored(NULL, 0, false);
+	return drain();
+}
+
+bool Deflater::finish() {
+	if (failed)
+		return false;
+	if (level == 0) {
+		writeStored(window.data(), end, true);
+		end = 0;
+	} else {
+		compress(true);
+		writeBlock(true);
+	}
+	alignBits();
+	return drain();
+}
+
+void Deflater::insert(int32_t position) {
+	uint32_t h = hashBytes(window.data() + position, HASH_BITS);
+	prev[position & (WINDOW - 1)] = head[h];
+	head[h] = position;
+}
+
+//Longest earlier match for position up to limit bytes, 0 if there's none of MIN_MATCH bytes.
+//Distances stay under WINDOW so every prev entry on the way is still the one its position wrote
+int Deflater::findMatch(int32_t position, int limit, int& distance) const {
+	const uint8_t* b = window.data() + position;
+	int best = MIN_MATCH - 1;
+	int32_t lowest = std::max(position - (WINDOW - 1), 0);
+	int32_t candidate = head[hashBytes(b, HASH_BITS)];
+	for (int chain = maxChain; candidate >= lowest && chain > 0; chain--) {
+		const uint8_t* a = window.data() + candidate;
+		if (a[best] == b[best] && a[0] == b[0] && a[1] == b[1]) {
+			int length = matchLength(a, b, limit);
+			if (length > best) {
+				best = length;
+				distance = position - candidate;
+				if (length >= limit || length >= niceLength)
+					break;
+			}
+		}
+		candidate = prev[candidate & (WINDOW - 1)];
+	}
+	return best >= MIN_MATCH ? best : 0;
+}
+
+//Moves the newer half of the window down, dropping positions too far back to match
+void Deflater::slide() {
+	memmove(window.data(), window.data() + WINDOW, end - WINDOW);
+	start -= WINDOW;
+	end -= WINDOW;
+	for (int32_t& p : head)
+		p = p >= WINDOW ? p - WINDOW : -1;
+	for (int32_t& p : prev)
+		p = p >= WINDOW ? p - WINDOW : -1;
+}
+
+//Turns the input into symbols, stopping LOOKAHEAD bytes before the end unless all is set
+void Deflater::compress(bool all) {
+	while (true) {
+		int32_t available = end - start;
+		if (available <= 0 || (!all && available < LOOKAHEAD))
+			break;
+
+		int limit = std::min(MAX_MATCH, (int)available);
+		int distance = 0, length = 0;
+		if (limit >= MIN_MATCH) {
+			length = findMatch(start, limit, distance);
+			insert(start);
+		}
+		//Lazy matching: when the next byte starts a longer match, this one goes as a literal
+		while (lazy && length >= MIN_MATCH && length < niceLength) {
+			int nextDistance = 0;
+			int nextLength = findMatch(start + 1, std::min(MAX_MATCH, (int)available - 1), nextDistance);
+			if (nextLength <= length)
+				break;
+			addSymbol(window[start]);
+			start++;
+			available--;
+			insert(start);
+			length = nextLength;
+			distance = nextDistance;
+		}
+
+		if (length >= MIN_MATCH) {
+			addSymbol(((uint32_t)distance << 8) | (uint32_t)(length - MIN_MATCH));
+			for (int k = 1; k < length; k++) {
+				if (available - k >= MIN_MATCH)
+					insert(start + k);
+			}
+			start += length;
+		} else {
+			addSymbol(window[start]);
+			start++;
+		}
+	}
+}
+
+void Deflater::addSymbol(uint32_t symbol) {
+	symbols.push_back(symbol);
+	if (symbol < 256)
+		literalFreq[symbol]++;
+	else {
+		literalFreq[257 + tables.lengthCode[symbol & 0xFF]]++;
+		distanceFreq[tables.distanceCode(symbol >> 8)]++;
+	}
+	if ((int)symbols.size() == BLOCK_SYMBOLS) {
+		writeBlock(false);
+		drain();
+	}
+}
+
+void Deflater::putBits(uint32_t value, int count) {
+	bits |= (uint64_t)value << bitCount;
+	bitCount += count;
+	if (bitCount >= 32) {
+		for (int k = 0; k < 4; k++)
+			out.push_back((uint8_t)(bits >> (k * 8)));
+		bits >>= 32;
+		bitCount -= 32;
+	}
+}
+
+//Pads with zero bits to the next byte
+void Deflater::alignBits() {
+	while (bitCount > 0) {
+		out.push_back((uint8_t)bits);
+		bits >>= 8;
+		bitCount -= 8;
+	}
+	bits = 0;
+	bitCount = 0;
+}
+
+//Hands the finished bytes to the output
+bool Deflater::drain() {
+	if (!failed && !out.empty() && !output(out.data(), out.size()))
+		failed = true;
+	out.clear();
+	return !failed;
+}
+
+void Deflater::writeBlock(bool last) {
+	literalFreq[256]++;
+
+	uint8_t literalLengths[286], distanceLengths[30];
+	buildLengths(literalFreq, 286, 15, literalLengths);
+	buildLengths(distanceFreq, 30, 15, distanceLengths);
+	//A block needs at least one distance code, even with no matches
+	bool anyDistance = false;
+	for (int s = 0; s < 30; s++)
+		anyDistance = anyDistance || distanceLengths[s] > 0;
+	if (!anyDistance)
+		distanceLengths[0] = 1;
+
+	int literalCount = 286, distanceCount = 30;
+	while (literalCount > 257 && literalLengths[literalCount - 1] == 0)
+		literalCount--;
+	while (distanceCount > 1 && distanceLengths[distanceCount - 1] == 0)
+		distanceCount--;
+
+	//Both length lists run length coded as one: 16 repeats the last length 3-6 times, 17 and 18 are 3-10
+	//and 11-138 zeros
+	uint8_t all[286 + 30];
+	std::copy(literalLengths, literalLengths + literalCount, all);
+	std::copy(distanceLengths, distanceLengths + distanceCount, all + literalCount);
+	int allCount = literalCount + distanceCount;
+	uint8_t runSymbols[286 + 30], runExtra[286 + 30];
+	int runCount = 0;
+	uint32_t codeLengthFreq[19] = {};
+	auto addRun = [&](int symbol, int extra) {
+		runSymbols[runCount] = (uint8_t)symbol;
+		runExtra[runCount++] = (uint8_t)extra;
+		codeLengthFreq[symbol]++;
+	};
+	for (int i = 0; i < allCount;) {
+		uint8_t length = all[i];
+		int run = 1;
+		while (i + run < allCount && all[i + run] == length)
+			run++;
+		i += run;
+		if (length == 0) {
+			for (; run >= 11; run -= std::min(run, 138))
+				addRun(18, std::min(run, 138) - 11);
+			if (run >= 3) {
+				addRun(17, run - 3);
+				run = 0;
+			}
+		} else {
+			addRun(length, 0);
+			for (run--; run >= 3; run -= std::min(run, 6))
+				addRun(16, std::min(run, 6) - 3);
+		}
+		for (; run > 0; run--)
+			addRun(length, 0);
+	}
+	uint8_t codeLengthLengths[19];
+	uint16_t codeLengthCodes[19];
+	buildLengths(codeLengthFreq, 19, 7, codeLengthLengths);
+	buildCodes(codeLengthLengths, 19, codeLengthCodes);
+	int codeLengthCount = 19;
+	while (codeLengthCount > 4 && codeLengthLengths[CODE_LENGTH_ORDER[codeLengthCount - 1]] == 0)
+		codeLengthCount--;
+
+	//Sizes of the block both ways, the extra bits being the same for both
+	static const int RUN_EXTRA_BITS[3] = { 2, 3, 7 };
+	uint64_t dynamicBits = 14 + (3 * codeLengthCount), fixedBits = 0, extraBits = 0;
+	for (int r = 0; r < runCount; r++)
+		dynamicBits += codeLengthLengths[runSymbols[r]] + (runSymbols[r] >= 16 ? RUN_EXTRA_BITS[runSymbols[r] - 16] : 0);
+	for (int s = 0; s < 286; s++) {
+		dynamicBits += (uint64_t)literalFreq[s] * literalLengths[s];
+		fixedBits += (uint64_t)literalFreq[s] * tables.fixedLiteralLengths[s];
+		if (s > 256)
+			extraBits += (uint64_t)literalFreq[s] * LENGTH_EXTRA[s - 257];
+	}
+	for (int s = 0; s < 30; s++) {
+		dynamicBits += (uint64_t)distanceFreq[s] * distanceLengths[s];
+		fixedBits += (uint64_t)distanceFreq[s] * 5;
+		extraBits += (uint64_t)distanceFreq[s] * DISTANCE_EXTRA[s];
+	}
+
+	uint16_t dynamicLiteralCodes[286], dynamicDistanceCodes[30];
+	const uint8_t* useLiteralLengths = tables.fixedLiteralLengths;
+	const uint16_t* useLiteralCodes = tables.fixedLiteralCodes;
+	const uint8_t* useDistanceLengths = tables.fixedDistanceLengths;
+	const uint16_t* useDistanceCodes = tables.fixedDistanceCodes;
+	putBits(last ? 1 : 0, 1);
+	if (dynamicBits < fixedBits) {
+		buildCodes(literalLengths, 286, dynamicLiteralCodes);
+		buildCodes(distanceLengths, 30, dynamicDistanceCodes);
+		useLiteralLengths = literalLengths;
+		useLiteralCodes = dynamicLiteralCodes;
+		useDistanceLengths = distanceLengths;
+		useDistanceCodes = dynamicDistanceCodes;
+
+		putBits(2, 2);
+		putBits(literalCount - 257, 5);
+		putBits(distanceCount - 1, 5);
+		putBits(codeLengthCount - 4, 4);
+		for (int k = 0; k < codeLengthCount; k++)
+			putBits(codeLengthLengths[CODE_LENGTH_ORDER[k]], 3);
+		for (int r = 0; r < runCount; r++) {
+			int symbol = runSymbols[r];
+			putBits(codeLengthCodes[symbol], codeLengthLengths[symbol]);
+			if (symbol >= 16)
+				putBits(runExtra[r], RUN_EXTRA_BITS[symbol - 16]);
+		}
+	} else
+		putBits(1, 2);
+
+	for (uint32_t symbol : symbols) {
+		if (symbol < 256) {
+			putBits(useLiteralCodes[symbol], useLiteralLengths[symbol]);
+			continue;
+		}
+		int length = (int)(symbol & 0xFF) + MIN_MATCH;
+		uint32_t distance = symbol >> 8;
+		int lc = tables.lengthCode[symbol & 0xFF], dc = tables.distanceCode(distance);
+		putBits(useLiteralCodes[257 + lc], useLiteralLengths[257 + lc]);
+		putBits(length - LENGTH_BASE[lc], LENGTH_EXTRA[lc]);
+		putBits(useDistanceCodes[dc], useDistanceLengths[dc]);
+		putBits(distance - DISTANCE_BASE[dc], DISTANCE_EXTRA[dc]);
+	}
+	putBits(useLiteralCodes[256], useLiteralLengths[256]);
+
+	symbols.clear();
+	std::fill(literalFreq, literalFreq + 286, 0u);
+	std::fill(distanceFreq, distanceFreq + 30, 0u);
+}
+
+void Deflater::writeStored(const uint8_t* data, int length, bool last) {
+	putBits(last ? 1 : 0, 1);
+	putBits(0, 2);
+	alignBits();
+	out.push_back((uint8_t)length);
+	out.push_back((uint8_t)(length >> 8));
+	out.push_back((uint8_t)~length);
+	out.push_back((uint8_t)(~length >> 8));
+	out.insert(out.end(), data, data + length);
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+namespace WG {
+	//Checksums for the PNG chunks (crc starting from 0) and the zlib stream (adler starting from 1)
+	uint32_t crc32(uint32_t crc, const uint8_t* data, size_t length);
+	uint32_t adler32(uint32_t adler, const uint8_t* data, size_t length);
+	//Adler-32 of two pieces of data put together, from their own checksums and the second one's length
+	uint32_t adler32Combine(uint32_t first, uint32_t second, uint64_t secondLength);
+
+	//Receives the compressed bytes as they're made, false to stop the stream
+	typedef std::function<bool(const uint8_t* data, size_t length)> DeflateOutput;
+
+	//Streaming raw deflate (RFC 1951) compressor, for the PNG writer, with no zlib dependency.
+	//
+	//Input goes through a 64 KB sliding window. Matches are found through hash chains over 3 byte prefixes
+	//(chain length set by the level, with one step of lazy matching from level 4), and every 32768 symbols
+	//become a block coded with its own Huffman tables, or the fixed ones when those come out smaller.
+	//Level 0 stores the input as it is. Memory stays under half a megabyte whatever the input size.
+	class Deflater {
+	public:
+		Deflater(int level, DeflateOutput output);
+
+		bool write(const uint8_t* data, size_t length);
+		//Ends the input on a byte boundary with an empty stored block (a sync flush), so another stream can follow
+		bool flush();
+		//Ends the stream with its final block
+		bool finish();
+	private:
+		int level;
+		int maxChain; //Candidates tried per match search
+		int niceLength; //Match length that ends the search and skips the lazy step
+		bool lazy;
+		DeflateOutput output;
+		bool failed = false;
+
+		std::vector<uint8_t> window; //2 * WINDOW bytes and some padding for the 8 byte compares
+		int32_t start = 0, end = 0; //Next byte to compress and end of the input in window
+		std::vector<int32_t> head; //Latest window position of every hash, -1 for none
+		std::vector<int32_t> prev; //Previous position with the same hash, by position & (WINDOW - 1)
+
+		std::vector<uint32_t> symbols; //Literal byte, or (distance << 8) | (length - 3) of a match
+		uint32_t literalFreq[286];
+		uint32_t distanceFreq[30];
+
+		std::vector<uint8_t> out;
+		uint64_t bits = 0;
+		int bitCount = 0;
+
+		void insert(int32_t position);
+		int findMatch(int32_t position, int limit, int& distance) const;
+		void slide();
+		void compress(bool all);
+		void addSymbol(uint32_t symbol);
+
+		void putBits(uint32_t value, int count);
+		void alignBits();
+		bool drain();
+		void writeBlock(bool last);
+		void writeStored(const uint8_t* data, int length, bool last);
+	};
+}
@@ -0,0 +1,112 @@
+#include "WGDerivedTerrain.h"
+#include "WGParallel.h"
+#include "WGSimd.h"
+
+using namespace WG;
+
+//Steepest descent drop is divided by the distance, so diagonals count a little less
+static const float DIAGONAL = 0.70710678f;
+
+//Gradient, slope and steepest descent for a run of cells in one row (just the descent without Gradients).
+//Rows x-1 and x+1 are clamped onto this one at the map edge, yUp/yDown do the same along the row.
+template<bool Gradients>
+struct DerivedKernel {
+	const float *hPrev, *hCur, *hNext;
+	float *gradX, *gradY, *slope;
+	uint8_t* flow;
+	int yUp, yDown;
+
+	template<typename V>
+	inline void run(int y) {
+		typedef Lanes<V> Ln;
+
+		V c = Ln::load(hCur + y);
+		V n = Ln::load(hCur + y + yUp), s = Ln::load(hCur + y + yDown);
+		V w = Ln::load(hPrev + y), e = Ln::load(hNext + y);
+
+		if (Gradients) {
+			V gx = (e - w) * V(0.5f);
+			V gy = (s - n) * V(0.5f);
+			Ln::store(gradX + y, gx);
+			Ln::store(gradY + y, gy);
+			Ln::store(slope + y, vsqrt((gx * gx) + (gy * gy)));
+		}
+
+		//Steepest drop, same order as FLOW_DX/FLOW_DY. A neighbor clamped onto this cell never drops
+		V drop[8];
+		drop[0] = c - n;
+		drop[1] = (c - Ln::load(hNext + y + yUp)) * V(DIAGONAL);
+		drop[2] = c - e;
+		drop[3] = (c - Ln::load(hNext + y + yDown)) * V(DIAGONAL);
+		drop[4] = c - s;
+		drop[5] = (c - Ln::load(hPrev + y + yDown)) * V(DIAGONAL);
+		drop[6] = c - w;
+		drop[7] = (c - Ln::load(hPrev + y + yUp)) * V(DIAGONAL);
+
+		V best(0.0f), bestDir((float)FLOW_NONE);
+		for (int d = 0; d < 8; d++) {
+			V steeper = vgreater(drop[d], best);
+			best = vselect(steeper, drop[d], best);
+			bestDir = vselect(steeper, V((float)d), bestDir);
+		}
+
+		float dirs[Lanes<V>::width];
+		Ln::store(dirs, bestDir);
+		for (int i = 0; i < Lanes<V>::width; i++)
+			flow[y + i] = (uint8_t)dirs[i];
+	}
+};
+
+DerivedTerrain::DerivedTerrain(int size) {
+	gradientX = new FloatData(size);
+	gradientY = new FloatData(size);
+	slope = new FloatData(size);
+	flowDirection = new ByteData(size);
+}
+
+DerivedTerrain::~DerivedTerrain() {
+	delete gradientX;
+	delete gradientY;
+	delete slope;
+	delete flowDirection;
+}
+
+//Runs the kernel over every row, the gradient layers are only touched with Gradients
+template<bool Gradients>
+static void runDerived(FloatData* height, FloatData* gradientX, FloatData* gradientY, FloatData* slope, ByteData* flow, int threads) {
+	int size = height->size;
+
+	parallelFor(0, size, threads, [&](int x0, int x1) {
+		DerivedKernel<Gradients> kernel;
+		for (int x = x0; x < x1; x++) {
+			kernel.hPrev = height->data + (std::max(x - 1, 0) * size);
+			kernel.hCur = height->data + (x * size);
+			kernel.hNext = height->data + (std::min(x + 1, size - 1) * size);
+			if (Gradients) {
+				kernel.gradX = gradientX->data + (x * size);
+				kernel.gradY = gradientY->data + (x * size);
+				kernel.slope = slope->data + (x * size);
+			}
+			kernel.flow = flow->data + (x * size);
+
+			//Ends of the row clamp, the middle runs 4 cells at a time
+			kernel.yUp = 0;
+			kernel.yDown = size > 1 ? 1 : 0;
+			kernel.template run<float>(0);
+			if (size > 1) {
+				kernel.yUp = -1;
+				forEachLane(1, size - 1, kernel);
+				kernel.yDown = 0;
+				kernel.template run<float>(size - 1);
+			}
+		}
+	});
+}
+
+void DerivedTerrain::compute(FloatData* height, int threads) {
+	runDerived<true>(height, gradientX, gradientY, slope, flowDirection, threads);
+}
+
+void WG::computeFlowDirections(FloatData* height, ByteData* flow, int threads) {
+	runDerived<false>(height, NULL, NULL, NULL, flow, threads);
+}
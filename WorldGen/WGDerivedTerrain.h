@@ -0,0 +1,30 @@
+#pragma once
+#include "WGFloatData.h"
+#include "WGByteData.h"
+
+namespace WG {
+	//D8 flow directions, clockwise starting North (y - 1)
+	//North/North East/East/South East/South/South West/West/North West
+	const int FLOW_DX[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+	const int FLOW_DY[8] = { -1, -1, 0, 1, 1, 1, 0, -1 };
+	const uint8_t FLOW_NONE = 255; //No lower neighbor (pit, flat or the bottom of the sea)
+
+	//Values worked out from the height map that several stages and exporters need.
+	//Everything is built in one pass over the map by compute(), which the Generator
+	//does on demand and throws away whenever the height data changes.
+	struct DerivedTerrain {
+		FloatData* gradientX; //Central difference along x (height units per cell)
+		FloatData* gradientY; //Central difference along y
+		FloatData* slope; //Length of the gradient
+		ByteData* flowDirection; //Index into FLOW_DX/FLOW_DY of the steepest downhill neighbor, or FLOW_NONE
+
+		DerivedTerrain(int size);
+		~DerivedTerrain();
+
+		//Fills in every layer from the height map. Neighbors off the map clamp back onto the edge
+		void compute(FloatData* height, int threads);
+	};
+
+	//Just the flowDirection part of DerivedTerrain::compute, for surfaces other then the height map
+	void computeFlowDirections(FloatData* height, ByteData* flow, int threads);
+}
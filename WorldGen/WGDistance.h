@@ -0,0 +1,91 @@
+#pragma once
+#include "WGFloatData.h"
+#include "WGParallel.h"
+
+#include <vector>
+#include <cmath>
+
+namespace WG {
+	//Squared distance stand-in for "no seed anywhere on this line"
+	const float DISTANCE_FAR = 1.0e20f;
+
+	//One dimensional squared distance transform (Felzenszwalb & Huttenlocher) of n samples.
+	//f is the input cost (0 at seeds, DISTANCE_FAR elsewhere), d gets the squared distance to the nearest seed.
+	//v and z are scratch space of n and n + 1 entries.
+	inline void distanceTransform1D(const float* f, float* d, int n, int* v, double* z) {
+		//Lower envelope of the parabolas rooted at every reachable sample.
+		//Samples at DISTANCE_FAR are left out, they would only swamp the math with huge numbers
+		int k = -1;
+		for (int q = 0; q < n; q++) {
+			if (f[q] >= DISTANCE_FAR)
+				continue;
+
+			double s = 0.0;
+			while (k >= 0) {
+				int p = v[k];
+				s = (((double)f[q] + (double)q * q) - ((double)f[p] + (double)p * p)) / (2.0 * (q - p));
+				if (s > z[k])
+					break;
+				k--;
+			}
+
+			k++;
+			v[k] = q;
+			z[k] = k == 0 ? -DISTANCE_FAR : s;
+			z[k + 1] = DISTANCE_FAR;
+		}
+
+		//Nothing reachable on this line
+		if (k < 0) {
+			for (int q = 0; q < n; q++)
+				d[q] = DISTANCE_FAR;
+			return;
+		}
+
+		//Read the envelope back out
+		k = 0;
+		for (int q = 0; q < n; q++) {
+			while (z[k + 1] < (double)q)
+				k++;
+			float dq = (float)(q - v[k]);
+			d[q] = (dq * dq) + f[v[k]];
+		}
+	}
+
+	//Exact Euclidean distance (in cells) from every cell to the nearest seed cell, seed(i) picking the seeds.
+	//Runs the 1D transform down every row (x fixed, y varying) on separate threads, then across every
+	//column, which is the same thing on the squared row results. Each pass is linear, so the whole map is O(N).
+	//Without any seeds on the map every cell ends up at sqrt(DISTANCE_FAR).
+	template<typename Seed>
+	void distanceTransform(FloatData* out, Seed seed, int threads) {
+		int size = out->size;
+		float* data = out->data;
+
+		//Rows are contiguous, transform them in place
+		parallelFor(0, size, threads, [&](int x0, int x1) {
+			std::vector<float> f(size);
+			std::vector<int> v(size);
+			std::vector<double> z(size + 1);
+			for (int x = x0; x < x1; x++) {
+				float* row = data + (x * size);
+				for (int y = 0; y < size; y++)
+					f[y] = seed(x * size + y) ? 0.0f : DISTANCE_FAR;
+				distanceTransform1D(f.data(), row, size, v.data(), z.data());
+			}
+		});
+
+		//Columns are strided, so copy each one out and back
+		parallelFor(0, size, threads, [&](int y0, int y1) {
+			std::vector<float> f(size), d(size);
+			std::vector<int> v(size);
+			std::vector<double> z(size + 1);
+			for (int y = y0; y < y1; y++) {
+				for (int x = 0; x < size; x++)
+					f[x] = data[x * size + y];
+				distanceTransform1D(f.data(), d.data(), size, v.data(), z.data());
+				for (int x = 0; x < size; x++)
+					data[x * size + y] = sqrtf(d[x]);
+			}
+		});
+	}
+}
@@ -0,0 +1,108 @@
+#include "WGDrainageBasins.h"
+#include "WGParallel.h"
+
+using namespace WG;
+
+void DrainageBasins::build(const ByteData* flow, const ByteData* water, int threads) {
+	size = flow->size;
+	int total = size * size;
+	int32_t offsets[8];
+	for (int d = 0; d < 8; d++)
+		offsets[d] = (FLOW_DX[d] * size) + FLOW_DY[d];
+
+	//Cell a land cell drains into, -1 for the outlets
+	auto receiver = [&](int32_t i) {
+		uint8_t d = flow->data[i];
+		if (d == FLOW_NONE)
+			return -1;
+		int32_t r = i + offsets[d];
+		return water->data[r] == 1 ? -1 : r;
+	};
+
+	labels.assign(total, NO_BASIN);
+	upstreamArea.assign(total, 0);
+
+	//Outlets, counted per row first so every row knows where to write its own
+	std::vector<int32_t> rowStart(size + 1, 0);
+	parallelFor(0, size, threads, [&](int x0, int x1) {
+		for (int x = x0; x < x1; x++) {
+			int32_t count = 0;
+			for (int32_t i = x * size; i < (x + 1) * size; i++) {
+				if (water->data[i] != 1 && receiver(i) < 0)
+					count++;
+			}
+			rowStart[x + 1] = count;
+		}
+	});
+	for (int x = 0; x < size; x++)
+		rowStart[x + 1] += rowStart[x];
+
+	int32_t basinCount = rowStart[size];
+	std::vector<int32_t> outlets(basinCount);
+	parallelFor(0, size, threads, [&](int x0, int x1) {
+		for (int x = x0; x < x1; x++) {
+			int32_t next = rowStart[x];
+			for (int32_t i = x * size; i < (x + 1) * size; i++) {
+				if (water->data[i] != 1 && receiver(i) < 0)
+					outlets[next++] = i;
+			}
+		}
+	});
+
+	//Walk up every basin from its outlet. Each thread keeps the cells of its own run of basins,
+	//depth first, and adds up the upstream area on the way back down the list
+	threads = std::max(1, std::min(threads, basinCount));
+	std::vector<std::vector<int32_t> > order(threads);
+	starts.assign(basinCount + 1, 0);
+	parallelFor(0, threads, threads, [&](int t0, int t1) {
+		std::vector<int32_t> stack;
+		for (int t = t0; t < t1; t++) {
+			int32_t b0 = (int32_t)(((int64_t)basinCount * t) / threads);
+			int32_t b1 = (int32_t)(((int64_t)basinCount * (t + 1)) / threads);
+			std::vector<int32_t>& list = order[t];
+
+			for (int32_t b = b0; b < b1; b++) {
+				size_t first = list.size();
+				stack.push_back(outlets[b]);
+				while (!stack.empty()) {
+					int32_t c = stack.back();
+					stack.pop_back();
+					labels[c] = b;
+					list.push_back(c);
+
+					int x = c / size, y = c - (x * size);
+					for (int d = 0; d < 8; d++) {
+						int nx = x + FLOW_DX[d], ny = y + FLOW_DY[d];
+						if (nx < 0 || ny < 0 || nx >= size || ny >= size)
+							continue;
+						int32_t n = c + offsets[d];
+						if (water->data[n] != 1 && receiver(n) == c)
+							stack.push_back(n);
+					}
+				}
+
+				//Everything upstream of a cell comes after it in the list
+				for (size_t k = list.size(); k-- > first; ) {
+					int32_t c = list[k];
+					upstreamArea[c]++;
+					int32_t r = receiver(c);
+					if (r >= 0)
+						upstreamArea[r] += upstreamArea[c];
+				}
+				starts[b + 1] = (int32_t)(list.size() - first);
+			}
+		}
+	});
+
+	for (int32_t b = 0; b < basinCount; b++)
+		starts[b + 1] += starts[b];
+
+	//Put the lists together, each thread's basins are a run of them
+	cells.resize(starts[basinCount]);
+	parallelFor(0, threads, threads, [&](int t0, int t1) {
+		for (int t = t0; t < t1; t++) {
+			int32_t b0 = (int32_t)(((int64_t)basinCount * t) / threads);
+			std::copy(order[t].begin(), order[t].end(), cells.begin() + starts[b0]);
+		}
+	});
+}
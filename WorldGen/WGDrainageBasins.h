@@ -0,0 +1,40 @@
+#pragma once
+#include "WGByteData.h"
+#include "WGDerivedTerrain.h"
+
+#include <vector>
+#include <cstdint>
+
+namespace WG {
+	const int32_t NO_BASIN = -1; //Basin of the ocean
+
+	//Drainage basins of a map of flow directions: every land cell belongs to the basin of the outlet its
+	//water ends up at, an outlet being a land cell that drains into the ocean, off the map or nowhere (a pit).
+	//
+	//Alongside the labels the cells of every basin are kept one basin after the other (compressed rows),
+	//each basin listed depth first from its outlet. So all cells of a basin, the outlet of the basin
+	//under a cell and the area draining through a cell are all a lookup away.
+	//
+	//build() is linear. The outlets are found a band of rows per thread, then every thread walks up
+	//the basins of its own outlets, so no two threads ever write the same cell.
+	//Basins are numbered in the order a plain scan meets their outlets, whatever the thread count.
+	class DrainageBasins {
+	public:
+		std::vector<int32_t> labels; //Basin of every cell, NO_BASIN for the ocean
+		std::vector<int32_t> cells; //Cells of basin b are cells[starts[b]] up to cells[starts[b + 1]], the outlet first
+		std::vector<int32_t> starts; //One more entry then there are basins
+		std::vector<int32_t> upstreamArea; //Cells draining through each cell, itself included (0 for the ocean)
+
+		inline int32_t getBasinCount() const { return starts.empty() ? 0 : (int32_t)starts.size() - 1; }
+		inline int32_t getBasin(int x, int y) const { return labels[x * size + y]; }
+		inline int32_t getOutlet(int32_t basin) const { return cells[starts[basin]]; }
+		inline int32_t getBasinArea(int32_t basin) const { return starts[basin + 1] - starts[basin]; }
+		inline const int32_t* getBasinCells(int32_t basin) const { return cells.data() + starts[basin]; }
+		inline int32_t getUpstreamArea(int x, int y) const { return upstreamArea[x * size + y]; }
+
+		//flow as in DerivedTerrain::flowDirection, water marks the ocean (1)
+		void build(const ByteData* flow, const ByteData* water, int threads);
+	private:
+		int size = 0;
+	};
+}
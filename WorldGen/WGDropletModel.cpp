@@ -0,0 +1,177 @@
+#include "WGDropletModel.h"
+#include "WGParallel.h"
+
+#include <cmath>
+#include <algorithm>
+
+using namespace WG;
+
+//Droplet constants
+static const float INERTIA = 0.05f; //How much a droplet keeps going the way it was (0...1)
+static const float CAPACITY = 4.0f; //Sediment carried per unit of speed, water and drop
+static const float MIN_CAPACITY = 0.01f; //Keeps droplets on flat ground carrying a little
+static const float ERODE_SPEED = 0.3f;
+static const float DEPOSIT_SPEED = 0.3f;
+static const float EVAPORATE = 0.01f;
+static const float GRAVITY = 4.0f;
+static const int MAX_LIFETIME = 30;
+
+//Droplets per batch, only there to bound the memory for sorting them into tiles
+static const int BATCH_SIZE = 65536;
+
+//Tile width. Has to be more then twice the distance a droplet can travel (plus the bilinear corner)
+//so droplets from two tiles in the same pass can never meet
+static const int TILE_SIZE = 64;
+
+//SplitMix64, small and good enough to give each droplet its own independent stream
+static inline uint64_t splitMix(uint64_t& state) {
+	uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+//Uniform float in [0, 1)
+static inline float randomUnit(uint64_t& state) {
+	return (float)(splitMix(state) >> 40) / (float)(1ULL << 24);
+}
+
+DropletModel::DropletModel(FloatData* height, unsigned int seed, int threads) {
+	this->height = height;
+	this->seed = seed;
+	this->threads = threads;
+	this->dropletCount = 0;
+
+	//Same idea as the pipe model, keep the slope per cell the same no matter the map size
+	this->heightScale = (float)height->size / 256.0f;
+
+	this->tiles = (height->size + TILE_SIZE - 1) / TILE_SIZE;
+	tileStart.resize((tiles * tiles) + 1);
+}
+
+void DropletModel::rain(int64_t droplets) {
+	float limit = (float)(height->size - 1);
+
+	while (droplets > 0) {
+		int batch = (int)std::min<int64_t>(droplets, BATCH_SIZE);
+
+		//Every droplet gets its own random stream from its number
+		startX.resize(batch);
+		startY.resize(batch);
+		for (int d = 0; d < batch; d++) {
+			uint64_t rng = ((uint64_t)seed << 32) ^ (uint64_t)(dropletCount + d);
+			splitMix(rng);
+			startX[d] = randomUnit(rng) * limit;
+			startY[d] = randomUnit(rng) * limit;
+		}
+
+		//Counting sort into tiles, keeping droplet order inside each tile
+		std::fill(tileStart.begin(), tileStart.end(), 0);
+		for (int d = 0; d < batch; d++)
+			tileStart[((int)startX[d] / TILE_SIZE) * tiles + ((int)startY[d] / TILE_SIZE) + 1]++;
+		for (int t = 0; t < tiles * tiles; t++)
+			tileStart[t + 1] += tileStart[t];
+		tileDroplets.resize(batch);
+		std::vector<int> fill(tileStart.begin(), tileStart.end() - 1);
+		for (int d = 0; d < batch; d++)
+			tileDroplets[fill[((int)startX[d] / TILE_SIZE) * tiles + ((int)startY[d] / TILE_SIZE)]++] = d;
+
+		//Four checkerboard passes, the tiles in each one are independent
+		for (int pass = 0; pass < 4; pass++) {
+			int ox = pass % 2, oy = pass / 2;
+			int across = (tiles - ox + 1) / 2, down = (tiles - oy + 1) / 2;
+
+			parallelFor(0, across * down, threads, [&](int t0, int t1) {
+				for (int t = t0; t < t1; t++) {
+					int tile = ((ox + (t / down) * 2) * tiles) + (oy + (t % down) * 2);
+					for (int i = tileStart[tile]; i < tileStart[tile + 1]; i++)
+						runDroplet(startX[tileDroplets[i]], startY[tileDroplets[i]]);
+				}
+			});
+		}
+
+		dropletCount += batch;
+		droplets -= batch;
+	}
+}
+
+//Bilinear height and gradient at a point, in scaled height units
+void DropletModel::sample(float x, float y, float& h, float& gx, float& gy) {
+	int size = height->size;
+	int cx = (int)x, cy = (int)y;
+	float u = x - cx, v = y - cy;
+
+	const float* d = height->data;
+	float h00 = d[cx * size + cy] * heightScale;
+	float h10 = d[(cx + 1) * size + cy] * heightScale;
+	float h01 = d[cx * size + cy + 1] * heightScale;
+	float h11 = d[(cx + 1) * size + cy + 1] * heightScale;
+
+	gx = (h10 - h00) * (1.0f - v) + (h11 - h01) * v;
+	gy = (h01 - h00) * (1.0f - u) + (h11 - h10) * u;
+	h = h00 * (1.0f - u) * (1.0f - v) + h10 * u * (1.0f - v) + h01 * (1.0f - u) * v + h11 * u * v;
+}
+
+void DropletModel::runDroplet(float x, float y) {
+	int size = height->size;
+	float limit = (float)(size - 1);
+
+	float dirX = 0.0f, dirY = 0.0f;
+	float speed = 1.0f, water = 1.0f, sediment = 0.0f;
+	float h, gx, gy, newH, ngx, ngy;
+
+	for (int life = 0; life < MAX_LIFETIME; life++) {
+		int cx = (int)x, cy = (int)y;
+		float u = x - cx, v = y - cy;
+		sample(x, y, h, gx, gy);
+
+		//Turn downhill, keeping some of the old direction
+		dirX = (dirX * INERTIA) - (gx * (1.0f - INERTIA));
+		dirY = (dirY * INERTIA) - (gy * (1.0f - INERTIA));
+		float len = sqrtf((dirX * dirX) + (dirY * dirY));
+		if (len <= 0.0f)
+			break;
+		dirX /= len;
+		dirY /= len;
+
+		x += dirX;
+		y += dirY;
+		if (x < 0.0f || x >= limit || y < 0.0f || y >= limit)
+			return; //Washed off the map, sediment and all
+
+		sample(x, y, newH, ngx, ngy);
+		float dh = newH - h;
+
+		//Corners of the cell the droplet just left, and how much each one gets
+		int idx = cx * size + cy;
+		int corner[4] = { idx, idx + size, idx + 1, idx + size + 1 };
+		float weight[4] = { (1.0f - u) * (1.0f - v), u * (1.0f - v), (1.0f - u) * v, u * v };
+
+		float capacity = std::max(-dh * speed * water * CAPACITY, MIN_CAPACITY);
+		if (sediment > capacity || dh > 0.0f) {
+			//Going uphill fills the pit behind it, otherwise drop what's over capacity
+			float amount = dh > 0.0f ? std::min(dh, sediment) : (sediment - capacity) * DEPOSIT_SPEED;
+			sediment -= amount;
+			for (int i = 0; i < 4; i++)
+				height->data[corner[i]] += (amount * weight[i]) / heightScale;
+		} else {
+			//Never dig deeper then the drop, that just makes holes
+			float amount = std::min((capacity - sediment) * ERODE_SPEED, -dh);
+			sediment += amount;
+			for (int i = 0; i < 4; i++)
+				height->data[corner[i]] -= (amount * weight[i]) / heightScale;
+		}
+
+		speed = sqrtf(std::max(0.0f, (speed * speed) - (dh * GRAVITY)));
+		water *= (1.0f - EVAPORATE);
+	}
+
+	//Dried up (or stuck), drop whatever is left where it stopped
+	int cx = (int)x, cy = (int)y;
+	float u = x - cx, v = y - cy;
+	int idx = cx * size + cy;
+	height->data[idx] += (sediment * (1.0f - u) * (1.0f - v)) / heightScale;
+	height->data[idx + size] += (sediment * u * (1.0f - v)) / heightScale;
+	height->data[idx + 1] += (sediment * (1.0f - u) * v) / heightScale;
+	height->data[idx + size + 1] += (sediment * u * v) / heightScale;
+}
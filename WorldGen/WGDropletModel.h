@@ -0,0 +1,41 @@
+#pragma once
+#include "WGFloatData.h"
+
+#include <vector>
+#include <cstdint>
+
+namespace WG {
+	//Particle (droplet) hydraulic erosion.
+	//Each droplet starts at a random spot, rolls down the bilinear gradient of the height map,
+	//dissolves ground while it's fast and has room for it, and drops it again when it slows or climbs.
+	//
+	//Droplets rain in batches and sorted into 64x64 tiles by where they start. A droplet lives for
+	//at most 30 steps of one cell, so it can never reach past the tiles around its own. Tiles are run in four
+	//passes (a 2x2 checkerboard), and tiles in the same pass are a whole tile apart, so they never touch the
+	//same cells and can run on separate threads with no locking. Inside a tile the droplets run in order.
+	//Droplet i always gets the same random numbers, so the thread count has no effect on the result.
+	class DropletModel {
+	public:
+		DropletModel(FloatData* height, unsigned int seed, int threads);
+
+		//Simulates this many more droplets
+		void rain(int64_t droplets);
+
+		inline int64_t getDropletCount() { return dropletCount; }
+	private:
+		FloatData* height;
+		unsigned int seed;
+		int threads;
+		float heightScale;
+		int64_t dropletCount;
+
+		int tiles; //Tiles per side
+
+		std::vector<float> startX, startY; //Where each droplet in the batch starts
+		std::vector<int> tileStart; //Offset of each tile's droplets in tileDroplets
+		std::vector<int> tileDroplets; //Batch droplet indices, grouped by tile
+
+		void runDroplet(float x, float y);
+		void sample(float x, float y, float& h, float& gx, float& gy);
+	};
+}
@@ -1,38 +1,50 @@
 #include "WGGenerator.h"
 #include "FastNoise.h"
+#include "WGStencil.h"
+#include "WGSimd.h"
+#include "WGPipeModel.h"
+#include "WGDropletModel.h"
+#include "WGDerivedTerrain.h"
+#include "WGDistance.h"
+#include "WGBlur.h"
+#include "WGModeFilter.h"
 
 #include <iostream>
 #include <cmath>
 #include <algorithm>
 #include <cstdlib>
 #include <vector>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
 
-using namespace WG;
-
-//Simple representation of a 2D point
-struct Point {
-	int x;
-	int y;
-
-	Point(int setX, int setY) {
-		x = setX;
-		y = setY;
-	}
-};
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
-//Returns a random number between low and high
-inline int randomRange(int low, int high) {
-	return low + int(high*rand() / (RAND_MAX + 1.0));
-}
+using namespace WG;
 
 Generator::Generator(Settings config) {
 	this->settings = config;
 
 	this->dataHeight = new FloatData(config.worldSize);
-	this->dataTemp = new FloatData(config.worldSize);
+	this->climateScale = std::max(1, config.climateDownsample);
+	this->climateSize = (config.worldSize + climateScale - 1) / climateScale;
+	this->climateUpsampler = climateScale > 1 ? new BilinearUpsampler(climateSize, config.worldSize, climateScale) : NULL;
+	this->dataTemp = new FloatData(climateSize);
 	this->dataWater = new ByteData(config.worldSize);
 	this->dataBiomes = new ByteData(config.worldSize);
-	this->dataMoist = new FloatData(config.worldSize);
+	this->dataMoist = new FloatData(climateSize);
+	this->dataCoast = config.coastDistance ? new FloatData(config.worldSize) : NULL;
+	this->shoreMask = config.shoreWidth > 0 ? new BitMask(config.worldSize) : NULL;
+	this->biomeIndex = config.biomeIndex ? new BiomeIndex() : NULL;
+	this->biomeRegions = config.biomeRegions ? new BiomeRegions() : NULL;
+	this->biomeBlend = config.biomeBlendRadius > 0.0f ? new BiomeBlend(config.worldSize) : NULL;
+	this->biomeTable.setBlendRadius(config.biomeBlendRadius);
+
+	this->derived = NULL;
+	this->derivedValid = false;
+	this->hydrology = NULL;
 }
 
 Generator::~Generator() {
@@ -42,9 +54,128 @@ Generator::~Generator() {
 	delete dataWater;
 	delete dataBiomes;
 	delete dataMoist;
+	delete dataCoast;
+	delete climateUpsampler;
+	delete shoreMask;
+	delete biomeIndex;
+	delete biomeRegions;
+	delete biomeBlend;
+	delete derived;
+	delete hydrology;
+}
+
+DerivedTerrain* Generator::getDerivedTerrain() {
+	if (derived == NULL)
+		derived = new DerivedTerrain(settings.worldSize);
+	if (!derivedValid) {
+		derived->compute(dataHeight, resolveThreadCount(settings.threadCount));
+		derivedValid = true;
+	}
+	return derived;
 }
 
 void Generator::generate() {
+	//Build the starting height map from noise
+	instrument.beginStage(STAGE_HEIGHT);
+	generateHeight();
+	instrument.endStage(STAGE_HEIGHT);
+
+	//If the settings want it, run thermal erosion
+	if (settings.thermalErosionIterations > 0) {
+		instrument.beginStage(STAGE_THERMAL_EROSION);
+		erosionThermal();
+		instrument.endStage(STAGE_THERMAL_EROSION);
+	}
+
+	//Run height modifier
+	instrument.beginStage(STAGE_HEIGHT_MODIFIER);
+	switch (settings.heightModifier) {
+	case PANGAEA:
+		hmPangaea();
+		break;
+	case INV_PANGAEA:
+		hmInvPangaea();
+		break;
+	case STRAIGHT:
+		hmStraight();
+		break;
+	}
+	instrument.endStage(STAGE_HEIGHT_MODIFIER);
+
+	//Claim the ocean tiles
+	instrument.beginStage(STAGE_SALTWATER);
+	calculateSaltwater();
+	if (dataCoast != NULL)
+		calculateCoastDistance();
+	instrument.endStage(STAGE_SALTWATER);
+
+	//Calculate the moisture map
+	instrument.beginStage(STAGE_MOISTURE);
+	calculateMoisture();
+	instrument.endStage(STAGE_MOISTURE);
+
+	//If settings want it, do hydraulic erosion
+	//The grid algorithm isn't very good, so I didn't use it in my tests
+	if (settings.hydraulicErosionIterations > 0) {
+		instrument.beginStage(STAGE_HYDRAULIC_EROSION);
+		if (settings.hydraulicErosionMode == HYDRAULIC_PIPE)
+			erosionHydrailicImproved();
+		else if (settings.hydraulicErosionMode == HYDRAULIC_DROPLET)
+			erosionHydraulicDroplets();
+		else
+			erosionHydraulic();
+		instrument.endStage(STAGE_HYDRAULIC_EROSION);
+	}
+
+	//Trace the rivers over the finished terrain
+	if (settings.riverThreshold > 0.0f) {
+		instrument.beginStage(STAGE_FRESHWATER);
+		calculateFreshwater();
+		instrument.endStage(STAGE_FRESHWATER);
+	}
+
+	//Label the drainage basins, which are final now the height is
+	instrument.beginStage(STAGE_DRAINAGE_BASINS);
+	calculateDrainageBasins();
+	instrument.endStage(STAGE_DRAINAGE_BASINS);
+
+	//Calculate temperature for climate
+	instrument.beginStage(STAGE_TEMPERATURE);
+	calculateTemperature();
+	instrument.endStage(STAGE_TEMPERATURE);
+
+	//With the ready data, get the biome data
+	instrument.beginStage(STAGE_BIOMES);
+	calculateBiomes();
+	instrument.endStage(STAGE_BIOMES);
+
+	//Clean the speckle off the band edges of the biome table
+	if (settings.biomeFilterRadius > 0) {
+		instrument.beginStage(STAGE_BIOME_FILTER);
+		filterBiomes();
+		instrument.endStage(STAGE_BIOME_FILTER);
+	}
+
+	//Index them for the area and nearest biome queries
+	if (biomeIndex != NULL) {
+		instrument.beginStage(STAGE_BIOME_INDEX);
+		indexBiomes();
+		instrument.endStage(STAGE_BIOME_INDEX);
+	}
+
+	//And split them into regions for quest and spawn placement
+	if (biomeRegions != NULL) {
+		instrument.beginStage(STAGE_BIOME_REGIONS);
+		findBiomeRegions();
+		instrument.endStage(STAGE_BIOME_REGIONS);
+	}
+
+	if (instrument.getLogSink() != NULL)
+		instrument.getLogSink()->flush();
+}
+
+//Builds the base height map by blending perturbed simplex and cellular noise
+void Generator::generateHeight() {
 	//First set up a perturber from FastNoise
 	//Basically this takes input coordinates and moves them randomly to give more of an organic feel
 	FastNoise peturber(settings.seed);
@@ -115,48 +246,12 @@ void Generator::generate() {
 	//To be safe, I normalize again in-case something went over
 	dataHeight->normalize();
 	delete cellData;
-
-	//If the settings want it, run thermal erosion
-	if (settings.thermalErosionIterations > 0)
-		erosionThermal();
-
-	//Run height modifier
-	switch (settings.heightModifier) {
-	case PANGAEA:
-		hmPangaea();
-		break;
-	case INV_PANGAEA:
-		hmInvPangaea();
-		break;
-	case STRAIGHT:
-		hmStraight();
-		break;
-	}
-
-	//Claim the ocean tiles
-	calculateSaltwater();
-
-	//Calculate the moisture map
-	calculateMoisture();
-
-	//If settings want it, do hydraulic erosion
-	//This algorithm isn't very good, so I didn't use it in my tests
-	if (settings.hydraulicErosionIterations > 0)
-		erosionHydraulic();
-
-	//This just takes forever and isn't producing good results yet
-	//calculateFreshwater();
-
-	//Calculate temperature for climate
-	calculateTemperature();
-
-	//With the ready data, get the biome data
-	calculateBiomes();
+	heightChanged();
 }
 
 // Pangea filter puts ocean around the whole map leaving the bulk land in the center
 void Generator::hmPangaea() {
-	std::cout << "Running pangaea modifier" << std::endl;
+	instrument.log() << "Running pangaea modifier";
 	float modX = 0.0f, modY = 0.0f;
 	float halfSize = (float)settings.worldSize / 2.0f;
 	for (int y = 0; y < settings.worldSize; y++) {
@@ -166,11 +261,12 @@ void Generator::hmPangaea() {
 			dataHeight->data[x * settings.worldSize + y] *= (modX * modY);
 		}
 	}
+	heightChanged();
 }
 
 // Inverse Pangea does the oposite. Drops the height in the center to generate a large central sea
 void Generator::hmInvPangaea() {
-	std::cout << "Running inverse-pangaea modifier" << std::endl;
+	instrument.log() << "Running inverse-pangaea modifier";
 	float modX = 0.0f, modY = 0.0f;
 	float halfSize = (float)settings.worldSize / 2.0f;
 	for (int y = 0; y < settings.worldSize; y++) {
@@ -180,13 +276,14 @@ void Generator::hmInvPangaea() {
 			dataHeight->data[x * settings.worldSize + y] *= (modX * modY);
 		}
 	}
+	heightChanged();
 }
 
 
 // Straight modifier drops the height data in the center in a strip or band across the width.
 // Basically producing a mediterranian type land mass with a large river running through the center
 void Generator::hmStraight() {
-	std::cout << "Running straight modifier" << std::endl;
+	instrument.log() << "Running straight modifier";
 	float modY = 0.0f;
 	float halfSize = (float)settings.worldSize / 2.0f;
 	for (int y = 0; y < settings.worldSize; y++) {
@@ -195,42 +292,214 @@ void Generator::hmStraight() {
 			dataHeight->data[x * settings.worldSize + y] *= modY;
 		}
 	}
+	heightChanged();
+}
+
+//Returns the index of the lowest set bit in a non-zero word
+inline int lowestBit(uint64_t word) {
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long idx;
+	_BitScanForward64(&idx, word);
+	return (int)idx;
+#elif defined(_MSC_VER)
+	unsigned long idx;
+	if (_BitScanForward(&idx, (unsigned long)word))
+		return (int)idx;
+	_BitScanForward(&idx, (unsigned long)(word >> 32));
+	return (int)idx + 32;
+#else
+	return __builtin_ctzll(word);
+#endif
+}
+
+//Halves the resolution of the given data by averaging 2x2 blocks (odd edges are clamped)
+static FloatData* downsampleHalf(FloatData* src) {
+	int size = (src->size + 1) / 2;
+	FloatData* out = new FloatData(size);
+	for (int x = 0; x < size; x++) {
+		for (int y = 0; y < size; y++) {
+			out->setValue((src->getValueClamped(x * 2, y * 2) + src->getValueClamped(x * 2 + 1, y * 2) +
+				src->getValueClamped(x * 2, y * 2 + 1) + src->getValueClamped(x * 2 + 1, y * 2 + 1)) * 0.25f, x, y);
+		}
+	}
+	return out;
+}
+
+//Bilinearly upsamples the coarse data (half resolution) and adds it onto the fine data
+static void addUpsampled(FloatData* fine, FloatData* coarse) {
+	float fx, fy, tx, ty;
+	int cx, cy;
+	for (int x = 0; x < fine->size; x++) {
+		//Fine cell centers sit a quarter of a coarse cell away from the coarse centers
+		fx = ((x + 0.5f) * 0.5f) - 0.5f;
+		cx = (int)floorf(fx);
+		tx = fx - cx;
+		for (int y = 0; y < fine->size; y++) {
+			fy = ((y + 0.5f) * 0.5f) - 0.5f;
+			cy = (int)floorf(fy);
+			ty = fy - cy;
+
+			float top = coarse->getValueClamped(cx, cy) * (1.0f - tx) + coarse->getValueClamped(cx + 1, cy) * tx;
+			float bot = coarse->getValueClamped(cx, cy + 1) * (1.0f - tx) + coarse->getValueClamped(cx + 1, cy + 1) * tx;
+			fine->data[x * fine->size + y] += top * (1.0f - ty) + bot * ty;
+		}
+	}
 }
 
 //Thermal erosion adjusts height data based on it's neighbors and the difference between
 //them and the sampled point. Good for smoothing out the height information
+//
+//Each iteration works through the map in place, so a change carries on into the cells visited
+//after it and spreads about a cell per iteration. Relaxing slopes over long distances takes a lot of
+//full resolution iterations. With thermalErosionLevels > 1 the height is first reduced into a pyramid
+//of half sized copies, and the erosion's iterations are split between the levels: every level but the
+//coarsest runs thermalErosionFineIterations, and the coarsest does the rest of the distance at half the
+//iterations per level down (a coarse iteration spreads twice as far). Each level's change is then scaled
+//back up and added onto the next finer one before it runs.
+//
+//Two levels come out about as far from the full resolution result as running 10% more or fewer
+//iterations would. Every level below that roughly doubles the difference, coarse cells can't follow
+//what the fine ones do exactly.
 void Generator::erosionThermal() {
-	int32 size = settings.worldSize;
-	float thresh = settings.thermalErosionThreshold; //Threshold is the delta-difference needed before changing
+	int32 iters = settings.thermalErosionIterations;
+	int32 fineIters = std::max(1, settings.thermalErosionFineIterations);
+
+	//Only as many levels as leave the coarsest one at least an iteration of its own
+	int32 coarsest = std::max(1, settings.thermalErosionLevels) - 1;
+	while (coarsest > 0 && ((dataHeight->size >> coarsest) < 8 || iters - (fineIters * ((1 << coarsest) - 1)) < (1 << coarsest)))
+		coarsest--;
+	if (coarsest == 0) {
+		erodeThermalLevel(dataHeight, iters, settings.thermalErosionThreshold);
+		heightChanged();
+		return;
+	}
+
+	//Build the pyramid, keeping an un-eroded copy of every level for the corrections
+	vector<FloatData*> pyramid;
+	vector<FloatData*> original;
+	pyramid.push_back(dataHeight);
+	for (int l = 1; l <= coarsest; l++) {
+		pyramid.push_back(downsampleHalf(pyramid.back()));
+		original.push_back(new FloatData(*pyramid.back()));
+	}
+
+	for (int l = coarsest; l > 0; l--) {
+		FloatData* level = pyramid[l];
+
+		//A coarse cell spans 2^l fine cells, so the same slope shows up as a bigger height difference.
+		//The finer levels each run fineIters, covering fineIters * (2^l - 1) full resolution iterations between them
+		float thresh = settings.thermalErosionThreshold * (float)(1 << l);
+		int32 levelIters = fineIters;
+		if (l == coarsest)
+			levelIters = ((iters - (fineIters * ((1 << l) - 1))) + (1 << (l - 1))) >> l;
+		int ran = erodeThermalLevel(level, levelIters, thresh);
+		instrument.log() << "Ran Thermal Erosion - Level: " << l << " Size: " << level->size << " Iterations: " << ran;
+		instrument.progress(STAGE_THERMAL_EROSION, (float)(pyramid.size() - l) / (float)pyramid.size());
+
+		//Turn the level into the correction it made and push that down a level
+		FloatData* orig = original[l - 1];
+		for (int i = 0; i < (level->size * level->size); i++)
+			level->data[i] -= orig->data[i];
+		addUpsampled(pyramid[l - 1], level);
+
+		delete level;
+		delete orig;
+	}
+
+	//Finish up the detail on the full resolution map
+	int ran = erodeThermalLevel(dataHeight, fineIters, settings.thermalErosionThreshold);
+	instrument.log() << "Ran Thermal Erosion - Level: 0 Size: " << dataHeight->size << " Iterations: " << ran;
+	heightChanged();
+}
+
+//Runs the thermal erosion iterations over one height map.
+//
+//After the first couple passes most of the map is stable (no neighbor lower then the threshold),
+//so instead of sweeping the whole map every iteration an "active" bitmap is kept.
+//Only cells whose own height, or a neighbors height, changed get looked at again.
+//Cells are still visited in the same order as a full sweep, so the result is identical to it.
+//Returns how many iterations actually ran before it settled.
+int Generator::erodeThermalLevel(FloatData* height, int32 iters, float thresh) {
+	int32 size = height->size;
 	float coeff = settings.thermalErosionCoefficient; //Coefficient specifies how much of the change to actually use
-	int32 iters = settings.thermalErosionIterations; //How many times will this run
+	float tolerance = settings.thermalErosionTolerance; //Stop once nothing moves more then this
+
+	//Cache blocked version. Every cell gathers what its neighbors would have pushed onto it,
+	//all reading the previous iteration, so it runs through the tiled stencil executor.
+	if (settings.stencilBlockDepth > 0) {
+		runStencil(height, iters, 2, STENCIL_CLAMP, settings.stencilTileSize, settings.stencilBlockDepth,
+			resolveThreadCount(settings.threadCount), [thresh, coeff](const StencilWindow<float>& w) {
+			static const int ox[4] = { -1, 0, 1, 0 };
+			static const int oy[4] = { 0, -1, 0, 1 };
+			float samp = w(0, 0);
+			float out = samp;
+			for (int j = 0; j < 4; j++) {
+				if (!w.inside(ox[j], oy[j]))
+					continue;
+
+				float nsamp = w(ox[j], oy[j]);
+				float delta = 0.0f, deltaMax = -1.0f, dif;
+				for (int k = 0; k < 4; k++) {
+					dif = nsamp - w(ox[j] + ox[k], oy[j] + oy[k]);
+					if (dif > thresh) {
+						delta += dif;
+						deltaMax = std::max(deltaMax, dif);
+					}
+				}
+				if (delta > 0.0f)
+					out += coeff * (deltaMax - thresh) * ((nsamp - samp) / delta);
+			}
+			return out;
+		});
+		instrument.log() << "Ran Thermal Erosion - Iterations: " << iters << " (blocked)";
+		return iters;
+	}
 
-	float samp = 0.0f, delta=0.0f, deltaMax=-1.0f;
+	//One bit per cell, in visiting order (y * size + x). "cur" is this iteration, "next" is the following one
+	int words = ((size * size) + 63) / 64;
+	vector<uint64_t> cur(words, ~0ULL);
+	vector<uint64_t> next(words, 0ULL);
+	if ((size * size) % 64 != 0)
+		cur[words - 1] = (1ULL << ((size * size) % 64)) - 1;
+
+	float samp = 0.0f, delta = 0.0f, deltaMax = -1.0f, change = 0.0f, changeMax = 0.0f;
 	float pnt[4];
 	float dif[4];
+	int nx[4], ny[4];
+	bool inside[4];
+	int active = 0;
+	int64_t changed = 0;
 
 	for (int i = 0; i < iters; i++) {
-		std::cout << "Running Thermal Erosion - Iteration: " << i << endl;
-		for (int y = 0; y < size; y++) {
-			for (int x = 0; x < size; x++) {
-				samp = dataHeight->getValue(x, y); //Get the targetted sample point from the height data
-
-				//Retrieve the neighbors to North/South/East/West
-				pnt[0] = dataHeight->getValueClamped(x - 1, y);
-				pnt[1] = dataHeight->getValueClamped(x, y - 1);
-				pnt[2] = dataHeight->getValueClamped(x + 1, y);
-				pnt[3] = dataHeight->getValueClamped(x, y + 1);
-
-				//Calculate the difference between the target sample and each neighbor point
-				dif[0] = samp - pnt[0];
-				dif[1] = samp - pnt[1];
-				dif[2] = samp - pnt[2];
-				dif[3] = samp - pnt[3];
-
-				//Figure out the total differences between sample and neighbors
+		active = 0;
+		changed = 0;
+		changeMax = 0.0f;
+		std::fill(next.begin(), next.end(), 0ULL);
+
+		for (int w = 0; w < words; w++) {
+			//Re-read the word every time, cells later in this word may have been woken up by the previous one
+			while (cur[w] != 0) {
+				int idx = (w * 64) + lowestBit(cur[w]);
+				cur[w] &= cur[w] - 1;
+
+				int x = idx % size;
+				int y = idx / size;
+				samp = height->getValue(x, y); //Get the targetted sample point from the height data
+
+				//Neighbors to North/South/East/West. Ones off the map clamp back onto this cell, which never changes it
+				nx[0] = x - 1; ny[0] = y;
+				nx[1] = x; ny[1] = y - 1;
+				nx[2] = x + 1; ny[2] = y;
+				nx[3] = x; ny[3] = y + 1;
+
 				delta = 0.0f;
 				deltaMax = -1.0f;
 				for (int j = 0; j < 4; j++) {
+					inside[j] = nx[j] >= 0 && nx[j] < size && ny[j] >= 0 && ny[j] < size;
+					pnt[j] = inside[j] ? height->getValue(nx[j], ny[j]) : samp;
+
+					//Calculate the difference between the target sample and each neighbor point
+					dif[j] = samp - pnt[j];
 					if (dif[j] > thresh) {
 						delta += dif[j];
 						if (dif[j] > deltaMax)
@@ -238,21 +507,140 @@ void Generator::erosionThermal() {
 					}
 				}
 
+				//Stable cell, nothing to move
+				if (delta <= 0.0f)
+					continue;
+				active++;
+
 				//Fill the neighbors with the scaled difference
 				//Essentially "blurs" the height data
 				for (int j = 0; j < 4; j++) {
-					if (delta > 0.0f)
-						pnt[j] += coeff * (deltaMax - thresh) * (dif[j] / delta);
+					if (!inside[j] || dif[j] == 0.0f)
+						continue;
+
+					change = coeff * (deltaMax - thresh) * (dif[j] / delta);
+					if (change == 0.0f)
+						continue;
+					height->setValue(pnt[j] + change, nx[j], ny[j]);
+					changed++;
+					changeMax = std::max(changeMax, std::abs(change));
+
+					//Wake up the changed cell and everything touching it.
+					//Anything after this cell in the sweep still gets visited this iteration, the rest next iteration
+					int nIdx = (ny[j] * size) + nx[j];
+					int wake[5] = { nIdx, nIdx - 1, nIdx + 1, nIdx - size, nIdx + size };
+					bool wakeValid[5] = { true, nx[j] > 0, nx[j] < size - 1, ny[j] > 0, ny[j] < size - 1 };
+					for (int k = 0; k < 5; k++) {
+						if (!wakeValid[k])
+							continue;
+						next[wake[k] / 64] |= 1ULL << (wake[k] % 64);
+						if (wake[k] > idx)
+							cur[wake[k] / 64] |= 1ULL << (wake[k] % 64);
+					}
 				}
-
-				//Update the height data with the new values
-				dataHeight->setValueClamped(pnt[0], x - 1, y);
-				dataHeight->setValueClamped(pnt[1], x, y - 1);
-				dataHeight->setValueClamped(pnt[2], x + 1, y);
-				dataHeight->setValueClamped(pnt[3], x, y + 1);
 			}
 		}
+
+		instrument.count(COUNTER_CELLS_CHANGED, changed);
+		instrument.log() << "Thermal Erosion - Iteration: " << i << " Active cells: " << active << " of " << (size * size);
+		if (settings.thermalErosionLevels <= 1)
+			instrument.progress(STAGE_THERMAL_EROSION, (float)(i + 1) / (float)iters);
+
+		//Settled, or close enough to it
+		if (active == 0 || changeMax < tolerance)
+			return i + 1;
+		cur.swap(next);
 	}
+	return iters;
+}
+
+//First half of a hydraulic erosion iteration, done for every cell on its own.
+//Rains on the cell, and if it has lower neighbors picks sediment up off the height map.
+//Rather then pushing that sediment out, it leaves "pick" = sediment / total drop, so each
+//neighbor can work out its own share in the gather step.
+struct HydraulicPickKernel {
+	const float *hPrev, *hCur, *hNext; //Source height rows x-1, x, x+1
+	const float* moist;
+	float *water, *pick, *hOut;
+	int yUp, yDown; //Neighbor offsets along the row (only differ from -1/+1 at the wrapped ends)
+
+	template<typename V>
+	inline void run(int y) {
+		typedef Lanes<V> Ln;
+		const V zero(0.0f);
+
+		V c = Ln::load(hCur + y);
+		V total = zero;
+		total = total + vmin(Ln::load(hPrev + y + yUp) - c, zero);
+		total = total + vmin(Ln::load(hCur + y + yUp) - c, zero);
+		total = total + vmin(Ln::load(hNext + y + yUp) - c, zero);
+		total = total + vmin(Ln::load(hPrev + y) - c, zero);
+		total = total + vmin(Ln::load(hNext + y) - c, zero);
+		total = total + vmin(Ln::load(hPrev + y + yDown) - c, zero);
+		total = total + vmin(Ln::load(hCur + y + yDown) - c, zero);
+		total = total + vmin(Ln::load(hNext + y + yDown) - c, zero);
+		total = zero - total;
+
+		//Add water (Raining still)
+		V w = Ln::load(water + y);
+		w = vselect(vless(w, V(0.9f)), w + (Ln::load(moist + y) * V(0.01f)), w);
+
+		//Pick-up sediment, reducing the height at this spot and using up some water
+		V flows = vgreater(total, V(0.001f));
+		V deltMax = vmin(total, V(0.9f));
+		V sediment = vmin(c * V(0.5f), w * (deltMax * V(0.25f)));
+		Ln::store(hOut + y, vselect(flows, c - sediment, c));
+		Ln::store(water + y, vselect(flows, w - (w * deltMax), w));
+		Ln::store(pick + y, vselect(flows, sediment / total, zero));
+	}
+};
+
+//Second half, gathers the sediment (and the same amount of water) flowing in from every higher
+//neighbor, then evaporates and drops anything over what the water can hold.
+struct HydraulicGatherKernel {
+	const float *hPrev, *hCur, *hNext; //Source height rows x-1, x, x+1
+	const float *pPrev, *pCur, *pNext; //Pick rows x-1, x, x+1
+	float *water, *sediment, *hOut;
+	int yUp, yDown;
+
+	template<typename V>
+	inline void run(int y) {
+		typedef Lanes<V> Ln;
+		const V zero(0.0f);
+
+		V c = Ln::load(hCur + y);
+		V in = zero;
+		in = in + Ln::load(pPrev + y + yUp) * vmax(Ln::load(hPrev + y + yUp) - c, zero);
+		in = in + Ln::load(pCur + y + yUp) * vmax(Ln::load(hCur + y + yUp) - c, zero);
+		in = in + Ln::load(pNext + y + yUp) * vmax(Ln::load(hNext + y + yUp) - c, zero);
+		in = in + Ln::load(pPrev + y) * vmax(Ln::load(hPrev + y) - c, zero);
+		in = in + Ln::load(pNext + y) * vmax(Ln::load(hNext + y) - c, zero);
+		in = in + Ln::load(pPrev + y + yDown) * vmax(Ln::load(hPrev + y + yDown) - c, zero);
+		in = in + Ln::load(pCur + y + yDown) * vmax(Ln::load(hCur + y + yDown) - c, zero);
+		in = in + Ln::load(pNext + y + yDown) * vmax(Ln::load(hNext + y + yDown) - c, zero);
+
+		//Evaporate
+		Ln::store(water + y, (Ln::load(water + y) + in) * V(0.1f));
+		V sed = Ln::load(sediment + y) + in;
+		V full = vgreater(sed, V(0.1f));
+		Ln::store(hOut + y, vselect(full, Ln::load(hOut + y) + (sed - V(0.1f)), Ln::load(hOut + y)));
+		Ln::store(sediment + y, vselect(full, V(0.1f), sed));
+	}
+};
+
+//Runs a row kernel over a whole wrapped row. The middle goes 4 cells at a time,
+//the two ends wrap around to the other side of the row
+template<typename Kernel>
+static void runWrappedRow(Kernel kernel, int size) {
+	kernel.yUp = size - 1;
+	kernel.yDown = 1;
+	kernel.template run<float>(0);
+
+	kernel.yUp = -1;
+	forEachLane(1, size - 1, kernel);
+
+	kernel.yDown = 1 - size;
+	kernel.template run<float>(size - 1);
 }
 
 //Hyrdaulic erosion is... complicated
@@ -263,157 +651,228 @@ void Generator::erosionThermal() {
 //and with it bringing some sediment.
 //During the evaporation phase, water is dried from the tiles and the suspended sediment
 //is added to the height data at that tile. Effectively carrying dirt from one tile to another
+//
+//Each iteration is done in two passes over separate water/sediment arrays so the cells don't step on each other.
+//The first one picks sediment up, the second has every cell pull in its share from the higher neighbors
+//(instead of every cell pushing out into eight others). Heights are double buffered, so both passes
+//only read the state from the start of the iteration and can be split over threads and run 4 cells at a time.
 void Generator::erosionHydraulic() {
 	int32 size = settings.worldSize;
+	int threads = resolveThreadCount(settings.threadCount);
 
-	waterCell* water = new waterCell[size * size];
-	for (int y = 0; y < size; y++)
-		for (int x = 0; x < size; x++)
-			water[x * size + y].waterAmount = dataMoist->getValue(x,y) * 0.1f; //Seed buckets
+	vector<float> water(size * size);
+	vector<float> sediment(size * size, 0.0f);
+	vector<float> pick(size * size);
+	vector<float> heightOut(size * size);
+	float* hSrc = dataHeight->data;
+	float* hDst = heightOut.data();
+
+	FloatData* moist = fullSizeClimate(dataMoist);
+	for (int i = 0; i < (size * size); i++)
+		water[i] = moist->data[i] * 0.1f; //Seed buckets
 
 	for (int i = 0; i < settings.hydraulicErosionIterations; i++) {
-		cout << "Running hydraulic erosion - Iteration: " << i << endl;
-		for (int y = 0; y < size; y++) {
-			for (int x = 0; x < size; x++) {
-				//Add water (Raining still)
-				waterCell* wc = &water[x * size + y];
-				if (wc->waterAmount < 0.9f)
-					wc->waterAmount += dataMoist->getValue(x, y) * 0.01f;
-
-				float c = dataHeight->getValue(x, y);
-				float tl = dataHeight->getValueWrapped(x - 1, y - 1),
-					t = dataHeight->getValueWrapped(x, y - 1),
-					tr = dataHeight->getValueWrapped(x + 1, y - 1);
-				float r = dataHeight->getValueWrapped(x + 1, y),
-					l = dataHeight->getValueWrapped(x - 1, y);
-				float bl = dataHeight->getValueWrapped(x - 1, y + 1),
-					b = dataHeight->getValueWrapped(x, y + 1),
-					br = dataHeight->getValueWrapped(x + 1, y + 1);
-
-				float dt = t - c, dtl = tl - c, dtr = tr - c,
-					db = b - c, dbl = bl - c, dbr = br - c,
-					dr = r - c, dl = l - c;
-
-				float totalDelta = (dt < 0 ? dt : 0) + (dtl < 0 ? dtl : 0) + (dtr < 0 ? dtr : 0) +
-					(db < 0 ? db : 0) + (dbl < 0 ? dbl : 0) + (dbr< 0 ? dbr : 0) +
-					(dr < 0 ? dr : 0) + (dl < 0 ? dl : 0);
-				totalDelta *= -1;
-
-				if (totalDelta > 0.001f) {
-					float deltMax = std::min(totalDelta, 0.9f);
-
-					//Pick-up sediment
-					float sediment = std::min(c*0.5f, (wc->waterAmount * (deltMax * 0.25f)));
-					dataHeight->setValue(c - sediment, x, y); //Reduction in current spot
-
-					float wpick = wc->waterAmount * deltMax;
-					wc->waterAmount -= wpick;
-
-					if (dt < 0) {
-						water[x * size + (y == 0 ? size-1 : y - 1)].sedimentAmount += sediment * (-dt / totalDelta);
-						water[x * size + (y == 0 ? size-1 : y - 1)].waterAmount += sediment * (-dt / totalDelta);
-					}
-					if (dtl < 0) {
-						water[(x == 0 ? size-1 : x - 1) * size + (y == 0 ? size-1 : y - 1)].sedimentAmount += sediment * (-dtl / totalDelta);
-						water[(x == 0 ? size-1 : x - 1) * size + (y == 0 ? size-1 : y - 1)].waterAmount += sediment * (-dtl / totalDelta);
-					}
-					if (dtr < 0) {
-						water[(x == size-1 ? 0 : x + 1) * size + (y == 0 ? size-1 : y - 1)].sedimentAmount += sediment * (-dtr / totalDelta);
-						water[(x == size-1 ? 0 : x + 1) * size + (y == 0 ? size-1 : y - 1)].waterAmount += sediment * (-dtr / totalDelta);
-					}
+		parallelFor(0, size, threads, [&](int x0, int x1) {
+			for (int x = x0; x < x1; x++) {
+				HydraulicPickKernel kernel;
+				kernel.hPrev = hSrc + ((x == 0 ? size - 1 : x - 1) * size);
+				kernel.hCur = hSrc + (x * size);
+				kernel.hNext = hSrc + ((x == size - 1 ? 0 : x + 1) * size);
+				kernel.moist = moist->data + (x * size);
+				kernel.water = water.data() + (x * size);
+				kernel.pick = pick.data() + (x * size);
+				kernel.hOut = hDst + (x * size);
+				runWrappedRow(kernel, size);
+			}
+		});
+
+		parallelFor(0, size, threads, [&](int x0, int x1) {
+			for (int x = x0; x < x1; x++) {
+				int xPrev = (x == 0 ? size - 1 : x - 1), xNext = (x == size - 1 ? 0 : x + 1);
+				HydraulicGatherKernel kernel;
+				kernel.hPrev = hSrc + (xPrev * size);
+				kernel.hCur = hSrc + (x * size);
+				kernel.hNext = hSrc + (xNext * size);
+				kernel.pPrev = pick.data() + (xPrev * size);
+				kernel.pCur = pick.data() + (x * size);
+				kernel.pNext = pick.data() + (xNext * size);
+				kernel.water = water.data() + (x * size);
+				kernel.sediment = sediment.data() + (x * size);
+				kernel.hOut = hDst + (x * size);
+				runWrappedRow(kernel, size);
+			}
+		});
 
-					if (db < 0) {
-						water[x * size + (y == size-1 ? 0 : y + 1)].sedimentAmount += sediment * (-db / totalDelta);
-						water[x * size + (y == size-1 ? 0 : y + 1)].waterAmount += sediment * (-db / totalDelta);
-					}
-					if (dbl < 0) {
-						water[(x == 0 ? size-1 : x - 1) * size + (y == size-1 ? 0 : y + 1)].sedimentAmount += sediment * (-dbl / totalDelta);
-						water[(x == 0 ? size-1 : x - 1) * size + (y == size-1 ? 0 : y + 1)].waterAmount += sediment * (-dbl / totalDelta);
-					}
-					if (dbr < 0) {
-						water[(x == size-1 ? 0 : x + 1) * size + (y == size-1 ? 0 : y + 1)].sedimentAmount += sediment * (-dbr / totalDelta);
-						water[(x == size-1 ? 0 : x + 1) * size + (y == size-1 ? 0 : y + 1)].waterAmount += sediment * (-dbr / totalDelta);
-					}
+		std::swap(hSrc, hDst);
+		instrument.progress(STAGE_HYDRAULIC_EROSION, (float)(i + 1) / (float)settings.hydraulicErosionIterations);
+	}
 
-					if (dl < 0) {
-						water[(x == 0 ? size-1 : x - 1) * size + y].sedimentAmount += sediment * (-dl / totalDelta);
-						water[(x == 0 ? size-1 : x - 1) * size + y].waterAmount += sediment * (-dl / totalDelta);
-					}
-					if (dr < 0) {
-						water[(x == size-1 ? 0 : x + 1) * size + y].sedimentAmount += sediment * (-dr / totalDelta);
-						water[(x == size-1 ? 0 : x + 1) * size + y].waterAmount += sediment * (-dr / totalDelta);
-					}
-				}
+	//Results ended up in the scratch buffer
+	if (hSrc != dataHeight->data)
+		std::copy(hSrc, hSrc + (size * size), dataHeight->data);
+	if (moist != dataMoist)
+		delete moist;
 
-				//Evaporate
-				wc->waterAmount *= 0.1f;
-				if (wc->sedimentAmount > 0.1f) {
-					dataHeight->setValue(dataHeight->getValue(x, y) + (wc->sedimentAmount - 0.1f), x, y);
-					wc->sedimentAmount = 0.1f;
-				}
+	int64_t filled = 0;
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			dataHeight->setValue(dataHeight->getValue(x, y) + sediment[x * size + y], x, y);
+
+			if (water[x * size + y] > 0.2f) {
+				dataWater->setValue(2, x, y);
+				filled++;
 			}
 		}
 	}
+	instrument.count(COUNTER_BUCKETS_FILLED, filled);
+	instrument.log() << "Ran hydraulic erosion - Iterations: " << settings.hydraulicErosionIterations << " Full buckets: " << filled;
+	heightChanged();
+}
+
+//Virtual pipe model hydraulic erosion, the CPU port of the flux/velocity shaders in research/ (see WGPipeModel.h).
+//Rain falls according to the moisture map and drains away into the ocean.
+//Anything left holding a decent amount of water at the end is marked as freshwater.
+void Generator::erosionHydrailicImproved() {
+	int32 size = settings.worldSize;
+
+	//Scale the 0...1 heights with the map size so the slope between two cells doesn't depend on it
+	float heightScale = (float)size * 0.2f;
+
+	PipeModel model(size, resolveThreadCount(settings.threadCount));
+	FloatData* moist = fullSizeClimate(dataMoist);
+	model.setTerrain(dataHeight, moist, dataWater, heightScale);
+	if (moist != dataMoist)
+		delete moist;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < settings.hydraulicErosionIterations; i++) {
+		model.step();
+		instrument.progress(STAGE_HYDRAULIC_EROSION, (float)(i + 1) / (float)settings.hydraulicErosionIterations);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	instrument.log() << "Ran pipe model hydraulic erosion - Steps: " << settings.hydraulicErosionIterations
+		<< " Steps/sec: " << (settings.hydraulicErosionIterations / std::max(seconds, 1e-9));
+
+	model.getTerrain(dataHeight);
 
-	waterCell wsamp;
 	for (int y = 0; y < size; y++) {
 		for (int x = 0; x < size; x++) {
-			dataHeight->setValue(dataHeight->getValue(x, y) + water[x * size + y].sedimentAmount, x, y);
-
-			wsamp = water[x * size + y];
-			if (wsamp.waterAmount > 0.2f) {
-				cout << "Found full bucket " << x << ", " << y << endl;
+			if (dataWater->getValue(x, y) == 0 && model.getWater(x, y) > (1.0f / 255.0f))
 				dataWater->setValue(2, x, y);
-			}
 		}
 	}
-
-	delete[] water;
+	heightChanged();
 }
 
-void Generator::erosionHydrailicImproved() {
-	//Do this later
+//Droplet hydraulic erosion (see WGDropletModel.h).
+//Every iteration rains hydraulicDropletsPerIteration droplets that carve the height map as they roll down it.
+void Generator::erosionHydraulicDroplets() {
+	DropletModel model(dataHeight, settings.seed, resolveThreadCount(settings.threadCount));
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < settings.hydraulicErosionIterations; i++) {
+		model.rain(settings.hydraulicDropletsPerIteration);
+		instrument.progress(STAGE_HYDRAULIC_EROSION, (float)(i + 1) / (float)settings.hydraulicErosionIterations);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	instrument.log() << "Ran droplet hydraulic erosion - Droplets: " << model.getDropletCount()
+		<< " Droplets/sec: " << (model.getDropletCount() / std::max(seconds, 1e-9));
+	heightChanged();
 }
 
 //Build the ocean data
+//Everything at or below sea level is water. The water is split into connected bodies, and a body is ocean
+//if it reaches the edge of the map or is at least oceanMinArea cells. Smaller enclosed bodies become lakes,
+//and the tiny ones (under lakeMinArea) dry up into land.
+//After that the ocean outline can be smoothed, and the shore band along it marked, with bit mask morphology.
 void Generator::calculateSaltwater() {
-	cout << "Claiming saltwater ocean..." << endl;
+	instrument.log() << "Claiming saltwater ocean...";
 	int size = settings.worldSize;
-
-	//Set all tiles under the sea-level to ocean
-	float samp = 0.0f;
-	for (int y = 0; y < size; y++) {
-		for (int x = 0; x < size; x++) {
-			samp = dataHeight->getValue(x, y);
-
-			if (samp <= settings.seaLevel)
-				dataWater->setValue(1, x, y);
-			else
-				dataWater->setValue(0, x, y);
-		}
+	const float* height = dataHeight->data;
+	float seaLevel = settings.seaLevel;
+
+	waterBodies.run(size, resolveThreadCount(settings.threadCount),
+		[height, seaLevel](int32_t i) { return height[i] <= seaLevel; },
+		[](int32_t, int32_t) { return true; });
+
+	//What each body turns into
+	vector<uint8_t> type(waterBodies.getComponentCount());
+	int oceans = 0, lakes = 0;
+	for (int32_t c = 0; c < waterBodies.getComponentCount(); c++) {
+		const ComponentStats& body = waterBodies.components[c];
+		if (body.touchesBorder || body.area >= settings.oceanMinArea) {
+			type[c] = 1;
+			oceans++;
+		} else if (body.area >= settings.lakeMinArea) {
+			type[c] = 3;
+			lakes++;
+		} else
+			type[c] = 0;
 	}
 
-	//Dry up small seas by checking the neighbors 3 tiles away.
-	//If none of the tiles 3 points away are ocean, then remove this one as well.
-	//Essentially any lonely single ocean tiles get removed.
-	for (int i = 0; i < 25; i++) {
-		for (int y = 0; y < size; y++) {
-			for (int x = 0; x < size; x++) {
-				if (dataWater->getValueClamped(x - 3, y) == 0 &&
-					dataWater->getValueClamped(x + 3, y) == 0 &&
-					dataWater->getValueClamped(x, y - 3) == 0 &&
-					dataWater->getValueClamped(x, y + 3) == 0 )
-					dataWater->setValue(0, x, y);
-			}
+	parallelFor(0, size * size, resolveThreadCount(settings.threadCount), [&](int i0, int i1) {
+		for (int i = i0; i < i1; i++) {
+			int32_t label = waterBodies.labels[i];
+			dataWater->data[i] = label == NO_COMPONENT ? 0 : type[label];
 		}
+	});
+
+	instrument.log() << "Water bodies: " << waterBodies.getComponentCount() << " Oceans: " << oceans << " Lakes: " << lakes;
+
+	int threads = resolveThreadCount(settings.threadCount);
+	uint8_t* water = dataWater->data;
+	BitMask ocean(size);
+	if (settings.coastSmoothing > 0 || shoreMask != NULL)
+		ocean.build([water](int32_t i) { return water[i] == 1; }, threads);
+
+	//Opening drops specks and thin spurs of ocean, closing fills in the narrow gaps between them.
+	//Lakes stay as they are, the water bodies above still describe the outline before smoothing
+	if (settings.coastSmoothing > 0) {
+		BitMask opened(size);
+		ocean.open(opened, MORPH_CROSS, settings.coastSmoothing, threads);
+		opened.close(ocean, MORPH_CROSS, settings.coastSmoothing, threads);
+
+		parallelFor(0, size, threads, [&](int x0, int x1) {
+			for (int x = x0; x < x1; x++) {
+				for (int y = 0; y < size; y++) {
+					uint8_t& cell = water[x * size + y];
+					if (!ocean.get(x, y)) {
+						if (cell == 1)
+							cell = 0;
+					} else if (cell == 0)
+						cell = 1;
+				}
+			}
+		});
 	}
+
+	if (shoreMask != NULL)
+		ocean.shoreBand(*shoreMask, MORPH_SQUARE, settings.shoreWidth, threads);
+}
+
+//Distance from every cell to the nearest ocean cell (0 on the ocean itself), see WGDistance.h
+void Generator::calculateCoastDistance() {
+	const uint8_t* water = dataWater->data;
+	distanceTransform(dataCoast, [water](int i) { return water[i] == 1; }, resolveThreadCount(settings.threadCount));
+}
+
+//How much the ocean affects a cell, 1 on the coast fading to 0 inland. Always 0 without the coast layer
+float Generator::getCoastInfluence(int x, int y) {
+	if (dataCoast == NULL)
+		return 0.0f;
+	return expf(-dataCoast->getValue(x, y) / std::max(settings.coastRange, 0.0001f));
 }
 
-//This is a very cheap and simple moisture calculation
-//It doesn't take into consideration anything.
-//It's basically just a posterized cellular noise map
+//Moisture in the mode the settings pick. MOISTURE_NOISE is a very cheap and simple moisture calculation,
+//basically just a posterized cellular noise map, with the coast's pull added when there's a coast distance.
+//MOISTURE_WIND carries it in off the ocean (calculateMoistureWind)
 void Generator::calculateMoisture() {
-	cout << "Calculating moisture..." << endl;
+	if (settings.moistureMode == MOISTURE_WIND) {
+		calculateMoistureWind();
+		return;
+	}
+
+	instrument.log() << "Calculating moisture...";
 	FastNoise peturber(settings.seed);
 	peturber.SetFrequency(0.02f);
 	peturber.SetFractalOctaves(5);
@@ -426,18 +885,96 @@ void Generator::calculateMoisture() {
 	noise.SetFrequency(0.01f);
 	noise.SetCellularReturnType(FastNoise::CellularReturnType::CellValue);
 
+	//Noise is still sampled in world coordinates, so the pattern is the same at any climate resolution
 	float ptX = 0.0f, ptY = 0.0f;
-	for (int y = 0; y < settings.worldSize; y++) {
-		for (int x = 0; x < settings.worldSize; x++) {
-			ptX = (float)x;
-			ptY = (float)y;
+	int wx, wy;
+	for (int y = 0; y < climateSize; y++) {
+		for (int x = 0; x < climateSize; x++) {
+			wx = climateToWorld(x);
+			wy = climateToWorld(y);
+			ptX = (float)wx;
+			ptY = (float)wy;
 			peturber.GradientPerturb(ptX, ptY);
-			dataMoist->setValue(noise.GetCellular(ptX, ptY), x, y);
+			dataMoist->setValue(noise.GetCellular(ptX, ptY) + (settings.coastMoisture * getCoastInfluence(wx, wy)), x, y);
 		}
 	}
 	dataMoist->normalize();
 }
 
+//Wind moisture constants, given per map width so they don't depend on the map size
+static const float WIND_START_VAPOR = 0.5f; //Vapor in the air blowing in from off the map
+static const float WIND_EVAPORATE = 20.0f; //How fast the air picks vapor up over the ocean
+static const float WIND_RAIN = 1.5f; //How fast vapor rains out over flat land
+static const float WIND_UPLIFT = 3.0f; //Share of the vapor rained out per unit of height the air is pushed up
+
+//One step of the wind sweep over a cell with the given surface height (lakes count at sea level, as flat land).
+//Returns the moisture of the cell (the vapor arriving over it) and moves the vapor and last height on to the next cell.
+static inline float windStep(float& vapor, float& lastHeight, float height, bool ocean, float perCell) {
+	float moisture = vapor;
+	if (ocean) {
+		vapor += (1.0f - vapor) * std::min(1.0f, WIND_EVAPORATE * perCell);
+	} else {
+		//Air forced up a slope cools and rains out, on the far side there's little left
+		float rise = std::max(0.0f, height - lastHeight);
+		vapor -= vapor * std::min(1.0f, (WIND_RAIN * perCell) + (rise * WIND_UPLIFT));
+	}
+	lastHeight = height;
+	return moisture;
+}
+
+//Moisture from a prevailing wind. Air picks up vapor over the ocean and drops it as rain over land,
+//mostly where the ground rises under it, so the far side of mountains ends up in a rain shadow.
+//
+//Every scanline along the wind is a single linear pass. Scanlines are independent, so they're split over threads:
+//wind along y runs each contiguous row on its own, wind along x steps across the rows with a whole band of
+//scanlines side by side, which keeps the reads contiguous.
+void Generator::calculateMoistureWind() {
+	instrument.log() << "Calculating wind moisture...";
+	int size = climateSize;
+	int worldSize = settings.worldSize;
+	int threads = resolveThreadCount(settings.threadCount);
+	const float* height = dataHeight->data;
+	const uint8_t* water = dataWater->data;
+	float* moist = dataMoist->data;
+	float seaLevel = settings.seaLevel;
+
+	float perCell = 1.0f / (float)size;
+
+	//Where each climate row/column reads the height and water from
+	vector<int> world(size);
+	for (int c = 0; c < size; c++)
+		world[c] = climateToWorld(c);
+	bool reverse = settings.windDirection == WIND_FROM_EAST || settings.windDirection == WIND_FROM_SOUTH;
+
+	if (settings.windDirection == WIND_FROM_WEST || settings.windDirection == WIND_FROM_EAST) {
+		parallelFor(0, size, threads, [&](int y0, int y1) {
+			vector<float> vapor(y1 - y0, WIND_START_VAPOR);
+			vector<float> lastHeight(y1 - y0, seaLevel);
+			for (int s = 0; s < size; s++) {
+				int x = reverse ? size - 1 - s : s;
+				int row = x * size, worldRow = world[x] * worldSize;
+				for (int y = y0; y < y1; y++) {
+					int w = worldRow + world[y];
+					moist[row + y] = windStep(vapor[y - y0], lastHeight[y - y0], std::max(height[w], seaLevel), water[w] == 1, perCell);
+				}
+			}
+		});
+	} else {
+		parallelFor(0, size, threads, [&](int x0, int x1) {
+			for (int x = x0; x < x1; x++) {
+				int row = x * size, worldRow = world[x] * worldSize;
+				float vapor = WIND_START_VAPOR;
+				float lastHeight = seaLevel;
+				for (int s = 0; s < size; s++) {
+					int y = reverse ? size - 1 - s : s;
+					int w = worldRow + world[y];
+					moist[row + y] = windStep(vapor, lastHeight, std::max(height[w], seaLevel), water[w] == 1, perCell);
+				}
+			}
+		});
+	}
+}
+
 //Calculate the temperature.
 //This is a double function in a way.
 //It maintains a heat index from both latitude and height data.
@@ -447,15 +984,19 @@ void Generator::calculateMoisture() {
 //
 // Temperature data is 1=HOT ... 0=COLD
 void Generator::calculateTemperature() {
-	cout << "Calculating climate temperature..." << endl;
+	instrument.log() << "Calculating climate temperature...";
 	int halfSize = (settings.worldSize / 2);
-	float samp = 0.0f, band = 0.0f, out = 0.0f, htInfl;
-	for (int y = 0; y < settings.worldSize; y++) {
-		for (int x = 0; x < settings.worldSize; x++) {
-			samp = dataHeight->getValue(x, y); // Height of the tile
-			band = 1.0f - ((float)(abs(y - halfSize) / (float)halfSize)); //Equator/Poles "band" temperature 1 at center, 0 at top
-
-			if (dataWater->getValue(x, y) == 1) //If ocean, ignore height data
+	float samp = 0.0f, band = 0.0f, out = 0.0f, htInfl, coast;
+	int wx, wy;
+	for (int y = 0; y < climateSize; y++) {
+		for (int x = 0; x < climateSize; x++) {
+			//Climate cells can be bigger then world cells, read the world where this one sits
+			wx = climateToWorld(x);
+			wy = climateToWorld(y);
+			samp = dataHeight->getValue(wx, wy); // Height of the tile
+			band = 1.0f - ((float)(abs(wy - halfSize) / (float)halfSize)); //Equator/Poles "band" temperature 1 at center, 0 at top
+
+			if (dataWater->getValue(wx, wy) == 1) //If ocean, ignore height data
 				htInfl = 0;
 			else {
 				//Inverse the height minus sea-level.
@@ -468,6 +1009,10 @@ void Generator::calculateTemperature() {
 			//Mix the height influence and latitudal band and clamp the value between 0...1
 			out = std::max(0.0f, std::min(band+htInfl, 1.0f));
 
+			//Near the ocean the land takes on some of the ocean's (latitude only) temperature
+			coast = settings.coastTemperature * getCoastInfluence(wx, wy);
+			out = (out * (1.0f - coast)) + (band * coast);
+
 			//Set temperature data
 			dataTemp->setValue(out, x, y);
 		}
@@ -476,321 +1021,214 @@ void Generator::calculateTemperature() {
 	//I didn't like the very ridgidness of the resulting map.
 	//While it is correct, it is tile specific which makes for lot's of noise
 	//In reality this wouldn't happen, a kind of gradient or blur would be needed.
-	//So I do just that. Average the target tile with it's neightbors with a given "coefficent"
-	float t = 0.0f, r = 0.0f, b = 0.0f, l = 0.0f, avg = 0.0f;
-	for (int i = 0; i < 100; i++) {
-		for (int y = 0; y < settings.worldSize; y++) {
-			for (int x = 0; x < settings.worldSize; x++) {
-				samp = dataTemp->getValue(x, y);
-
-				//Get neighbor values from NSWE
-				t = dataTemp->getValueWrapped(x, y - 1);
-				r = dataTemp->getValueWrapped(x + 1, y);
-				b = dataTemp->getValueWrapped(x, y - 1);
-				l = dataTemp->getValueWrapped(x - 1, y);
-
-				//Average them together
-				avg = (samp + t + r + b + l) / 5.0f;
-
-				//Only use 50% influence. Honestly this is probably overkill, could just do full influence
-				//And have less need for iterations, but doing this to be safe so the whole thing doesn't go
-				//from un-touched, to completely average
-				dataTemp->setValue(((samp*0.5f) + (avg * 0.5f)), x, y);
-			}
-		}
-	}
+	//
+	//This used to be 100 passes of averaging every tile 50/50 with its NSWE neighbors, which spreads it out like
+	//a Gaussian with a variance of 100 * 2 * 0.1 = 20 cells along each axis. Three 9 wide boxes give the
+	//same variance (3 * (81 - 1) / 12) at a fraction of the cost. East-west wraps around, the poles don't.
+	//On a smaller climate grid the variance shrinks with the square of the scale, so the boxes get narrower.
+	float variance = 20.0f / (float)(climateScale * climateScale);
+	int radius = (int)roundf((sqrtf((4.0f * variance) + 1.0f) - 1.0f) * 0.5f);
+	boxBlur(dataTemp, radius, 3, STENCIL_WRAP, STENCIL_CLAMP, resolveThreadCount(settings.threadCount));
 }
 
-//This is a work-in-progress freshwater algorithm.
-//It doesn't work so good.
-//The idea so far is to "seed" rivers at random and only above a certain altitude.
-//As usually mountains are the start of rivers.
-//Then it was supposed to iterate over those river points and claim any neighbor point
-//which was lower then itself (downhill).
-//So far it just does a crazy flood-fill thing which is not useful.
-//
-//My idea to improve is to use velocity with random nudges to hopefully get it to snake along in a semi-straight path.
+//Rivers from the drainage of the whole map (see WGHydrology.h).
+//Every land cell gets its moisture as rain, the rain runs down the depression filled terrain,
+//and any land cell collecting more then settings.riverThreshold turns into freshwater.
+//Because the filled surface always drains to the sea or the map edge, the rivers form connected
+//networks that run all the way out instead of stopping in the first dip.
 void Generator::calculateFreshwater() {
-	cout << "Forming freshwater..." << endl;
+	instrument.log() << "Forming freshwater...";
 	int size = settings.worldSize;
 
-	vector<Point> water;
-	vector<Point> tmp;
-
-	srand(settings.seed);
-
-	float samp, msamp;
-	int swt;
-	//Seed the rivers by height
-	for (int y = 0; y < settings.worldSize; y++) {
-		for (int x = 0; x < settings.worldSize; x++) {
-			samp = dataHeight->getValue(x, y);
-
-			if (dataWater->getValue(x, y) > 0)
-				continue;
-
-			if (samp >= 0.3f) {
-				msamp = dataMoist->getValue(x, y);
-				swt = randomRange(0, (size*2) + (size - (int)(msamp * size)));
-				if (swt <= 1) {
-					dataWater->setValue(2, x, y);
-					dataHeight->setValue(dataHeight->getValue(x, y) - (1.0f / 255.0f), x, y);
-					water.push_back(Point(x, y));
-					cout << "Seeded river" << endl;
-				}
-			}
-		}
+	if (hydrology == NULL)
+		hydrology = new Hydrology(size);
+	FloatData* moist = fullSizeClimate(dataMoist);
+	hydrology->compute(dataHeight, dataWater, moist, resolveThreadCount(settings.threadCount));
+	if (moist != dataMoist)
+		delete moist;
+	instrument.progress(STAGE_FRESHWATER, 0.5f);
+
+	//Mark the rivers, lakes and ocean stay what they are
+	int cells = size * size;
+	const float* acc = hydrology->accumulation->data;
+	const uint8_t RIVER = 1, FED = 2; //FED: another river cell drains into this one
+	vector<uint8_t> marks(cells, 0);
+	int64_t riverCells = 0;
+	for (int32_t i = 0; i < cells; i++) {
+		if (dataWater->data[i] != 0 || acc[i] < settings.riverThreshold)
+			continue;
+		dataWater->data[i] = 2;
+		marks[i] |= RIVER;
+		riverCells++;
+
+		int32_t r = hydrology->getReceiver(i);
+		if (r >= 0)
+			marks[r] |= FED;
 	}
 
-	tmp.swap(water);
-	float samps[8];
-	int lowest = 0;
-	float delta;
-	for (int i = 0; i < 100; i++) {
-		//Using a vector instead of the whole map so we only iterate what we know is rivers
-		for (std::vector<Point>::iterator it = tmp.begin(); it != tmp.end(); ++it) {
-			Point pnt = *it;
-
-			//Get the height of the current river point and ALL neighbors
-			//North/North East/East/South East/South/South West/West/North West
-			samp = dataHeight->getValue(pnt.x, pnt.y);
-			samps[0] = dataHeight->getValueClamped(pnt.x, pnt.y - 1);
-			samps[1] = dataHeight->getValueClamped(pnt.x + 1, pnt.y - 1);
-			samps[2] = dataHeight->getValueClamped(pnt.x+1, pnt.y);
-			samps[3] = dataHeight->getValueClamped(pnt.x+1, pnt.y-1);
-			samps[4] = dataHeight->getValueClamped(pnt.x, pnt.y-1);
-			samps[5] = dataHeight->getValueClamped(pnt.x-1, pnt.y-1);
-			samps[6] = dataHeight->getValueClamped(pnt.x-1, pnt.y);
-			samps[7] = dataHeight->getValueClamped(pnt.x-1, pnt.y+1);
-
-			//Find the lowest instead of just spreading to all (which would really flood-fill)
-			lowest = -1;
-			delta = samp;
-			for (int j = 0; j < 8; j++) {
-				if (samps[j] < delta) {
-					delta = samps[j];
-					lowest = j;
-				} else if (samps[j] == delta) {
-					if (randomRange(0, 8) == 1)
-						lowest = j;
-				}
-			}
+	//Sources are the river cells nothing else flows into
+	int64_t sources = 0;
+	for (int32_t i = 0; i < cells; i++) {
+		if (marks[i] == RIVER)
+			sources++;
+	}
 
-			//From the chosen index, birth a new river tile
-			Point newPnt(-1, -1);
-			switch (lowest){
-			case 0:
-				newPnt.x = pnt.x;
-				newPnt.y = pnt.y - 1;
-				break;
-			case 1:
-				newPnt.x = pnt.x + 1;
-				newPnt.y = pnt.y - 1;
-				break;
-			case 2:
-				newPnt.x = pnt.x + 1;
-				newPnt.y = pnt.y;
-				break;
-			case 3:
-				newPnt.x = pnt.x + 1;
-				newPnt.y = pnt.y + 1;
-				break;
-			case 4:
-				newPnt.x = pnt.x;
-				newPnt.y = pnt.y + 1;
-				break;
-			case 5:
-				newPnt.x = pnt.x - 1;
-				newPnt.y = pnt.y + 1;
-				break;
-			case 6:
-				newPnt.x = pnt.x - 1;
-				newPnt.y = pnt.y;
-				break;
-			case 7:
-				newPnt.x = pnt.x - 1;
-				newPnt.y = pnt.y - 1;
-				break;
-			default:
-				continue;
-			}
+	instrument.count(COUNTER_RIVERS_SEEDED, sources);
+	instrument.log() << "River sources: " << sources << " River cells: " << riverCells;
+}
 
-			if (lowest >= 0) {
-				//Set the actual tile data
-				if (dataWater->getValue(newPnt.x, newPnt.y) > 0)
-					continue;
+void Generator::calculateDrainageBasins() {
+	ByteData* flow = hydrology != NULL ? hydrology->flowDirection : getDerivedTerrain()->flowDirection;
+	basins.build(flow, dataWater, resolveThreadCount(settings.threadCount));
+	instrument.log() << "Drainage basins: " << basins.getBasinCount();
+}
 
-				dataHeight->setValue(dataHeight->getValue(newPnt.x, newPnt.y) - (1.0f / 255.0f), newPnt.x, newPnt.y);
-				dataWater->setValue(2, newPnt.x, newPnt.y);
-				water.push_back(newPnt);
-			}
-		}
+void Generator::heightEdited(int x0, int y0, int x1, int y1) {
+	heightChanged();
+	if (hydrology == NULL)
+		return;
 
-		//Cannot modify the same vector you are iterating so copy over the water data to the temp vector for iteration
-		tmp.swap(water);
+	int size = settings.worldSize;
+	RainFunction rain = [&](int32_t i) {
+		if (climateUpsampler == NULL)
+			return dataMoist->data[i];
+		int x = i / size;
+		return climateUpsampler->sample(dataMoist, x, i - (x * size));
+	};
+	vector<int32_t> changed;
+	hydrology->update(dataHeight, dataWater, rain, x0, y0, x1, y1, changed);
+
+	//Same rule as calculateFreshwater, on just the cells whose flow changed.
+	//Any other freshwater among them (from erosion) is treated the same as river
+	const float* acc = hydrology->accumulation->data;
+	for (size_t k = 0; k < changed.size(); k++) {
+		int32_t i = changed[k];
+		if (dataWater->data[i] == 0 && acc[i] >= settings.riverThreshold)
+			dataWater->data[i] = 2;
+		else if (dataWater->data[i] == 2 && acc[i] < settings.riverThreshold)
+			dataWater->data[i] = 0;
 	}
+	instrument.log() << "Updated rivers after an edit, cells changed: " << changed.size();
+}
 
-	//Old algorithm, even worse (but actually didn't flood fill, just did straight lines
-	/*
-	float t, r, b, l;
-	for (int i = 0; i < 100; i++) {
-		for (std::vector<Point>::iterator it = tmp.begin(); it != tmp.end(); ++it) {
-			Point pnt = *it;
-			samp = dataHeight->getValue(pnt.x, pnt.y);
-			t = dataHeight->getValueClamped(pnt.x, pnt.y - 1);
-			r = dataHeight->getValueClamped(pnt.x - 1, pnt.y);
-			b = dataHeight->getValueClamped(pnt.x, pnt.y + 1);
-			l = dataHeight->getValueClamped(pnt.x+1, pnt.y);
-
-			if (t<r && t<b && t<l && t < samp) {
-				Point newPnt(pnt.x, pnt.y - 1);
+//Biome calculation is easiest part so far.
+//Takes the temperature and moisture data from their respective arrays and matches them to a biome switch
+//It's just a byte/uint8_t number matching to a constant in the Generator class
+void Generator::calculateBiomes() {
+	instrument.log() << "Calculating biome data...";
+	int size = settings.worldSize;
 
-				if (dataWater->getValue(newPnt.x, newPnt.y) > 0)
-					continue;
+	//Whole rows go through the biome table at once, the blend weights straight after from the same rows.
+	//Climate layers on a smaller grid are brought up one world row at a time, never the whole map
+	parallelFor(0, size, resolveThreadCount(settings.threadCount), [&](int x0, int x1) {
+		vector<float> tempRow, moistRow, scratch(size * 2);
+		if (climateUpsampler != NULL) {
+			tempRow.resize(size);
+			moistRow.resize(size);
+		}
 
-				dataHeight->setValue(dataHeight->getValue(newPnt.x, newPnt.y) - (1.0f / 255.0f), newPnt.x, newPnt.y);
-				dataWater->setValue(2, newPnt.x, newPnt.y);
-				water.push_back(newPnt);
+		for (int x = x0; x < x1; x++) {
+			const float* temp = dataTemp->data + (x * size);
+			const float* moist = dataMoist->data + (x * size);
+			if (climateUpsampler != NULL) {
+				climateUpsampler->row(dataTemp, x, tempRow.data(), scratch.data());
+				climateUpsampler->row(dataMoist, x, moistRow.data(), scratch.data());
+				temp = tempRow.data();
+				moist = moistRow.data();
 			}
-			if (b<t && b<r && b<l && b < samp) {
-				Point newPnt(pnt.x, pnt.y + 1);
-
-				if (dataWater->getValue(newPnt.x, newPnt.y) > 0)
-					continue;
-
-				dataHeight->setValue(dataHeight->getValue(newPnt.x, newPnt.y) - (1.0f / 255.0f), newPnt.x, newPnt.y);
-				dataWater->setValue(2, newPnt.x, newPnt.y);
-				water.push_back(newPnt);
+			biomeTable.classifyRow(temp, moist, dataWater->data + (x * size), dataBiomes->data + (x * size), size, scratch.data());
+			if (biomeBlend != NULL) {
+				biomeTable.blendRow(temp, moist, dataWater->data + (x * size), biomeBlend->ids.data() + (x * size * 4),
+					biomeBlend->weights.data() + (x * size * 4), size, scratch.data());
 			}
-			if (r<t && r<b && r<l && r < samp) {
-				Point newPnt(pnt.x-1, pnt.y);
+		}
+	});
+}
 
-				if (dataWater->getValue(newPnt.x, newPnt.y) > 0)
+//Land only, so the coast stays where the ocean is.
+//The blend was worked out from the unfiltered biomes, so a cell the filter changes takes the blend of the nearest
+//cell in its window that held the new biome before and after. Its weights come from the climate a few cells over,
+//which made that biome, rather then being made up. When there's no such cell the new biome is just moved to the
+//front of the cell's own blend, an approximation: the weights are still the ones of the old biome's climate
+void Generator::filterBiomes() {
+	int size = settings.worldSize;
+	int radius = std::min(settings.biomeFilterRadius, 127);
+	int threads = resolveThreadCount(settings.threadCount);
+	vector<uint8_t> unfiltered;
+	if (biomeBlend != NULL)
+		unfiltered.assign(dataBiomes->data, dataBiomes->data + (size * size));
+
+	modeFilter(dataBiomes, radius, biomeTable.getOceanBiome(), threads);
+	if (biomeBlend == NULL)
+		return;
+
+	const uint8_t* biomes = dataBiomes->data;
+	//Nearest cell in ring d around (x, y) that kept the biome, -1 if none does
+	auto keptOnRing = [&](int x, int y, int d, uint8_t id) {
+		for (int sx = std::max(x - d, 0); sx <= std::min(x + d, size - 1); sx++) {
+			int step = (sx == x - d || sx == x + d) ? 1 : 2 * d; //Whole row on the ring's edges, the two ends between
+			for (int sy = y - d; sy <= y + d; sy += step) {
+				int j = (sx * size) + sy;
+				if (sy >= 0 && sy < size && biomes[j] == id && unfiltered[j] == id)
+					return j;
+			}
+		}
+		return -1;
+	};
+
+	//The cells taken from never change, so rows can go to different threads
+	parallelFor(0, size, threads, [&](int x0, int x1) {
+		for (int i = x0 * size; i < x1 * size;) {
+			//Nearly every cell stays, skip them 8 at a time
+			uint64_t before, after;
+			if (i + 8 <= x1 * size) {
+				memcpy(&before, unfiltered.data() + i, 8);
+				memcpy(&after, biomes + i, 8);
+				if (before == after) {
+					i += 8;
 					continue;
-
-				dataHeight->setValue(dataHeight->getValue(newPnt.x, newPnt.y) - (1.0f / 255.0f), newPnt.x, newPnt.y);
-				dataWater->setValue(2, newPnt.x, newPnt.y);
-				water.push_back(newPnt);
+				}
 			}
-			if (l<t && l<b && l<r && l < samp) {
-				Point newPnt(pnt.x+1, pnt.y);
-
-				if (dataWater->getValue(newPnt.x, newPnt.y) > 0)
+			for (int end = std::min(i + 8, x1 * size); i < end; i++) {
+				if (biomes[i] == unfiltered[i])
 					continue;
-
-				dataHeight->setValue(dataHeight->getValue(newPnt.x, newPnt.y) - (1.0f / 255.0f), newPnt.x, newPnt.y);
-				dataWater->setValue(2, newPnt.x, newPnt.y);
-				water.push_back(newPnt);
+				int source = -1;
+				for (int d = 1; d <= radius && source < 0; d++)
+					source = keptOnRing(i / size, i % size, d, biomes[i]);
+				if (source >= 0) {
+					std::copy(biomeBlend->ids.begin() + (source * 4), biomeBlend->ids.begin() + (source * 4) + 4, biomeBlend->ids.begin() + (i * 4));
+					std::copy(biomeBlend->weights.begin() + (source * 4), biomeBlend->weights.begin() + (source * 4) + 4, biomeBlend->weights.begin() + (i * 4));
+				}
+				//The blend there may still lead with another biome if it was near a table edge
+				biomeBlend->lead(i, biomes[i]);
 			}
 		}
-
-		tmp.swap(water);
-		cout << "River iteration complete. Water tiles = " << tmp.size() << endl;
-	}
-	*/
-
-	//Delete the temperary data
-	tmp.clear();
-	water.clear();
+	});
 }
 
-//Biome calculation is easiest part so far.
-//Takes the temperature and moisture data from their respective arrays and matches them to a biome switch
-//It's just a byte/uint8_t number matching to a constant in the Generator class
-void Generator::calculateBiomes() {
-	cout << "Calculating biome data..." << endl;
+void Generator::indexBiomes() {
+	biomeIndex->build(dataBiomes, resolveThreadCount(settings.threadCount));
+	instrument.log() << "Biome index: " << (biomeIndex->getMemoryBytes() >> 10) << " KB";
+}
 
-	float msamp, tsamp;
-	int tempScale, moistScale;
-	for (int y = 0; y < settings.worldSize; y++) {
-		for (int x = 0; x < settings.worldSize; x++) {
-			if (dataWater->getValue(x, y) == 1) //If ocean, set to ocean biome
-				dataBiomes->setValue(BIOME_OCEAN, x, y);
-			else {
-				msamp = dataMoist->getValue(x, y);
-				tsamp = dataTemp->getValue(x, y);
-				tempScale = (int)(3.0f - roundf(tsamp * 3)); //Inverse the temperature and make it 0...3 (4 levels)
-				moistScale = (int)(roundf(msamp * 5)); //Make the moisture to scale 0...5 (6 levels)
+void Generator::findBiomeRegions() {
+	biomeRegions->build(dataBiomes, resolveThreadCount(settings.threadCount));
+	instrument.log() << "Biome regions: " << biomeRegions->getRegionCount() << ", " << (biomeRegions->neighbors.size() / 2) << " borders";
+}
 
-				dataBiomes->setValue(getBiome(tempScale, moistScale), x, y);
-			}
-		}
-	}
+//Copies or upsamples a climate layer into a world sized one
+void Generator::upsampleClimate(FloatData* layer, FloatData* out) {
+	if (climateUpsampler == NULL)
+		std::copy(layer->data, layer->data + (layer->size * layer->size), out->data);
+	else
+		climateUpsampler->upsample(layer, out, resolveThreadCount(settings.threadCount));
 }
 
-uint8_t Generator::getBiome(int temp, int moist) {
-	switch (moist) {
-	case 0: //If no moisutre
-		switch (temp) {
-		case 0: //And super hot (remember inverse temperature
-			return BIOME_SUBTROPICAL_DESERT; //Then make sahara desert
-		case 1:
-		case 2:
-			return BIOME_TEMPERATE_DESERT;
-		case 3: //If super cold
-			return BIOME_SCORCHED; //Scorched earth (super frosty dead-lands
-		}
-		break;
-	case 1:
-		switch (temp) {
-		case 0:
-		case 1:
-			return BIOME_GRASSLAND;
-		case 2:
-			return BIOME_TEMPERATE_DESERT;
-		case 3:
-			return BIOME_BARE;
-		}
-		break;
-	case 2:
-		switch (temp) {
-		case 0:
-			return BIOME_TROPICAL_FOREST;
-		case 1:
-			return BIOME_GRASSLAND;
-		case 2:
-			return BIOME_SHRUBLAND;
-		case 3:
-			return BIOME_TUNDRA;
-		}
-		break;
-	case 3: //On the middle side of moisture
-		switch (temp) {
-		case  0: //But super hot make it tropical forest
-			return BIOME_TROPICAL_FOREST;
-		case 1:
-			return BIOME_DECIDEOUS_FOREST;
-		case 2:
-			return BIOME_SHRUBLAND;
-		case 3: //Or if super cold make it arctic snow lands
-			return BIOME_ARCTIC;
-		}
-		break;
-	case 4:
-		switch (temp) {
-		case 0:
-			return BIOME_TROPICAL_RAIN_FOREST;
-		case 1:
-			return BIOME_DECIDEOUS_FOREST;
-		case 2:
-			return BIOME_TAIGA;
-		case 3:
-			return BIOME_ARCTIC;
-		}
-		break;
-	case 5: //TONS of moisture, maxed out, like raining all the time
-		switch (temp) {
-		case 0: //And super hot, obviously rain forest
-			return BIOME_TROPICAL_RAIN_FOREST;
-		case 1:
-			return BIOME_TEMPERATE_RAIN_FOREST;
-		case 2:
-			return BIOME_TAIGA;
-		case 3: //Or super cold, then go to snowy blizzard arctic
-			return BIOME_ARCTIC;
-		}
-		break;
-	}
-	cout << "Warning, biome scale fell out of range: Temp=" << temp << " Moisture=" << moist << endl;
-	return BIOME_SCORCHED;
+//The layer itself at full resolution, otherwise a new world sized copy the caller deletes
+FloatData* Generator::fullSizeClimate(FloatData* layer) {
+	if (climateUpsampler == NULL)
+		return layer;
+	FloatData* out = new FloatData(settings.worldSize);
+	upsampleClimate(layer, out);
+	return out;
 }
@@ -1,8 +1,18 @@
 #pragma once
+#include <cmath>
 
 #include "WGGeneratorSettings.h"
 #include "WGFloatData.h"
 #include "WGByteData.h"
+#include "WGInstrumentation.h"
+#include "WGLabeling.h"
+#include "WGBitMask.h"
+#include "WGResample.h"
+#include "WGHydrology.h"
+#include "WGDrainageBasins.h"
+#include "WGBiomeTable.h"
+#include "WGBiomeIndex.h"
+#include "WGBiomeRegions.h"
 
 struct vector3 {
 	float x = 0.0f;
@@ -21,17 +31,15 @@ struct vector3 {
 	}
 };
 
-struct waterCell {
-	float waterAmount = 0.0f;
-	float sedimentAmount = 0.0f;
-};
-
 namespace WG {
 	class PerlinNoise;
+	class Benchmark;
+	struct DerivedTerrain;
 
 	// Holds the generator parent information and connects everything up
 	class Generator {
 	public:
+		//Ids of the built in biome table (BiomeTable::setDefaults), a loaded table can use its own
 		static const uint8_t BIOME_OCEAN = 0;
 		static const uint8_t BIOME_SUBTROPICAL_DESERT = 1;
 		static const uint8_t BIOME_GRASSLAND = 2;
@@ -53,36 +61,110 @@ namespace WG {
 		void generate();
 
 		inline FloatData* getHeightData() { return this->dataHeight; }
+		//Temperature and moisture are settings.climateDownsample times smaller then the world,
+		//use upsampleClimate to get them at full size
 		inline FloatData* getTemperatureData() { return this->dataTemp; }
 		inline ByteData* getWaterData() { return this->dataWater; }
+		//Every connected body of water below sea level (ocean and lakes) with its size and bounds
+		inline ComponentLabeling* getWaterBodies() { return &this->waterBodies; }
+		//Land within settings.shoreWidth cells of the ocean, NULL when shoreWidth is 0
+		inline BitMask* getShoreMask() { return this->shoreMask; }
 		inline ByteData* getBiomeData() { return this->dataBiomes; }
+		//Which biome each temperature and moisture makes, load a table into it before generate() to change them
+		inline BiomeTable* getBiomeTable() { return &this->biomeTable; }
+		//Heaviest biomes of every cell and their weights, for renderers to splat. NULL unless settings.biomeBlendRadius is set
+		inline BiomeBlend* getBiomeBlend() { return this->biomeBlend; }
+		//Area and nearest cell lookups on the biome map, NULL unless settings.biomeIndex is on
+		inline BiomeIndex* getBiomeIndex() { return this->biomeIndex; }
+		//Connected areas of one biome with their stats and which border which, NULL unless settings.biomeRegions is on
+		inline BiomeRegions* getBiomeRegions() { return this->biomeRegions; }
 		inline FloatData* getMoistureData() { return this->dataMoist; }
+		//Writes a climate layer (temperature or moisture) into out at the full world size
+		void upsampleClimate(FloatData* layer, FloatData* out);
+		//Distance in cells to the nearest ocean cell, NULL unless settings.coastDistance is on
+		inline FloatData* getCoastDistanceData() { return this->dataCoast; }
+
+		//Gradient, slope and flow direction of the current height data.
+		//Built the first time it's asked for and kept until the height data changes again
+		DerivedTerrain* getDerivedTerrain();
+		//Filled height, flow directions and accumulation the rivers were traced from, NULL without rivers
+		inline Hydrology* getHydrology() { return this->hydrology; }
+		//Basin every land cell drains to, with the cells, outlet and upstream area lookups.
+		//Follows the rivers' flow when there are rivers, the plain terrain's otherwise (pits being their own basins).
+		//Built by generate(), heightEdited() leaves it as it was
+		inline DrainageBasins* getDrainageBasins() { return &this->basins; }
+
+		//Call after changing the height data inside x0 <= x < x1, y0 <= y < y1 (an editor brush).
+		//The rivers there and downstream are brought up to date in place, without running the freshwater stage again
+		void heightEdited(int x0, int y0, int x1, int y1);
+
+		//Log sink, progress callback and counters for this generator
+		inline Instrumentation* getInstrumentation() { return &this->instrument; }
 	private:
+		friend class Benchmark;
+
 		Settings settings;
+		Instrumentation instrument;
 
 		FloatData* dataHeight;
 		FloatData* dataTemp;
-		ByteData* dataWater;
+		ByteData* dataWater; //0 = land, 1 = ocean, 2 = freshwater, 3 = lake
 		ByteData* dataBiomes;
+		BiomeTable biomeTable;
+		BiomeBlend* biomeBlend;
+		BiomeIndex* biomeIndex;
+		BiomeRegions* biomeRegions;
 
 		FloatData* dataMoist;
+		FloatData* dataCoast;
+
+		int climateScale; //World cells per climate cell along each side
+		int climateSize;
+		BilinearUpsampler* climateUpsampler;
+
+		//World cell a climate cell samples its inputs from (the one nearest its center). climateUpsampler puts the
+		//cell back at that spot, both going by climateScale even where the world size isn't a multiple of it
+		inline int climateToWorld(int c) { return std::min((c * climateScale) + (climateScale / 2), settings.worldSize - 1); }
+		//The layer at full size. Either the layer itself or a new upsampled copy the caller deletes
+		FloatData* fullSizeClimate(FloatData* layer);
+
+		ComponentLabeling waterBodies;
+		BitMask* shoreMask;
+
+		DerivedTerrain* derived;
+		bool derivedValid;
+		Hydrology* hydrology;
+		DrainageBasins basins;
+
+		//Every stage that writes to dataHeight calls this when it's done
+		inline void heightChanged() { derivedValid = false; }
+
+		void generateHeight();
 
 		void hmPangaea();
 		void hmInvPangaea();
 		void hmStraight();
 
 		void erosionThermal();
+		int erodeThermalLevel(FloatData* height, int32 iters, float thresh);
 		void erosionHydraulic();
 		void erosionHydrailicImproved();
+		void erosionHydraulicDroplets();
 
 		void calculateSaltwater();
+		void calculateCoastDistance();
 		void calculateMoisture();
+		void calculateMoistureWind();
 		void calculateTemperature();
 		void calculateFreshwater();
+		void calculateDrainageBasins();
 
 		void calculateBiomes();
+		void filterBiomes();
+		void indexBiomes();
+		void findBiomeRegions();
 
-		uint8_t getBiome(int temp, int moist);
+		float getCoastInfluence(int x, int y);
 	};
 }
 
@@ -10,17 +10,61 @@ namespace WG {
 		NONE, PANGAEA, INV_PANGAEA, STRAIGHT
 	};
 
+	// Which hydraulic erosion algorithm to run
+	enum HydraulicErosionMode {
+		HYDRAULIC_GRID, HYDRAULIC_PIPE, HYDRAULIC_DROPLET
+	};
+
+	// How the moisture map is made
+	enum MoistureMode {
+		MOISTURE_NOISE, MOISTURE_WIND
+	};
+
+	// Where the prevailing wind comes from (north is y = 0, west is x = 0)
+	enum WindDirection {
+		WIND_FROM_WEST, WIND_FROM_EAST, WIND_FROM_NORTH, WIND_FROM_SOUTH
+	};
+
 	//Sets up and contains the settings for the generation
 	struct Settings {
 		int32 worldSize;
 		unsigned int seed;
 		HeightModifier heightModifier;
 		float seaLevel;
+		int32 oceanMinArea = 4096; //Enclosed bodies of water at least this many cells are still ocean
+		int32 lakeMinArea = 16; //Enclosed bodies of water smaller than this dry up into land
+		int32 coastSmoothing = 0; //Radius of the open/close pass that smooths the ocean outline (0 = off)
+		int32 shoreWidth = 0; //Width in cells of the shore band along the ocean (0 = no shore mask)
+
+		bool coastDistance = false; //Build the distance to the ocean layer (the coast settings below need it)
+		float coastRange = 32.0f; //Cells over which the coast's influence fades off (by 1/e)
+		float coastMoisture = 0.0f; //Moisture added right at the coast (NOISE moisture only)
+		float coastTemperature = 0.0f; //How much the coast pulls land temperature toward the ocean's (0...1)
 
 		int32 thermalErosionIterations;
 		float thermalErosionThreshold;
 		float thermalErosionCoefficient;
+		float thermalErosionTolerance = 0.0f; //Stop early once the largest height change in an iteration drops below this (0 = never)
+		int32 thermalErosionLevels = 1; //Resolution levels to erode coarse-to-fine (1 = full resolution only, 2 stays close to it, more trade accuracy for speed)
+		int32 thermalErosionFineIterations = 2; //Iterations on the full resolution map, and each level above the coarsest, with more than one level
+
+		int32 climateDownsample = 1; //Temperature and moisture are made at 1/this of the world size (1, 2, 4 or 8) and upsampled where used
+		MoistureMode moistureMode = MOISTURE_NOISE; //NOISE is warped cellular noise, WIND carries moisture in off the ocean
+		WindDirection windDirection = WIND_FROM_WEST;
+
+		float riverThreshold = 0.0f; //Rain (moisture summed over the cells upstream) that makes a cell a river (0 = no rivers)
+
+		int32 biomeFilterRadius = 0; //Radius of the majority filter that clears single cell speckle out of the biome map (0 = off, at most 127)
+		float biomeBlendRadius = 0.0f; //Temperature and moisture distance the biome blend weights reach over (0 = no blend layer, at most 0.25)
+		bool biomeIndex = false; //Index the finished biome map for area and nearest biome queries (one bit per cell per biome)
+		bool biomeRegions = false; //Split the finished biome map into connected regions with their adjacency graph
 
 		int32 hydraulicErosionIterations;
+		HydraulicErosionMode hydraulicErosionMode = HYDRAULIC_GRID; //GRID is the original bucket model, PIPE the virtual pipe model
+		int32 hydraulicDropletsPerIteration = 65536; //Droplets rained per iteration in DROPLET mode
+
+		int32 threadCount = 0; //Worker threads for the parallel stages (0 = one per hardware thread)
+		int32 stencilTileSize = 128; //Tile width for the cache blocked iterative stages
+		int32 stencilBlockDepth = 0; //Iterations run on a tile before moving to the next (0 = plain full map sweeps)
 	};
 }
\ No newline at end of file
@@ -0,0 +1,375 @@
+#include "WGHydrology.h"
+
+#include <queue>
+#include <unordered_map>
+#include <cmath>
+#include <cfloat>
+
+using namespace WG;
+
+//How far (in height) a filled cell can sit above the lowest of its neighbors before update() counts it as
+//lake that could drain away. Filled flats climb by a float step a cell, this stays well clear of those
+static const float DRAIN_TOLERANCE = 1.0e-6f;
+
+//Marks in Hydrology::marks used by update()
+static const uint8_t MARK_REGION = 1; //Being filled again
+static const uint8_t MARK_VISITED = 2; //Reached by the current flood
+static const uint8_t MARK_RING = 4; //Outside the region next to it, a seed for the flood
+static const uint8_t MARK_SAVED = 8; //Direction is being worked out again
+static const uint8_t MARK_QUEUED = 16; //Waiting in the accumulation queue
+static const uint8_t MARK_CHANGED = 32; //Listed in the changed cells
+
+//A cell waiting in a Priority-Flood or accumulation heap
+struct FloodCell {
+	float height;
+	int32_t index;
+
+	//Ties go to the lower index so the fill doesn't depend on how the heap shuffles
+	inline bool operator>(const FloodCell& other) const {
+		return height > other.height || (height == other.height && index > other.index);
+	}
+	inline bool operator<(const FloodCell& other) const {
+		return height < other.height || (height == other.height && index < other.index);
+	}
+};
+
+typedef std::priority_queue<FloodCell, std::vector<FloodCell>, std::greater<FloodCell> > FloodHeap; //Lowest first
+typedef std::priority_queue<FloodCell> DrainHeap; //Highest first, so every cell comes before the one it drains into
+
+//Calls func with every neighbor of cell c that is on the map
+template<typename Func>
+static inline void forNeighbors(int32_t c, int size, const int32_t* offsets, Func func) {
+	int x = c / size, y = c - (x * size);
+	for (int d = 0; d < 8; d++) {
+		int nx = x + FLOW_DX[d], ny = y + FLOW_DY[d];
+		if (nx >= 0 && ny >= 0 && nx < size && ny < size)
+			func(c + offsets[d]);
+	}
+}
+
+//Priority-Flood from whatever is already in the heap into the cells isOpen(i) allows, close(i) takes
+//them out. Raised cells and cells climbing a slope skip the heap (see WGHydrology.h)
+template<typename Open, typename Close>
+static void flood(float* filled, const int32_t* offsets, int size, FloodHeap& open, Open isOpen, Close close) {
+	std::queue<int32_t> pit;
+	std::queue<int32_t> slope;
+
+	while (!open.empty() || !pit.empty() || !slope.empty()) {
+		int32_t c;
+		if (!pit.empty()) {
+			c = pit.front();
+			pit.pop();
+		} else if (!slope.empty()) {
+			c = slope.front();
+			slope.pop();
+			//A slope cell next to anything lower that's still open could be a spill point,
+			//so it waits in the heap for its turn. Otherwise nothing it reaches needs raising
+			bool reachesLower = false;
+			forNeighbors(c, size, offsets, [&](int32_t n) {
+				if (isOpen(n) && filled[n] <= filled[c])
+					reachesLower = true;
+			});
+			if (reachesLower) {
+				open.push(FloodCell{ filled[c], c });
+				continue;
+			}
+		} else {
+			c = open.top().index;
+			open.pop();
+		}
+
+		float level = filled[c];
+		forNeighbors(c, size, offsets, [&](int32_t n) {
+			if (!isOpen(n))
+				return;
+			close(n);
+
+			if (filled[n] <= level) {
+				//Under the water line, raise it just enough to drain back the way the flood came
+				filled[n] = nextafterf(level, FLT_MAX);
+				pit.push(n);
+			} else {
+				slope.push(n);
+			}
+		});
+	}
+}
+
+Hydrology::Hydrology(int size) {
+	this->size = size;
+	filled = new FloatData(size);
+	flowDirection = new ByteData(size);
+	accumulation = new FloatData(size);
+
+	for (int d = 0; d < 8; d++)
+		offsets[d] = (FLOW_DX[d] * size) + FLOW_DY[d];
+}
+
+Hydrology::~Hydrology() {
+	delete filled;
+	delete flowDirection;
+	delete accumulation;
+}
+
+void Hydrology::compute(FloatData* height, ByteData* water, FloatData* rain, int threads) {
+	fillDepressions(height, water);
+
+	computeFlowDirections(filled, flowDirection, threads);
+	for (int i = 0; i < (size * size); i++) {
+		if (water->data[i] == 1)
+			flowDirection->data[i] = FLOW_NONE;
+	}
+
+	accumulate(water, rain);
+}
+
+void Hydrology::fillDepressions(FloatData* height, ByteData* water) {
+	int cells = size * size;
+	std::copy(height->data, height->data + cells, filled->data);
+
+	std::vector<uint8_t> closed(cells, 0);
+	FloodHeap open;
+
+	//Seed with the outlets. The open sea is closed off right away,
+	//only the ocean cells along a coast ever reach anything
+	for (int32_t i = 0; i < cells; i++) {
+		if (water->data[i] != 1 && !isEdge(i))
+			continue;
+
+		closed[i] = 1;
+		bool reachesLand = isEdge(i);
+		forNeighbors(i, size, offsets, [&](int32_t n) {
+			if (water->data[n] != 1)
+				reachesLand = true;
+		});
+		if (reachesLand)
+			open.push(FloodCell{ filled->data[i], i });
+	}
+
+	flood(filled->data, offsets, size, open,
+		[&](int32_t n) { return closed[n] == 0; },
+		[&](int32_t n) { closed[n] = 1; });
+}
+
+void Hydrology::accumulate(ByteData* water, FloatData* rain) {
+	int cells = size * size;
+	float* acc = accumulation->data;
+
+	//How many neighbors still have to hand their water on to each cell
+	std::vector<uint8_t> waiting(cells, 0);
+	for (int32_t i = 0; i < cells; i++) {
+		int32_t r = getReceiver(i);
+		if (r >= 0)
+			waiting[r]++;
+		acc[i] = water->data[i] == 1 ? 0.0f : (rain != NULL ? rain->data[i] : 1.0f);
+	}
+
+	//Start at every ridge (nothing flows in) and follow the water down.
+	//The walk stops at a cell that still has upstream neighbors to wait for, the last of them carries on.
+	//Cells a walk went through are marked DONE so the scan doesn't start from them again
+	const uint8_t DONE = 255;
+	for (int32_t i = 0; i < cells; i++) {
+		if (waiting[i] != 0)
+			continue;
+
+		int32_t c = i, r;
+		while ((r = getReceiver(c)) >= 0) {
+			acc[r] += acc[c];
+			if (--waiting[r] != 0)
+				break;
+			waiting[r] = DONE;
+			c = r;
+		}
+	}
+}
+
+//Same choice the computeFlowDirections kernel makes, for one cell
+uint8_t Hydrology::steepestDescent(int32_t c) const {
+	static const float DIAGONAL = 0.70710678f;
+	int x = c / size, y = c - (x * size);
+	float h = filled->data[c], best = 0.0f;
+	uint8_t dir = FLOW_NONE;
+	for (int d = 0; d < 8; d++) {
+		int nx = std::max(0, std::min(x + FLOW_DX[d], size - 1));
+		int ny = std::max(0, std::min(y + FLOW_DY[d], size - 1));
+		float drop = h - filled->data[nx * size + ny];
+		if (FLOW_DX[d] != 0 && FLOW_DY[d] != 0)
+			drop *= DIAGONAL;
+		if (drop > best) {
+			best = drop;
+			dir = (uint8_t)d;
+		}
+	}
+	return dir;
+}
+
+void Hydrology::update(FloatData* height, ByteData* water, const RainFunction& rain, int x0, int y0, int x1, int y1, std::vector<int32_t>& changed) {
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	x1 = std::min(x1, size);
+	y1 = std::min(y1, size);
+	if (x0 >= x1 || y0 >= y1)
+		return;
+	if (marks.empty())
+		marks.assign(size * size, 0);
+
+	float* fill = filled->data;
+	float* acc = accumulation->data;
+	auto isOutlet = [&](int32_t i) { return water->data[i] == 1 || isEdge(i); };
+
+	//1. The region to fill again: the edit, and whatever drains into it that the edit can reach.
+	//Cells upstream only change if they are no higher then the new heights (a dam backing water up into them)
+	//or already under water (a lake the edit could let out)
+	std::vector<int32_t> region;
+	float cap = -FLT_MAX;
+	for (int x = x0; x < x1; x++) {
+		for (int y = y0; y < y1; y++) {
+			int32_t i = x * size + y;
+			marks[i] |= MARK_REGION;
+			region.push_back(i);
+			cap = std::max(cap, height->data[i]);
+		}
+	}
+	cap += DRAIN_TOLERANCE;
+
+	auto growUpstream = [&](size_t from) {
+		for (size_t k = from; k < region.size(); k++) {
+			int32_t c = region[k];
+			forNeighbors(c, size, offsets, [&](int32_t n) {
+				if ((marks[n] & MARK_REGION) || getReceiver(n) != c)
+					return;
+				if (fill[n] <= cap || fill[n] > height->data[n]) {
+					marks[n] |= MARK_REGION;
+					region.push_back(n);
+				}
+			});
+		}
+	};
+	growUpstream(0);
+
+	//2. Fill the region from the ring of cells around it, which keep their levels. If a ring cell is
+	//left without a way down, or a lake on it could now drain lower, it joins the region and it goes again
+	std::vector<int32_t> ring;
+	while (true) {
+		for (size_t k = 0; k < ring.size(); k++)
+			marks[ring[k]] &= ~MARK_RING;
+		ring.clear();
+
+		FloodHeap open;
+		for (size_t k = 0; k < region.size(); k++) {
+			int32_t c = region[k];
+			fill[c] = height->data[c];
+			if (isOutlet(c)) {
+				marks[c] |= MARK_VISITED;
+				open.push(FloodCell{ fill[c], c });
+			}
+			forNeighbors(c, size, offsets, [&](int32_t n) {
+				if (marks[n] & (MARK_REGION | MARK_RING))
+					return;
+				marks[n] |= MARK_RING;
+				ring.push_back(n);
+				open.push(FloodCell{ fill[n], n });
+			});
+		}
+
+		flood(fill, offsets, size, open,
+			[&](int32_t n) { return (marks[n] & (MARK_REGION | MARK_VISITED)) == MARK_REGION; },
+			[&](int32_t n) { marks[n] |= MARK_VISITED; });
+		for (size_t k = 0; k < region.size(); k++)
+			marks[region[k]] &= ~MARK_VISITED;
+
+		size_t grown = region.size();
+		for (size_t k = 0; k < ring.size(); k++) {
+			int32_t b = ring[k];
+			if (isOutlet(b))
+				continue;
+			float lowest = FLT_MAX;
+			forNeighbors(b, size, offsets, [&](int32_t n) { lowest = std::min(lowest, fill[n]); });
+			bool stuck = lowest >= fill[b];
+			bool drains = fill[b] > std::max(height->data[b], lowest) + DRAIN_TOLERANCE;
+			if (stuck || drains) {
+				marks[b] = (marks[b] & ~MARK_RING) | MARK_REGION;
+				region.push_back(b);
+			}
+		}
+		if (grown == region.size())
+			break;
+		growUpstream(grown);
+	}
+
+	//3. New directions for the region and its ring, the only cells that can see a changed level.
+	//What they used to pass on is kept to take back out of the cells below
+	std::vector<int32_t> cells(region);
+	cells.insert(cells.end(), ring.begin(), ring.end());
+	std::vector<int32_t> oldReceiver(cells.size());
+	std::vector<float> oldAccumulation(cells.size());
+	for (size_t k = 0; k < cells.size(); k++) {
+		int32_t c = cells[k];
+		marks[c] |= MARK_SAVED;
+		oldReceiver[k] = getReceiver(c);
+		oldAccumulation[k] = acc[c];
+	}
+	for (size_t k = 0; k < cells.size(); k++) {
+		int32_t c = cells[k];
+		flowDirection->data[c] = water->data[c] == 1 ? FLOW_NONE : steepestDescent(c);
+	}
+
+	//Passes the pending amounts down the map, highest cell first so every cell has all of its inflow
+	//before it moves on. Stops at the outlets and at cells marked with stopAt
+	std::unordered_map<int32_t, float> pending;
+	DrainHeap queue;
+	auto enqueue = [&](int32_t c, float amount) {
+		pending[c] += amount;
+		if (!(marks[c] & MARK_QUEUED)) {
+			marks[c] |= MARK_QUEUED;
+			queue.push(FloodCell{ fill[c], c });
+		}
+	};
+	auto drain = [&](uint8_t stopAt) {
+		while (!queue.empty()) {
+			int32_t c = queue.top().index;
+			queue.pop();
+			marks[c] &= ~MARK_QUEUED;
+			float amount = pending[c];
+			pending.erase(c);
+			acc[c] += amount;
+			if (!(marks[c] & MARK_CHANGED)) {
+				marks[c] |= MARK_CHANGED;
+				changed.push_back(c);
+			}
+
+			int32_t r = getReceiver(c);
+			if (r >= 0 && !(marks[r] & stopAt))
+				enqueue(r, amount);
+		}
+	};
+
+	//4. Take the old flow of those cells back out of everything below them, up to the next of them.
+	//The cells below kept their directions and levels, so the order still holds
+	for (size_t k = 0; k < cells.size(); k++) {
+		int32_t r = oldReceiver[k];
+		if (r >= 0 && !(marks[r] & MARK_SAVED))
+			enqueue(r, -oldAccumulation[k]);
+	}
+	drain(MARK_SAVED);
+
+	//5. They start over from their own rain and the other cells still draining into them,
+	//then it all goes down the new directions
+	for (size_t k = 0; k < cells.size(); k++) {
+		int32_t c = cells[k];
+		float inflow = water->data[c] == 1 ? 0.0f : rain(c);
+		forNeighbors(c, size, offsets, [&](int32_t n) {
+			if (!(marks[n] & MARK_SAVED) && getReceiver(n) == c)
+				inflow += acc[n];
+		});
+		acc[c] = 0.0f;
+		enqueue(c, inflow);
+	}
+	drain(0);
+
+	//Leave the marks clear for the next call
+	for (size_t k = 0; k < cells.size(); k++)
+		marks[cells[k]] = 0;
+	for (size_t k = 0; k < changed.size(); k++)
+		marks[changed[k]] = 0;
+}
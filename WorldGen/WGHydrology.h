@@ -0,0 +1,67 @@
+#pragma once
+#include "WGFloatData.h"
+#include "WGByteData.h"
+#include "WGDerivedTerrain.h"
+
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+namespace WG {
+	//Rain falling on cell i (its x * size + y index)
+	typedef std::function<float(int32_t)> RainFunction;
+
+	//Where the rain goes once it lands on the map.
+	//
+	//compute() runs three passes over a height map:
+	//1. Depression filling (Priority-Flood, Barnes et al. 2014). The map is flooded inwards from the outlets,
+	//   always from the lowest cell reached so far. Cells below the level they were reached at get raised to a
+	//   hair (one float step) above it, so every filled pit and flat still slopes down to where it spills out.
+	//   Cells that get raised go on a plain queue, and so do cells climbing a slope with nothing lower around
+	//   (Zhou et al. 2016), only the cells that could be a spill point need the heap.
+	//2. D8 flow directions on the filled surface (computeFlowDirections), so every cell has a way out.
+	//3. Flow accumulation. Every cell passes its rain on once everything upstream of it is done (Kahn's
+	//   topological order over the flow directions), which is linear in the cells.
+	//
+	//The outlets are the ocean and the map edge. Ocean cells never flow anywhere, they only collect.
+	//
+	//update() redoes all three for a small edit without touching the rest of the map. Only the edit and the
+	//cells draining into it that it can back water up into (or let a lake out of) are filled again, seeded
+	//from the ring of unchanged cells around them, and the region grows wherever that ring no longer fits.
+	//The accumulation is fixed up by taking the old flow of the redone cells out of the cells below them
+	//and putting the new flow in, passed down highest cell first.
+	class Hydrology {
+	public:
+		int size;
+		FloatData* filled; //Height with every depression filled to its spill point
+		ByteData* flowDirection; //Index into FLOW_DX/FLOW_DY, FLOW_NONE on ocean cells and sinks at the edge
+		FloatData* accumulation; //Rain collected by the cell from itself and everything upstream
+
+		Hydrology(int size);
+		~Hydrology();
+
+		//water marks the ocean (1), rain is what every land cell adds (NULL adds 1 each)
+		void compute(FloatData* height, ByteData* water, FloatData* rain, int threads);
+
+		//Brings everything up to date after the height changed inside x0 <= x < x1, y0 <= y < y1 (water staying the same).
+		//Adds every cell whose accumulation changed to changed
+		void update(FloatData* height, ByteData* water, const RainFunction& rain, int x0, int y0, int x1, int y1, std::vector<int32_t>& changed);
+
+		//Index of the cell that cell i drains into, or -1
+		inline int32_t getReceiver(int32_t i) const {
+			uint8_t d = flowDirection->data[i];
+			return d == FLOW_NONE ? -1 : i + offsets[d];
+		}
+		inline bool isEdge(int32_t i) const {
+			int x = i / size, y = i - (x * size);
+			return x == 0 || y == 0 || x == size - 1 || y == size - 1;
+		}
+	private:
+		int32_t offsets[8]; //Index step of every flow direction
+		std::vector<uint8_t> marks; //Scratch flags for update(), all clear between calls
+
+		void fillDepressions(FloatData* height, ByteData* water);
+		void accumulate(ByteData* water, FloatData* rain);
+		uint8_t steepestDescent(int32_t c) const;
+	};
+}
@@ -0,0 +1,441 @@
+#include "WGImageWriter.h"
+#include "WGParallel.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace WG;
+
+static const size_t BUFFER_SIZE = 1 << 16; //Output buffer, also the most data an IDAT chunk gets
+static const size_t BAND_SIZE = 1 << 20; //Filtered bytes per band when encoding PNGs in parallel
+
+static int openFile(const char* path) {
+#ifdef _WIN32
+	return _open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+	return ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+}
+
+static void closeFile(int fd) {
+#ifdef _WIN32
+	_close(fd);
+#else
+	::close(fd);
+#endif
+}
+
+static bool writeAll(int fd, const uint8_t* data, size_t length) {
+	while (length > 0) {
+#ifdef _WIN32
+		int written = _write(fd, data, (unsigned int)std::min(length, (size_t)1 << 30));
+#else
+		ssize_t written = ::write(fd, data, length);
+		if (written < 0 && errno == EINTR)
+			continue;
+#endif
+		if (written <= 0)
+			return false;
+		data += written;
+		length -= (size_t)written;
+	}
+	return true;
+}
+
+static inline void putLE16(std::vector<uint8_t>& out, uint32_t value) {
+	out.push_back((uint8_t)value);
+	out.push_back((uint8_t)(value >> 8));
+}
+static inline void putLE32(std::vector<uint8_t>& out, uint32_t value) {
+	putLE16(out, value & 0xFFFF);
+	putLE16(out, value >> 16);
+}
+static inline void putBE32(std::vector<uint8_t>& out, uint32_t value) {
+	for (int shift = 24; shift >= 0; shift -= 8)
+		out.push_back((uint8_t)(value >> shift));
+}
+
+//PNG's Paeth predictor: whichever of left, up and up left is closest to left + up - up left
+static inline int paeth(int a, int b, int c) {
+	int p = a + b - c;
+	int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+	if (pa <= pb && pa <= pc)
+		return a;
+	return pb <= pc ? b : c;
+}
+
+//Filters a PNG row against the one above it (zeros for the first), returning the filter byte and the row
+//in filtered. Rows to be stored uncompressed aren't filtered, the others get every filter and keep the one
+//whose differences add up smallest (libpng's heuristic). filtered holds 5 rows of rowBytes + 1
+static const uint8_t* filterRow(const uint8_t* cur, const uint8_t* up, size_t rowBytes, int channels, int compression, uint8_t* filtered) {
+	if (compression <= 0) {
+		filtered[0] = 0;
+		std::copy(cur, cur + rowBytes, filtered + 1);
+		return filtered;
+	}
+
+	uint8_t* out[5];
+	for (int f = 0; f < 5; f++) {
+		out[f] = filtered + (f * (rowBytes + 1));
+		*out[f]++ = (uint8_t)f;
+	}
+	uint32_t sums[5] = {};
+	for (size_t i = 0; i < rowBytes; i++) {
+		int a = i >= (size_t)channels ? cur[i - channels] : 0;
+		int b = up[i];
+		int c = i >= (size_t)channels ? up[i - channels] : 0;
+		int x = cur[i];
+		uint8_t values[5] = { (uint8_t)x, (uint8_t)(x - a), (uint8_t)(x - b), (uint8_t)(x - ((a + b) >> 1)), (uint8_t)(x - paeth(a, b, c)) };
+		for (int f = 0; f < 5; f++) {
+			out[f][i] = values[f];
+			sums[f] += (uint32_t)abs((int8_t)values[f]);
+		}
+	}
+	int pick = 0;
+	for (int f = 1; f < 5; f++) {
+		if (sums[f] < sums[pick])
+			pick = f;
+	}
+	return filtered + (pick * (rowBytes + 1));
+}
+
+ImageWriter::ImageWriter() {
+	this->format = IMAGE_BMP;
+}
+
+ImageWriter::~ImageWriter() {
+	if (fd >= 0)
+		flushBuffer();
+	release();
+}
+
+ImageFormat ImageWriter::formatFromPath(const std::string& path) {
+	size_t dot = path.find_last_of('.');
+	std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+	for (char& c : extension)
+		c = (char)tolower((unsigned char)c);
+	if (extension == "png")
+		return IMAGE_PNG;
+	if (extension == "pgm" || extension == "ppm" || extension == "pnm")
+		return IMAGE_PNM;
+	return IMAGE_BMP;
+}
+
+const char* ImageWriter::getExtension(ImageFormat format, int channels) {
+	switch (format) {
+	case IMAGE_PNM:
+		return channels == 1 ? ".pgm" : ".ppm";
+	case IMAGE_PNG:
+		return ".png";
+	default:
+		return ".bmp";
+	}
+}
+
+bool ImageWriter::open(const std::string& path, ImageFormat format, int width, int height, int channels) {
+	release();
+	error.clear();
+	if (path == "-") {
+		//Anything printed so far goes out before the image
+		fflush(stdout);
+#ifdef _WIN32
+		_setmode(_fileno(stdout), _O_BINARY);
+		this->fd = _fileno(stdout);
+#else
+		this->fd = fileno(stdout);
+#endif
+		this->ownsFd = false;
+	} else {
+		this->fd = openFile(path.c_str());
+		this->ownsFd = true;
+		if (this->fd < 0)
+			return fail("Couldn't create " + path);
+	}
+	return begin(format, width, height, channels);
+}
+
+bool ImageWriter::open(int fd, ImageFormat format, int width, int height, int channels) {
+	release();
+	error.clear();
+	this->fd = fd;
+	this->ownsFd = false;
+	return begin(format, width, height, channels);
+}
+
+bool ImageWriter::begin(ImageFormat format, int width, int height, int channels) {
+	this->format = format;
+	this->width = width;
+	this->height = height;
+	this->channels = channels;
+	this->rowsWritten = 0;
+	this->bytesWritten = 0;
+	if (width <= 0 || height <= 0)
+		return fail("Images need at least one pixel");
+	if (channels != 1 && channels != 3)
+		return fail("Images are gray (1 channel) or RGB (3 channels)");
+
+	size_t rowBytes = (size_t)width * channels;
+	this->buffer.clear();
+	this->buffer.reserve(BUFFER_SIZE);
+	this->row.assign(rowBytes, 0);
+
+	std::vector<uint8_t> header;
+	if (format == IMAGE_BMP) {
+		uint32_t stride = (uint32_t)((rowBytes + 3) & ~(size_t)3);
+		uint32_t palette = channels == 1 ? 256 : 0;
+		uint32_t offset = 14 + 40 + (palette * 4);
+		uint64_t imageBytes = (uint64_t)stride * height;
+		if (imageBytes > 0xFFFFFFFFULL - offset)
+			return fail("Image too large for a BMP");
+
+		header.push_back('B');
+		header.push_back('M');
+		putLE32(header, offset + (uint32_t)imageBytes);
+		putLE32(header, 0);
+		putLE32(header, offset);
+		putLE32(header, 40);
+		putLE32(header, (uint32_t)width);
+		putLE32(header, (uint32_t)-height); //Negative for top down rows
+		putLE16(header, 1);
+		putLE16(header, channels * 8);
+		putLE32(header, 0); //Uncompressed
+		putLE32(header, (uint32_t)imageBytes);
+		putLE32(header, 2835); //72 DPI
+		putLE32(header, 2835);
+		putLE32(header, palette);
+		putLE32(header, 0);
+		for (uint32_t i = 0; i < palette; i++)
+			putLE32(header, i * 0x010101);
+		this->converted.assign(stride, 0);
+	} else if (format == IMAGE_PNM) {
+		char text[64];
+		snprintf(text, sizeof(text), "P%d\n%d %d\n255\n", channels == 1 ? 5 : 6, width, height);
+		header.insert(header.end(), text, text + strlen(text));
+	} else {
+		static const uint8_t SIGNATURE[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+		if (!put(SIGNATURE, 8))
+			return false;
+		std::vector<uint8_t> info;
+		putBE32(info, (uint32_t)width);
+		putBE32(info, (uint32_t)height);
+		info.push_back(8); //Bits per channel
+		info.push_back(channels == 1 ? 0 : 2); //Gray or RGB
+		info.push_back(0);
+		info.push_back(0);
+		info.push_back(0);
+		if (!putChunk("IHDR", info.data(), info.size()))
+			return false;
+
+		//zlib header: deflate with a 32 KB window, the level hint, and the check bits
+		int level = std::max(0, std::min(compression, 9));
+		uint32_t flags = (uint32_t)(level < 2 ? 0 : (level < 6 ? 1 : (level == 6 ? 2 : 3))) << 6;
+		flags += 31 - (((0x78 << 8) | flags) % 31);
+		this->chunk.clear();
+		this->chunk.reserve(BUFFER_SIZE + 8);
+		this->chunk.push_back(0x78);
+		this->chunk.push_back((uint8_t)flags);
+		this->adler = 1;
+		this->previous.assign(rowBytes, 0);
+		this->filtered.assign(5 * (rowBytes + 1), 0);
+		this->deflater.reset(new Deflater(level, [this](const uint8_t* data, size_t length) {
+			return addCompressed(data, length);
+		}));
+	}
+	return put(header.data(), header.size());
+}
+
+bool ImageWriter::writeRow() {
+	if (fd < 0)
+		return error.empty() ? fail("No image open") : false;
+	if (rowsWritten >= height)
+		return fail("More rows than the image has");
+	rowsWritten++;
+
+	if (format == IMAGE_BMP) {
+		if (channels == 3) {
+			for (int x = 0; x < width; x++) {
+				converted[(x * 3)] = row[(x * 3) + 2];
+				converted[(x * 3) + 1] = row[(x * 3) + 1];
+				converted[(x * 3) + 2] = row[(x * 3)];
+			}
+		} else
+			std::copy(row.begin(), row.end(), converted.begin());
+		return put(converted.data(), converted.size());
+	}
+	if (format == IMAGE_PNM)
+		return put(row.data(), row.size());
+	return writePngRow();
+}
+
+bool ImageWriter::writeRows(const RowSource& source, int threads) {
+	if (fd < 0)
+		return error.empty() ? fail("No image open") : false;
+
+	//Only a PNG not started yet can be split up, the rest go a row at a time
+	if (format != IMAGE_PNG || rowsWritten > 0 || threads <= 1) {
+		while (rowsWritten < height) {
+			source(rowsWritten, row.data());
+			if (!writeRow())
+				return false;
+		}
+		return true;
+	}
+
+	size_t rowBytes = row.size();
+	int bandRows = (int)std::max((size_t)1, BAND_SIZE / (rowBytes + 1));
+	int bands = (height + bandRows - 1) / bandRows;
+	int level = std::max(0, std::min(compression, 9));
+	std::vector<std::vector<uint8_t> > outputs(threads);
+	std::vector<uint32_t> adlers(threads);
+
+	for (int first = 0; first < bands; first += threads) {
+		int count = std::min(threads, bands - first);
+		parallelFor(0, count, threads, [&](int b0, int b1) {
+			std::vector<uint8_t> current(rowBytes), above(rowBytes), filteredRows(5 * (rowBytes + 1));
+			for (int b = b0; b < b1; b++) {
+				int y0 = (first + b) * bandRows, y1 = std::min(height, y0 + bandRows);
+				std::vector<uint8_t>& out = outputs[b];
+				out.clear();
+				Deflater band(level, [&out](const uint8_t* data, size_t length) {
+					out.insert(out.end(), data, data + length);
+					return true;
+				});
+
+				//The filters need the row above the band too
+				std::fill(above.begin(), above.end(), (uint8_t)0);
+				if (y0 > 0)
+					source(y0 - 1, above.data());
+				uint32_t bandAdler = 1;
+				for (int y = y0; y < y1; y++) {
+					source(y, current.data());
+					const uint8_t* best = filterRow(current.data(), above.data(), rowBytes, channels, level, filteredRows.data());
+					bandAdler = adler32(bandAdler, best, rowBytes + 1);
+					band.write(best, rowBytes + 1);
+					std::swap(current, above);
+				}
+				if (y1 == height)
+					band.finish();
+				else
+					band.flush();
+				adlers[b] = bandAdler;
+			}
+		});
+
+		for (int b = 0; b < count; b++) {
+			int y0 = (first + b) * bandRows, y1 = std::min(height, y0 + bandRows);
+			adler = adler32Combine(adler, adlers[b], (uint64_t)(y1 - y0) * (rowBytes + 1));
+			if (!addCompressed(outputs[b].data(), outputs[b].size()))
+				return false;
+		}
+	}
+
+	//The last band ended the stream
+	deflater.reset();
+	rowsWritten = height;
+	return true;
+}
+
+bool ImageWriter::close() {
+	if (fd < 0)
+		return error.empty() ? fail("No image open") : false;
+	if (rowsWritten < height)
+		return fail("Image closed after " + std::to_string(rowsWritten) + " of " + std::to_string(height) + " rows");
+
+	if (format == IMAGE_PNG) {
+		if (deflater && !deflater->finish())
+			return false;
+		deflater.reset();
+		putBE32(chunk, adler);
+		if (!putChunk("IDAT", chunk.data(), chunk.size()) || !putChunk("IEND", NULL, 0))
+			return false;
+		chunk.clear();
+	}
+	if (!flushBuffer())
+		return false;
+	release();
+	return true;
+}
+
+bool ImageWriter::put(const void* data, size_t length) {
+	if (fd < 0)
+		return false;
+	if (buffer.size() + length > BUFFER_SIZE && !flushBuffer())
+		return false;
+	const uint8_t* bytes = (const uint8_t*)data;
+	//Too big to be worth buffering
+	bytesWritten += length;
+	if (length >= BUFFER_SIZE)
+		return writeAll(fd, bytes, length) || fail("Couldn't write the image");
+	buffer.insert(buffer.end(), bytes, bytes + length);
+	return true;
+}
+
+bool ImageWriter::flushBuffer() {
+	if (fd < 0)
+		return false;
+	bool written = writeAll(fd, buffer.data(), buffer.size());
+	buffer.clear();
+	return written || fail("Couldn't write the image");
+}
+
+//Keeps the first error and stops writing. The Deflater stays until the next open, since this can be
+//called from inside its output
+bool ImageWriter::fail(const std::string& message) {
+	if (error.empty())
+		error = message;
+	release();
+	return false;
+}
+
+void ImageWriter::release() {
+	if (ownsFd && fd >= 0)
+		closeFile(fd);
+	fd = -1;
+	ownsFd = false;
+}
+
+bool ImageWriter::putChunk(const char* type, const uint8_t* data, size_t length) {
+	std::vector<uint8_t> header;
+	putBE32(header, (uint32_t)length);
+	header.insert(header.end(), type, type + 4);
+	uint32_t crc = crc32(crc32(0, (const uint8_t*)type, 4), data, length);
+	std::vector<uint8_t> footer;
+	putBE32(footer, crc);
+	return put(header.data(), header.size()) && put(data, length) && put(footer.data(), footer.size());
+}
+
+//Deflater output, gathered into IDAT chunks of BUFFER_SIZE
+bool ImageWriter::addCompressed(const uint8_t* data, size_t length) {
+	while (length > 0) {
+		size_t n = std::min(length, BUFFER_SIZE - chunk.size());
+		chunk.insert(chunk.end(), data, data + n);
+		data += n;
+		length -= n;
+		if (chunk.size() == BUFFER_SIZE) {
+			if (!putChunk("IDAT", chunk.data(), chunk.size()))
+				return false;
+			chunk.clear();
+		}
+	}
+	return true;
+}
+
+bool ImageWriter::writePngRow() {
+	size_t rowBytes = row.size();
+	const uint8_t* best = filterRow(row.data(), previous.data(), rowBytes, channels, compression, filtered.data());
+	adler = adler32(adler, best, rowBytes + 1);
+	std::copy(row.begin(), row.end(), previous.begin());
+	return deflater->write(best, rowBytes + 1) && fd >= 0;
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include "WGDeflate.h"
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+namespace WG {
+	enum ImageFormat {
+		IMAGE_BMP,
+		IMAGE_PNM, //PGM for gray images, PPM for color
+		IMAGE_PNG
+	};
+
+	//Fills in row y of an image, width * channels bytes. ImageWriter::writeRows calls it from several threads at once
+	typedef std::function<void(int y, uint8_t* row)> RowSource;
+
+	//Writes an image a row at a time, so exporting a layer takes a row of memory instead of the whole image.
+	//Rows go top first, gray (1 channel) or RGB (3 channels) bytes, and are converted to the format on the
+	//way out: BGR rows padded to 4 bytes stored top down for BMP (gray as 8 bit with a gray palette), plain
+	//rows for PGM/PPM, and for PNG each row filtered (the filter adding up to the smallest differences) and
+	//deflated through a Deflater, level 0 storing them uncompressed.
+	//Output goes through a 64 KB buffer straight to a file descriptor, "-" being stdout.
+	//
+	//writeRows encodes PNGs in parallel: the rows are cut into bands of about 1 MB, and each thread filters and
+	//deflates a band of its own into memory as a separate deflate stream ending in a sync flush (so it starts
+	//byte aligned with an empty dictionary and the streams simply follow each other). The bands are written in
+	//order a round of threads at a time, their Adler-32s combined, so memory stays a band per thread.
+	//Compression is a fraction of a percent worse than a single stream.
+	//
+	//Every call returns false once something fails, getError saying what.
+	class ImageWriter {
+	public:
+		ImageWriter();
+		~ImageWriter(); //Closes the output, an unfinished image is left cut off
+
+		//Format from the path's extension (.bmp, .pgm, .ppm, .pnm or .png), BMP when it's none of those
+		static ImageFormat formatFromPath(const std::string& path);
+		static const char* getExtension(ImageFormat format, int channels);
+
+		//PNG compression level from 0 (stored) to 9, 6 by default. Set before open
+		inline void setCompression(int level) { this->compression = level; }
+
+		bool open(const std::string& path, ImageFormat format, int width, int height, int channels);
+		//Writes to an already open descriptor, left open afterwards
+		bool open(int fd, ImageFormat format, int width, int height, int channels);
+
+		//Row to fill in next, width * channels bytes
+		inline uint8_t* getRow() { return row.data(); }
+		bool writeRow();
+		//Writes all the rows left, source called once per row (and again for the row before each PNG band)
+		bool writeRows(const RowSource& source, int threads);
+		//Finishes the image once every row is in
+		bool close();
+
+		inline const std::string& getError() const { return error; }
+		inline uint64_t getBytesWritten() const { return bytesWritten; }
+	private:
+		ImageFormat format;
+		int width = 0, height = 0, channels = 0;
+		int compression = 6;
+		int rowsWritten = 0;
+
+		int fd = -1;
+		bool ownsFd = false;
+		std::vector<uint8_t> buffer;
+		uint64_t bytesWritten = 0;
+		std::string error;
+
+		std::vector<uint8_t> row; //What the caller fills in
+		std::vector<uint8_t> converted; //Row in the file's layout, BMP only
+		std::vector<uint8_t> previous; //Last row as it was, for the PNG filters
+		std::vector<uint8_t> filtered; //Every PNG filter's row, filter byte first
+		std::unique_ptr<Deflater> deflater;
+		uint32_t adler = 1;
+		std::vector<uint8_t> chunk; //IDAT data not written yet
+
+		bool begin(ImageFormat format, int width, int height, int channels);
+		bool put(const void* data, size_t length);
+		bool flushBuffer();
+		bool fail(const std::string& message);
+		void release();
+
+		bool putChunk(const char* type, const uint8_t* data, size_t length);
+		bool addCompressed(const uint8_t* data, size_t length);
+		bool writePngRow();
+	};
+}
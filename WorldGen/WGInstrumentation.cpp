@@ -0,0 +1,76 @@
+#include "WGInstrumentation.h"
+
+using namespace WG;
+
+const char* WG::getStageName(GeneratorStage stage) {
+	static const char* names[STAGE_COUNT] = {
+		"Height", "Thermal erosion", "Height modifier", "Saltwater", "Moisture",
+		"Hydraulic erosion", "Freshwater", "Drainage basins", "Temperature", "Biomes", "Biome filter", "Biome index", "Biome regions"
+	};
+	return (stage >= 0 && stage < STAGE_COUNT) ? names[stage] : "Unknown";
+}
+
+const char* WG::getCounterName(GeneratorCounter counter) {
+	static const char* names[COUNTER_COUNT] = { "Cells changed", "Buckets filled", "Rivers seeded" };
+	return (counter >= 0 && counter < COUNTER_COUNT) ? names[counter] : "Unknown";
+}
+
+BufferedLogSink::BufferedLogSink(std::ostream& out, size_t capacity) : out(out) {
+	this->capacity = capacity;
+	buffer.reserve(capacity);
+}
+
+BufferedLogSink::~BufferedLogSink() {
+	flush();
+}
+
+void BufferedLogSink::write(const std::string& line) {
+	std::lock_guard<std::mutex> guard(lock);
+	buffer += line;
+	buffer += '\n';
+	if (buffer.size() >= capacity) {
+		out.write(buffer.data(), buffer.size());
+		buffer.clear();
+	}
+}
+
+void BufferedLogSink::flush() {
+	std::lock_guard<std::mutex> guard(lock);
+	if (!buffer.empty()) {
+		out.write(buffer.data(), buffer.size());
+		buffer.clear();
+	}
+	out.flush();
+}
+
+Instrumentation::Instrumentation() : defaultSink(std::cout) {
+	this->sink = &defaultSink;
+	resetCounters();
+}
+
+void Instrumentation::setLogSink(LogSink* sink) {
+	if (this->sink != NULL)
+		this->sink->flush();
+	this->sink = sink;
+}
+
+void Instrumentation::beginStage(GeneratorStage stage) {
+	stageStart[stage] = std::chrono::high_resolution_clock::now();
+	progress(stage, 0.0f);
+}
+
+void Instrumentation::progress(GeneratorStage stage, float done) {
+	if (callback)
+		callback(stage, done);
+}
+
+void Instrumentation::endStage(GeneratorStage stage) {
+	progress(stage, 1.0f);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - stageStart[stage]).count();
+	log() << getStageName(stage) << " done in " << ms << " ms";
+}
+
+void Instrumentation::resetCounters() {
+	for (int i = 0; i < COUNTER_COUNT; i++)
+		counters[i].store(0, std::memory_order_relaxed);
+}
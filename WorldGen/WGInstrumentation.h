@@ -0,0 +1,118 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+namespace WG {
+	//Generator stages, in the order generate() runs them
+	enum GeneratorStage {
+		STAGE_HEIGHT,
+		STAGE_THERMAL_EROSION,
+		STAGE_HEIGHT_MODIFIER,
+		STAGE_SALTWATER,
+		STAGE_MOISTURE,
+		STAGE_HYDRAULIC_EROSION,
+		STAGE_FRESHWATER,
+		STAGE_DRAINAGE_BASINS,
+		STAGE_TEMPERATURE,
+		STAGE_BIOMES,
+		STAGE_BIOME_FILTER,
+		STAGE_BIOME_INDEX,
+		STAGE_BIOME_REGIONS,
+		STAGE_COUNT
+	};
+
+	//Things the stages count while they run
+	enum GeneratorCounter {
+		COUNTER_CELLS_CHANGED, //Height writes made by thermal erosion
+		COUNTER_BUCKETS_FILLED, //Cells the grid hydraulic erosion left holding water
+		COUNTER_RIVERS_SEEDED, //River sources (river cells nothing flows into) found by the freshwater stage
+		COUNTER_COUNT
+	};
+
+	const char* getStageName(GeneratorStage stage);
+	const char* getCounterName(GeneratorCounter counter);
+
+	//Where log lines end up. write() can be called from any thread
+	class LogSink {
+	public:
+		virtual ~LogSink() {}
+		virtual void write(const std::string& line) = 0;
+		virtual void flush() {}
+	};
+
+	//Collects lines in memory and only writes them out to the stream when the buffer fills up,
+	//flush() is called or the sink goes away
+	class BufferedLogSink : public LogSink {
+	public:
+		BufferedLogSink(std::ostream& out, size_t capacity = 16384);
+		~BufferedLogSink();
+
+		void write(const std::string& line);
+		void flush();
+	private:
+		std::ostream& out;
+		size_t capacity;
+		std::string buffer;
+		std::mutex lock;
+	};
+
+	//Called with the stage and how far along it is (0...1)
+	typedef std::function<void(GeneratorStage stage, float progress)> ProgressCallback;
+
+	//Logging, progress reporting and counters for one Generator.
+	//Stages report progress per iteration or per stage, never per cell, and add to the
+	//counters once per pass with a local total, so none of this shows up in the inner loops.
+	class Instrumentation {
+	public:
+		Instrumentation();
+
+		//Replaces the default (buffered std::cout) sink. The sink isn't owned, NULL silences the log
+		void setLogSink(LogSink* sink);
+		inline LogSink* getLogSink() { return this->sink; }
+
+		inline void setProgressCallback(ProgressCallback callback) { this->callback = callback; }
+
+		//Reports progress 0, remembers the start time
+		void beginStage(GeneratorStage stage);
+		void progress(GeneratorStage stage, float done);
+		//Reports progress 1 and logs how long the stage took
+		void endStage(GeneratorStage stage);
+
+		inline void count(GeneratorCounter counter, int64_t amount) { counters[counter].fetch_add(amount, std::memory_order_relaxed); }
+		inline int64_t getCount(GeneratorCounter counter) { return counters[counter].load(std::memory_order_relaxed); }
+		void resetCounters();
+
+		//Builds up one line with << and hands it to the sink when it goes out of scope.
+		//With no sink nothing gets formatted
+		class Line {
+		public:
+			Line(LogSink* sink) : sink(sink) {}
+			Line(Line&& other) : sink(other.sink), text(std::move(other.text)) { other.sink = NULL; }
+			~Line() { if (sink != NULL) sink->write(text.str()); }
+
+			template<typename T>
+			Line& operator<<(const T& value) {
+				if (sink != NULL)
+					text << value;
+				return *this;
+			}
+		private:
+			LogSink* sink;
+			std::ostringstream text;
+		};
+
+		inline Line log() { return Line(sink); }
+	private:
+		BufferedLogSink defaultSink;
+		LogSink* sink;
+		ProgressCallback callback;
+		std::atomic<int64_t> counters[COUNTER_COUNT];
+		std::chrono::high_resolution_clock::time_point stageStart[STAGE_COUNT];
+	};
+}
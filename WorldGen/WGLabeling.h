@@ -0,0 +1,176 @@
+#pragma once
+#include "WGParallel.h"
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+namespace WG {
+	const int32_t NO_COMPONENT = -1; //Label of cells that aren't part of any component
+
+	//Size and position of one connected component
+	struct ComponentStats {
+		int64_t area = 0; //Cells
+		int minX = 0, minY = 0, maxX = -1, maxY = -1; //Bounding box, inclusive
+		double sumX = 0.0, sumY = 0.0; //Sum of the cell positions, divide by area for the centroid
+		bool touchesBorder = false;
+
+		inline float getCentroidX() const { return area > 0 ? (float)(sumX / area) : 0.0f; }
+		inline float getCentroidY() const { return area > 0 ? (float)(sumY / area) : 0.0f; }
+	};
+
+	//Connected component labeling (4 neighbors) of a square map stored x * size + y.
+	//
+	//The map is cut into tiles that are labeled on their own threads with union-find, every tile only
+	//ever touching its own cells. The tile seams are then merged in one serial pass, and a last pass in
+	//index order turns the union-find roots into component numbers and adds up the stats.
+	//A root is always the lowest index in its component, so components are numbered in the order
+	//a plain scan would find them and the result doesn't depend on the thread count.
+	class ComponentLabeling {
+	public:
+		std::vector<int32_t> labels; //Component of every cell, NO_COMPONENT for cells left out
+		std::vector<ComponentStats> components;
+
+		inline int32_t getComponentCount() const { return (int32_t)components.size(); }
+		inline int32_t getLabel(int x, int y, int size) const { return labels[x * size + y]; }
+
+		//include(i) says if cell i takes part, connected(a, b) if two neighboring included cells belong together
+		template<typename Include, typename Connected>
+		void run(int size, int threads, Include include, Connected connected);
+	private:
+		static const int TILE_SIZE = 128;
+
+		static inline int32_t findRoot(int32_t* parent, int32_t i) {
+			while (parent[i] != i) {
+				parent[i] = parent[parent[i]]; //Path halving
+				i = parent[i];
+			}
+			return i;
+		}
+
+		//Same as findRoot without writing, so it can run on many threads at once
+		static inline int32_t peekRoot(const int32_t* parent, int32_t i) {
+			while (parent[i] != i)
+				i = parent[i];
+			return i;
+		}
+
+		//The lower root always wins, which keeps every root at its component's lowest index
+		static inline void unite(int32_t* parent, int32_t a, int32_t b) {
+			a = findRoot(parent, a);
+			b = findRoot(parent, b);
+			if (a < b)
+				parent[b] = a;
+			else if (b < a)
+				parent[a] = b;
+		}
+	};
+
+	template<typename Include, typename Connected>
+	void ComponentLabeling::run(int size, int threads, Include include, Connected connected) {
+		int cells = size * size;
+		int tiles = (size + TILE_SIZE - 1) / TILE_SIZE;
+		std::vector<int32_t> forest(cells);
+		int32_t* parent = forest.data();
+
+		//Label every tile on its own
+		parallelFor(0, tiles * tiles, threads, [&](int t0, int t1) {
+			for (int t = t0; t < t1; t++) {
+				int x0 = (t / tiles) * TILE_SIZE, y0 = (t % tiles) * TILE_SIZE;
+				int x1 = std::min(x0 + TILE_SIZE, size), y1 = std::min(y0 + TILE_SIZE, size);
+				for (int x = x0; x < x1; x++) {
+					for (int y = y0; y < y1; y++) {
+						int32_t i = x * size + y;
+						if (!include(i)) {
+							parent[i] = NO_COMPONENT;
+							continue;
+						}
+						//Joining the neighbors' sets by pointing at them, only a real union when those two differ
+						bool up = x > x0 && parent[i - size] != NO_COMPONENT && connected(i - size, i);
+						bool left = y > y0 && parent[i - 1] != NO_COMPONENT && connected(i - 1, i);
+						parent[i] = left ? parent[i - 1] : (up ? parent[i - size] : i);
+						if (up && left && parent[i - size] != parent[i - 1])
+							unite(parent, i - size, i - 1);
+					}
+				}
+			}
+		});
+
+		//Stitch the tiles together across their seams
+		for (int x = TILE_SIZE; x < size; x += TILE_SIZE) {
+			for (int y = 0; y < size; y++) {
+				int32_t i = x * size + y;
+				if (parent[i] != NO_COMPONENT && parent[i - size] != NO_COMPONENT && connected(i - size, i))
+					unite(parent, i - size, i);
+			}
+		}
+		for (int y = TILE_SIZE; y < size; y += TILE_SIZE) {
+			for (int x = 0; x < size; x++) {
+				int32_t i = x * size + y;
+				if (parent[i] != NO_COMPONENT && parent[i - 1] != NO_COMPONENT && connected(i - 1, i))
+					unite(parent, i - 1, i);
+			}
+		}
+
+		//Point every cell straight at its root. A cell pointing where its row neighbor points, or at the
+		//neighbor itself, shares its root
+		labels.resize(cells);
+		parallelFor(0, size, threads, [&](int x0, int x1) {
+			for (int x = x0; x < x1; x++) {
+				for (int32_t i = x * size; i < (x + 1) * size; i++) {
+					int32_t p = parent[i];
+					if (p == NO_COMPONENT)
+						labels[i] = NO_COMPONENT;
+					else if (i > x * size && (p == i - 1 || p == parent[i - 1]))
+						labels[i] = labels[i - 1];
+					else
+						labels[i] = peekRoot(parent, i);
+				}
+			}
+		});
+
+		//Number the roots in index order, a run of a row with the same root at a time. A root comes before
+		//the rest of its component (always at the start of a run), so its number is always ready by the time
+		//the other cells look it up
+		components.clear();
+		for (int x = 0; x < size; x++) {
+			int32_t* row = labels.data() + (x * size);
+			for (int y = 0; y < size; ) {
+				int32_t root = row[y];
+				int end = y + 1;
+				while (end < size && row[end] == root)
+					end++;
+				if (root == NO_COMPONENT) {
+					y = end;
+					continue;
+				}
+
+				int32_t i = x * size + y;
+				if (root == i) {
+					parent[i] = (int32_t)components.size();
+					components.push_back(ComponentStats());
+					components.back().minX = x;
+					components.back().minY = y;
+					components.back().maxX = x;
+					components.back().maxY = y;
+				}
+
+				int32_t id = parent[root];
+				std::fill(row + y, row + end, id);
+
+				ComponentStats& stats = components[id];
+				int64_t length = end - y;
+				stats.area += length;
+				stats.minX = std::min(stats.minX, x);
+				stats.minY = std::min(stats.minY, y);
+				stats.maxX = std::max(stats.maxX, x);
+				stats.maxY = std::max(stats.maxY, end - 1);
+				stats.sumX += (double)x * length;
+				stats.sumY += (double)(y + end - 1) * length * 0.5;
+				if (x == 0 || y == 0 || x == size - 1 || end == size)
+					stats.touchesBorder = true;
+				y = end;
+			}
+		}
+	}
+}
@@ -0,0 +1,249 @@
+#include "WGModeFilter.h"
+#include "WGParallel.h"
+#include "WGSimd.h"
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+using namespace WG;
+
+//What a column holds over the window's rows when it isn't a single category, see modeFilter
+static const uint8_t MIXED = 255;
+static const uint8_t IGNORED = 254; //Only ignored cells
+
+//window += column (sign 1) or window -= column (sign -1), over a multiple of 8 counts
+static inline void addCounts(uint16_t* window, const uint16_t* column, int stride, int sign) {
+	int k = 0;
+#ifdef WG_SIMD_SSE2
+	for (; k < stride; k += 8) {
+		__m128i w = _mm_loadu_si128((const __m128i*)(window + k));
+		__m128i c = _mm_loadu_si128((const __m128i*)(column + k));
+		_mm_storeu_si128((__m128i*)(window + k), sign > 0 ? _mm_add_epi16(w, c) : _mm_sub_epi16(w, c));
+	}
+#endif
+	for (; k < stride; k++)
+		window[k] = (uint16_t)(sign > 0 ? window[k] + column[k] : window[k] - column[k]);
+}
+
+//What one row of the filter needs: the column counts, which count is which category and where the total is
+struct ModeRow {
+	const uint16_t* columns;
+	int stride, count, total, radius, size;
+	const int16_t* dense;
+	const uint8_t* category;
+
+	//Category for a cell given its window counts
+	inline uint8_t pick(uint8_t value, const uint16_t* window) const {
+		int own = dense[value];
+		//Most cells already hold over half their window, nothing can beat that
+		if (own < 0 || window[own] * 2 > window[total])
+			return value;
+		int best = own;
+		for (int k = 0; k < count; k++) {
+			if (window[k] > window[best])
+				best = k;
+		}
+		return category[best];
+	}
+
+	//Slides the window along the cells y0...y1 of a row, starting it from scratch at y0. With Vectors > 0 the counts
+	//stay in that many SSE registers (stride is 8 * Vectors) instead of going through memory every cell, 0 handles any stride
+	template<int Vectors>
+	void run(const uint8_t* row, uint8_t* out, uint16_t* window, int y0, int y1) const {
+		std::fill(window, window + stride, (uint16_t)0);
+		for (int y = std::max(y0 - radius, 0); y <= std::min(y0 + radius, size - 1); y++)
+			addCounts(window, columns + (y * stride), stride, 1);
+
+#ifdef WG_SIMD_SSE2
+		if (Vectors > 0) {
+			__m128i counts[Vectors > 0 ? Vectors : 1];
+			for (int v = 0; v < Vectors; v++)
+				counts[v] = _mm_loadu_si128((const __m128i*)(window + (v * 8)));
+			for (int y = y0; y <= y1; y++) {
+				if (y > y0 && y + radius < size) {
+					const uint16_t* column = columns + ((y + radius) * stride);
+					for (int v = 0; v < Vectors; v++)
+						counts[v] = _mm_add_epi16(counts[v], _mm_loadu_si128((const __m128i*)(column + (v * 8))));
+				}
+				if (y > y0 && y - radius - 1 >= 0) {
+					const uint16_t* column = columns + ((y - radius - 1) * stride);
+					for (int v = 0; v < Vectors; v++)
+						counts[v] = _mm_sub_epi16(counts[v], _mm_loadu_si128((const __m128i*)(column + (v * 8))));
+				}
+				for (int v = 0; v < Vectors; v++)
+					_mm_storeu_si128((__m128i*)(window + (v * 8)), counts[v]);
+				out[y] = pick(row[y], window);
+			}
+			return;
+		}
+#endif
+		for (int y = y0; y <= y1; y++) {
+			if (y > y0 && y + radius < size)
+				addCounts(window, columns + ((y + radius) * stride), stride, 1);
+			if (y > y0 && y - radius - 1 >= 0)
+				addCounts(window, columns + ((y - radius - 1) * stride), stride, -1);
+			out[y] = pick(row[y], window);
+		}
+	}
+
+	inline void run(const uint8_t* row, uint8_t* out, uint16_t* window, int y0, int y1) const {
+		if (stride == 8)
+			run<1>(row, out, window, y0, y1);
+		else if (stride == 16)
+			run<2>(row, out, window, y0, y1);
+		else
+			run<0>(row, out, window, y0, y1);
+	}
+};
+
+void WG::modeFilter(ByteData* data, int radius, int ignore, int threads) {
+	int size = data->size;
+	radius = std::min(radius, 127);
+	if (radius <= 0 || size <= 1)
+		return;
+
+	//Only the categories on the map get a count
+	threads = std::max(1, std::min(threads, size));
+	std::vector<uint8_t> seen(threads * 256, 0);
+	parallelFor(0, threads, threads, [&](int t0, int t1) {
+		for (int t = t0; t < t1; t++) {
+			int64_t i0 = ((int64_t)size * size * t) / threads, i1 = ((int64_t)size * size * (t + 1)) / threads;
+			for (int64_t i = i0; i < i1;) {
+				//Categories come in long runs, skip 8 cells at a time while they hold the one just seen
+				uint8_t last = data->data[i];
+				seen[(t * 256) + last] = 1;
+				uint64_t block, same = last * 0x0101010101010101ull;
+				for (i++; i + 8 <= i1 && (memcpy(&block, data->data + i, 8), block == same); i += 8);
+				for (; i < i1 && data->data[i] == last; i++);
+			}
+		}
+	});
+	int16_t dense[256];
+	uint8_t category[256];
+	int count = 0;
+	for (int v = 0; v < 256; v++) {
+		bool present = false;
+		for (int t = 0; t < threads; t++)
+			present = present || seen[(t * 256) + v] != 0;
+		dense[v] = -1;
+		if (present && v != ignore) {
+			dense[v] = (int16_t)count;
+			category[count++] = (uint8_t)v;
+		}
+	}
+	if (count <= 1)
+		return;
+	//One more count for the cells counted at all, padded to 8 so the count updates run in whole vectors
+	int total = count;
+	int stride = (count + 1 + 7) & ~7;
+
+	std::vector<uint8_t> out(size * size);
+	parallelFor(0, size, threads, [&](int x0, int x1) {
+		std::vector<uint16_t> columns(size * stride, 0); //Counts of every column over the window's rows
+		std::vector<uint16_t> window(stride);
+		std::vector<uint8_t> settled(size); //Category filling all of each column, or MIXED/IGNORED
+
+		//Counts one cell of column y in (sign 1) or out (sign -1)
+		auto addCell = [&](int y, uint8_t value, int sign) {
+			int d = dense[value];
+			if (d >= 0) {
+				columns[(y * stride) + d] += (uint16_t)sign;
+				columns[(y * stride) + total] += (uint16_t)sign;
+			}
+		};
+		auto addRow = [&](int x, int sign) {
+			const uint8_t* row = data->data + (x * size);
+			for (int y = 0; y < size; y++)
+				addCell(y, row[y], sign);
+		};
+		//A column is settled when its cells in the window all hold one category, which is then the one in row x
+		auto settle = [&](int y, uint8_t value, int rows) {
+			int d = dense[value];
+			const uint16_t* column = columns.data() + (y * stride);
+			if (d < 0)
+				settled[y] = column[total] == 0 ? IGNORED : MIXED;
+			else
+				settled[y] = (uint8_t)(d < IGNORED && column[d] == rows ? d : MIXED);
+		};
+		for (int x = std::max(x0 - radius, 0); x <= std::min(x0 + radius, size - 1); x++)
+			addRow(x, 1);
+
+		ModeRow mode;
+		mode.columns = columns.data();
+		mode.stride = stride;
+		mode.count = count;
+		mode.total = total;
+		mode.radius = radius;
+		mode.size = size;
+		mode.dense = dense;
+		mode.category = category;
+
+		for (int x = x0; x < x1; x++) {
+			const uint8_t* row = data->data + (x * size);
+			int rows = std::min(x + radius, size - 1) - std::max(x - radius, 0) + 1;
+			if (x > x0 && x - radius - 1 >= 0 && x + radius < size) {
+				//Only the columns where the rows leaving and entering the window differ change, and across most
+				//of the map they don't. Compare them 8 cells at a time
+				const uint8_t* leaving = data->data + ((x - radius - 1) * size);
+				const uint8_t* entering = data->data + ((x + radius) * size);
+				for (int y = 0; y < size;) {
+					uint64_t a, b;
+					if (y + 8 <= size) {
+						memcpy(&a, leaving + y, 8);
+						memcpy(&b, entering + y, 8);
+						if (a == b) {
+							y += 8;
+							continue;
+						}
+					}
+					for (int end = std::min(y + 8, size); y < end; y++) {
+						if (leaving[y] != entering[y]) {
+							addCell(y, leaving[y], -1);
+							addCell(y, entering[y], 1);
+							settle(y, entering[y], rows);
+						}
+					}
+				}
+			} else {
+				//Near the map edges the window gains or loses whole rows, so every column is looked at again
+				if (x > x0) {
+					if (x - radius - 1 >= 0)
+						addRow(x - radius - 1, -1);
+					if (x + radius < size)
+						addRow(x + radius, 1);
+				}
+				for (int y = 0; y < size; y++)
+					settle(y, row[y], rows);
+			}
+
+			//A cell whose window is all settled columns of its own category keeps it. Those are the insides of the
+			//runs of settled columns, and every cell of a run of ignored ones. So the window only slides over the rest,
+			//and over runs too short to pay for starting it again after them
+			uint8_t* outRow = out.data() + (x * size);
+			int from = 0; //First cell not handled yet
+			for (int a = 0; a < size;) {
+				uint8_t value = settled[a];
+				uint64_t block, same = value * 0x0101010101010101ull;
+				int b = a + 1;
+				for (; b + 8 <= size && (memcpy(&block, &settled[b], 8), block == same); b += 8);
+				for (; b < size && settled[b] == value; b++);
+				b--;
+				int keep0 = a == 0 || value == IGNORED ? a : a + radius;
+				int keep1 = b == size - 1 || value == IGNORED ? b : b - radius;
+				if (value != MIXED && keep1 - keep0 >= radius) {
+					if (keep0 > from)
+						mode.run(row, outRow, window.data(), from, keep0 - 1);
+					std::copy(row + keep0, row + keep1 + 1, outRow + keep0);
+					from = keep1 + 1;
+				}
+				a = b + 1;
+			}
+			if (from < size)
+				mode.run(row, outRow, window.data(), from, size - 1);
+		}
+	});
+
+	std::copy(out.begin(), out.end(), data->data);
+}
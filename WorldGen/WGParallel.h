@@ -0,0 +1,41 @@
+#pragma once
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+namespace WG {
+	//Resolves the thread count setting into an actual number of threads (0 = one per hardware thread)
+	inline int resolveThreadCount(int requested) {
+		if (requested > 0)
+			return requested;
+		int hw = (int)std::thread::hardware_concurrency();
+		return hw > 0 ? hw : 1;
+	}
+
+	//Splits [begin, end) into one contiguous band per thread and runs func(bandBegin, bandEnd) on each.
+	//The calling thread takes the first band itself, so a thread count of 1 never spawns anything.
+	template<typename Func>
+	void parallelFor(int begin, int end, int threads, Func func) {
+		int count = end - begin;
+		if (count <= 0)
+			return;
+
+		threads = std::max(1, std::min(threads, count));
+		if (threads == 1) {
+			func(begin, end);
+			return;
+		}
+
+		std::vector<std::thread> workers;
+		workers.reserve(threads - 1);
+		for (int t = 1; t < threads; t++) {
+			int bandBegin = begin + (int)(((long long)count * t) / threads);
+			int bandEnd = begin + (int)(((long long)count * (t + 1)) / threads);
+			workers.push_back(std::thread(func, bandBegin, bandEnd));
+		}
+		func(begin, begin + (int)(count / threads));
+
+		for (size_t t = 0; t < workers.size(); t++)
+			workers[t].join();
+	}
+}
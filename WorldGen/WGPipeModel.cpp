@@ -0,0 +1,234 @@
+#include "WGPipeModel.h"
+#include "WGParallel.h"
+#include "WGSimd.h"
+
+#include <cmath>
+#include <algorithm>
+
+using namespace WG;
+
+//Model constants, the same values as the research shaders apart from the rain.
+//If you increase time you must increase pipe length and cell area
+static const float T = 0.1f; //Delta time
+static const float L = 1.0f; //Pipe length
+static const float A = 1.0f; //Cell area
+static const float G = 9.81f; //Gravity
+static const float Kc = 0.04f; //Sediment capacity constant
+static const float Ks = 0.04f; //Dissolving constant
+static const float Kd = 0.04f; //Deposition constant
+static const float Ke = 0.01f; //Evaporation constant
+//Rain constant. The shaders use 0.001, but they run every frame for as long as they're left open. At that rate
+//500 steps move the heights by an RMS of 0.0006 here, so rain falls 50x harder to carve channels in a few hundred
+static const float Kr = 0.05f;
+
+//Height of the border cells. Nothing ever flows up into them
+static const float WALL = 1.0e30f;
+
+//New outflow flux per direction, scaled down by K when it would drain more water than the cell has
+struct FluxKernel {
+	const float *land, *sand, *water;
+	float *fluxL, *fluxR, *fluxT, *fluxB;
+	int stride;
+
+	template<typename V>
+	inline void run(int i) {
+		typedef Lanes<V> Ln;
+		const V zero(0.0f), one(1.0f), scale(T * A * G / L);
+
+		V ht = Ln::load(land + i) + Ln::load(sand + i) + Ln::load(water + i);
+		V htL = Ln::load(land + i - stride) + Ln::load(sand + i - stride) + Ln::load(water + i - stride);
+		V htR = Ln::load(land + i + stride) + Ln::load(sand + i + stride) + Ln::load(water + i + stride);
+		V htT = Ln::load(land + i - 1) + Ln::load(sand + i - 1) + Ln::load(water + i - 1);
+		V htB = Ln::load(land + i + 1) + Ln::load(sand + i + 1) + Ln::load(water + i + 1);
+
+		//New flux value is old value + delta time * area * ((gravity * delta ht) / length), never negative
+		V fL = vmax(zero, Ln::load(fluxL + i) + scale * (ht - htL));
+		V fR = vmax(zero, Ln::load(fluxR + i) + scale * (ht - htR));
+		V fT = vmax(zero, Ln::load(fluxT + i) + scale * (ht - htT));
+		V fB = vmax(zero, Ln::load(fluxB + i) + scale * (ht - htB));
+
+		//K keeps the outflow from taking more water then is in the cell
+		V sum = fL + fR + fT + fB;
+		V k = vselect(vgreater(sum, zero), vmin(one, (Ln::load(water + i) * V(L * L)) / (sum * V(T))), one);
+
+		Ln::store(fluxL + i, fL * k);
+		Ln::store(fluxR + i, fR * k);
+		Ln::store(fluxT + i, fT * k);
+		Ln::store(fluxB + i, fB * k);
+	}
+};
+
+//Moves the water by the net flux, rains and evaporates, and works out the velocity field
+struct WaterKernel {
+	const float *fluxL, *fluxR, *fluxT, *fluxB, *rain, *keep;
+	float *water, *velX, *velY;
+	int stride;
+
+	template<typename V>
+	inline void run(int i) {
+		typedef Lanes<V> Ln;
+		const V half(0.5f);
+
+		V fL = Ln::load(fluxL + i), fR = Ln::load(fluxR + i), fT = Ln::load(fluxT + i), fB = Ln::load(fluxB + i);
+
+		//What flows in is the neighbors flux pointing at this cell
+		V inL = Ln::load(fluxR + i - stride), inR = Ln::load(fluxL + i + stride);
+		V inT = Ln::load(fluxB + i - 1), inB = Ln::load(fluxT + i + 1);
+
+		V vol = V(T) * ((inL + inR + inT + inB) - (fL + fR + fT + fB));
+		V wt = Ln::load(water + i) + Ln::load(rain + i) + (vol / V(L * L));
+		wt = wt * V(1.0f - (Ke * T)) * Ln::load(keep + i);
+		Ln::store(water + i, wt);
+
+		//Average amount of water passing through the cell per unit time on each axis
+		Ln::store(velX + i, half * ((inL - fL) + (fR - inR)));
+		Ln::store(velY + i, half * ((inT - fT) + (fB - inB)));
+	}
+};
+
+//Erodes or deposits depending on how the carried (already advected) sediment compares to the capacity
+struct ErodeKernel {
+	const float *velX, *velY, *water;
+	float *land, *sand, *sediment;
+
+	template<typename V>
+	inline void run(int i) {
+		typedef Lanes<V> Ln;
+		const V zero(0.0f);
+
+		V vx = Ln::load(velX + i), vy = Ln::load(velY + i);
+		V cap = V(Kc) * vsqrt((vx * vx) + (vy * vy)); //Transport capacity
+		V sed = Ln::load(sediment + i);
+		V ld = Ln::load(land + i);
+
+		V ks = vmax(zero, V(Ks) * (cap - sed));
+		V kd = vmax(zero, V(Kd) * (sed - cap));
+
+		//Dissolve land into the water if it can carry more, otherwise drop some as sand
+		V erode = vand(vand(vgreater(cap, sed), vgreater(ld - ks, zero)), vgreater(Ln::load(water + i), sed));
+		Ln::store(land + i, vselect(erode, ld - ks, ld));
+		Ln::store(sand + i, vselect(erode, Ln::load(sand + i), Ln::load(sand + i) + kd));
+		Ln::store(sediment + i, vmax(zero, vselect(erode, sed + ks, sed - kd)));
+	}
+};
+
+PipeModel::PipeModel(int size, int threads) {
+	this->size = size;
+	this->stride = size + 2;
+	this->threads = threads;
+	this->heightScale = 1.0f;
+
+	int total = stride * stride;
+	land.assign(total, WALL);
+	sand.assign(total, 0.0f);
+	water.assign(total, 0.0f);
+	sediment.assign(total, 0.0f);
+	sedimentNext.assign(total, 0.0f);
+	fluxL.assign(total, 0.0f);
+	fluxR.assign(total, 0.0f);
+	fluxT.assign(total, 0.0f);
+	fluxB.assign(total, 0.0f);
+	velX.assign(total, 0.0f);
+	velY.assign(total, 0.0f);
+	rain.assign(total, 0.0f);
+	keep.assign(total, 0.0f);
+}
+
+void PipeModel::setTerrain(FloatData* height, FloatData* rainMap, ByteData* sinks, float heightScale) {
+	this->heightScale = heightScale;
+	for (int x = 0; x < size; x++) {
+		for (int y = 0; y < size; y++) {
+			int i = index(x, y);
+			land[i] = height->getValue(x, y) * heightScale;
+			sand[i] = 0.0f;
+			water[i] = 0.0f;
+			sediment[i] = 0.0f;
+			rain[i] = rainMap->getValue(x, y) * T * Kr;
+			keep[i] = (sinks != NULL && sinks->getValue(x, y) != 0) ? 0.0f : 1.0f;
+		}
+	}
+}
+
+void PipeModel::getTerrain(FloatData* height) {
+	for (int x = 0; x < size; x++)
+		for (int y = 0; y < size; y++)
+			height->setValue((land[index(x, y)] + sand[index(x, y)]) / heightScale, x, y);
+}
+
+void PipeModel::step() {
+	stepFlux();
+	stepWater();
+	stepTransport();
+}
+
+void PipeModel::stepFlux() {
+	FluxKernel kernel;
+	kernel.land = land.data();
+	kernel.sand = sand.data();
+	kernel.water = water.data();
+	kernel.fluxL = fluxL.data();
+	kernel.fluxR = fluxR.data();
+	kernel.fluxT = fluxT.data();
+	kernel.fluxB = fluxB.data();
+	kernel.stride = stride;
+
+	parallelFor(0, size, threads, [&](int x0, int x1) {
+		FluxKernel k = kernel;
+		for (int x = x0; x < x1; x++)
+			forEachLane(index(x, 0), index(x, 0) + size, k);
+	});
+}
+
+void PipeModel::stepWater() {
+	WaterKernel kernel;
+	kernel.fluxL = fluxL.data();
+	kernel.fluxR = fluxR.data();
+	kernel.fluxT = fluxT.data();
+	kernel.fluxB = fluxB.data();
+	kernel.rain = rain.data();
+	kernel.keep = keep.data();
+	kernel.water = water.data();
+	kernel.velX = velX.data();
+	kernel.velY = velY.data();
+	kernel.stride = stride;
+
+	parallelFor(0, size, threads, [&](int x0, int x1) {
+		WaterKernel k = kernel;
+		for (int x = x0; x < x1; x++)
+			forEachLane(index(x, 0), index(x, 0) + size, k);
+	});
+}
+
+void PipeModel::stepTransport() {
+	ErodeKernel kernel;
+	kernel.velX = velX.data();
+	kernel.velY = velY.data();
+	kernel.water = water.data();
+	kernel.land = land.data();
+	kernel.sand = sand.data();
+	kernel.sediment = sedimentNext.data();
+
+	parallelFor(0, size, threads, [&](int x0, int x1) {
+		ErodeKernel k = kernel;
+		float maxPos = (float)(size - 1);
+		for (int x = x0; x < x1; x++) {
+			//Carry the sediment along the velocity field by looking back to where the water came from.
+			//That's a bilinear gather, so it stays scalar, the rest of the row goes through the kernel
+			for (int y = 0; y < size; y++) {
+				int i = index(x, y);
+				float px = std::max(0.0f, std::min((float)x - velX[i], maxPos));
+				float py = std::max(0.0f, std::min((float)y - velY[i], maxPos));
+				int sx = std::min((int)px, size - 2), sy = std::min((int)py, size - 2);
+				float tx = px - sx, ty = py - sy;
+
+				int s = index(sx, sy);
+				float top = sediment[s] * (1.0f - tx) + sediment[s + stride] * tx;
+				float bot = sediment[s + 1] * (1.0f - tx) + sediment[s + stride + 1] * tx;
+				sedimentNext[i] = top * (1.0f - ty) + bot * ty;
+			}
+			forEachLane(index(x, 0), index(x, 0) + size, k);
+		}
+	});
+
+	sediment.swap(sedimentNext);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "WGFloatData.h"
+#include "WGByteData.h"
+
+#include <vector>
+
+namespace WG {
+	//CPU version of the virtual pipe hydraulic erosion model in research/flux.frag and research/velocity.frag.
+	//Every cell holds land (rock), sand, water and suspended sediment heights. Water flows out to the four
+	//neighbors through virtual pipes (an outflow flux per direction), the fluxes give a velocity field,
+	//and the speed of the water decides how much sediment it can carry.
+	//
+	//Each quantity is its own array (structure-of-arrays) with a one cell border around the map,
+	//so the per-row kernels run 4 cells at a time without any edge checks. The border holds "infinitely"
+	//high land, which keeps the outflow towards it at zero. Rows are split over threads.
+	class PipeModel {
+	public:
+		PipeModel(int size, int threads);
+
+		//Loads the terrain. Heights are multiplied by heightScale so slopes mean something to the model.
+		//Rain (0...1 per cell) scales how much water falls on each cell every step.
+		//Cells in the sink mask (non-zero) drain all of their water every step, like the ocean does.
+		void setTerrain(FloatData* height, FloatData* rain, ByteData* sinks, float heightScale);
+
+		//Writes land + sand back into the height map, undoing the height scale
+		void getTerrain(FloatData* height);
+
+		//Runs one time step: outflow flux, then water and velocity, then sediment transport
+		void step();
+
+		inline float getWater(int x, int y) { return water[index(x, y)] / heightScale; }
+		inline float getSediment(int x, int y) { return sediment[index(x, y)] / heightScale; }
+	private:
+		int size;
+		int stride; //Padded row length (size + 2)
+		int threads;
+		float heightScale;
+
+		std::vector<float> land;
+		std::vector<float> sand;
+		std::vector<float> water;
+		std::vector<float> sediment;
+		std::vector<float> sedimentNext;
+		std::vector<float> fluxL, fluxR, fluxT, fluxB; //Outflow towards x-1, x+1, y-1, y+1
+		std::vector<float> velX, velY;
+		std::vector<float> rain; //Water added per step
+		std::vector<float> keep; //1 to keep water, 0 to drain it
+
+		inline int index(int x, int y) { return ((x + 1) * stride) + (y + 1); }
+
+		void stepFlux();
+		void stepWater();
+		void stepTransport();
+	};
+}
@@ -0,0 +1,68 @@
+#include "WGResample.h"
+#include "WGParallel.h"
+#include "WGSimd.h"
+
+#include <cmath>
+#include <algorithm>
+
+using namespace WG;
+
+//out = a + (b - a) * t over a run of cells
+struct LerpKernel {
+	const float *a, *b;
+	float* out;
+	float t;
+
+	template<typename V>
+	inline void run(int i) {
+		typedef Lanes<V> Ln;
+		V va = Ln::load(a + i);
+		Ln::store(out + i, va + ((Ln::load(b + i) - va) * V(t)));
+	}
+};
+
+BilinearUpsampler::BilinearUpsampler(int coarseSize, int fineSize, int scale) {
+	this->coarseSize = coarseSize;
+	this->fineSize = fineSize;
+
+	lower.resize(fineSize);
+	upper.resize(fineSize);
+	weight.resize(fineSize);
+	for (int i = 0; i < fineSize; i++) {
+		float pos = std::max(0.0f, std::min(((i + 0.5f) / (float)scale) - 0.5f, (float)(coarseSize - 1)));
+		lower[i] = (int)floorf(pos);
+		upper[i] = std::min(lower[i] + 1, coarseSize - 1);
+		weight[i] = pos - (float)lower[i];
+	}
+}
+
+void BilinearUpsampler::row(const FloatData* coarse, int x, float* out, float* scratch) const {
+	LerpKernel kernel;
+	kernel.a = coarse->data + (lower[x] * coarseSize);
+	kernel.b = coarse->data + (upper[x] * coarseSize);
+	kernel.out = scratch;
+	kernel.t = weight[x];
+	forEachLane(0, coarseSize, kernel);
+
+	for (int y = 0; y < fineSize; y++) {
+		float a = scratch[lower[y]];
+		out[y] = a + ((scratch[upper[y]] - a) * weight[y]);
+	}
+}
+
+float BilinearUpsampler::sample(const FloatData* coarse, int x, int y) const {
+	const float* a = coarse->data + (lower[x] * coarseSize);
+	const float* b = coarse->data + (upper[x] * coarseSize);
+	float t = weight[x];
+	float near = a[lower[y]] + ((b[lower[y]] - a[lower[y]]) * t);
+	float far = a[upper[y]] + ((b[upper[y]] - a[upper[y]]) * t);
+	return near + ((far - near) * weight[y]);
+}
+
+void BilinearUpsampler::upsample(const FloatData* coarse, FloatData* fine, int threads) const {
+	parallelFor(0, fineSize, threads, [&](int x0, int x1) {
+		std::vector<float> scratch(coarseSize);
+		for (int x = x0; x < x1; x++)
+			row(coarse, x, fine->data + (x * fineSize), scratch.data());
+	});
+}
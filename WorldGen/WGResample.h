@@ -0,0 +1,37 @@
+#pragma once
+#include "WGFloatData.h"
+
+#include <vector>
+
+namespace WG {
+	//Bilinear upsampling of a coarse square layer onto a finer one, with cell centers lined up. Every coarse cell
+	//covers scale x scale fine ones, so fine cell x sits at coarse position (x + 0.5) / scale - 0.5, clamped at the
+	//edges. When the fine size isn't a multiple of the scale the last coarse cells hang over the edge, rather
+	//then the scale being stretched to fit.
+	//
+	//A fine row is made in two steps: the two coarse rows around it are blended 4 cells at a time,
+	//then that blended coarse row is stretched out along y with the weights worked out up front.
+	//Rows don't depend on each other, so callers can make them on any thread, one at a time as they need them.
+	class BilinearUpsampler {
+	public:
+		//coarseSize needs to be at least fineSize / scale, rounded up
+		BilinearUpsampler(int coarseSize, int fineSize, int scale);
+
+		//Fills out (fineSize floats) with fine row x. scratch needs room for coarseSize floats
+		void row(const FloatData* coarse, int x, float* out, float* scratch) const;
+
+		//Just fine cell (x, y), the same value row() would give it
+		float sample(const FloatData* coarse, int x, int y) const;
+
+		//Upsamples the whole layer, rows split over threads
+		void upsample(const FloatData* coarse, FloatData* fine, int threads) const;
+	private:
+		int coarseSize;
+		int fineSize;
+
+		//Per fine position along either axis: the coarse cells on each side and the weight of the second one
+		std::vector<int> lower;
+		std::vector<int> upper;
+		std::vector<float> weight;
+	};
+}
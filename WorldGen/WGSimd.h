@@ -0,0 +1,126 @@
+#pragma once
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WG_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace WG {
+	//Tiny 4-wide float vector used by the per-row kernels.
+	//Kernels are written once as templates over the lane type and then run as float4 across
+	//the body of a row and as plain float for the leftovers, so the free functions below
+	//are overloaded for both.
+#ifdef WG_SIMD_SSE2
+	struct float4 {
+		__m128 v;
+
+		float4() {}
+		float4(__m128 val) : v(val) {}
+		float4(float val) : v(_mm_set1_ps(val)) {}
+
+		static const int width = 4;
+	};
+
+	inline float4 load4(const float* ptr) { return float4(_mm_loadu_ps(ptr)); }
+	inline void store4(float* ptr, float4 a) { _mm_storeu_ps(ptr, a.v); }
+
+	inline float4 operator+(float4 a, float4 b) { return float4(_mm_add_ps(a.v, b.v)); }
+	inline float4 operator-(float4 a, float4 b) { return float4(_mm_sub_ps(a.v, b.v)); }
+	inline float4 operator*(float4 a, float4 b) { return float4(_mm_mul_ps(a.v, b.v)); }
+	inline float4 operator/(float4 a, float4 b) { return float4(_mm_div_ps(a.v, b.v)); }
+	inline float4 operator&(float4 a, float4 b) { return float4(_mm_and_ps(a.v, b.v)); }
+	inline float4 operator|(float4 a, float4 b) { return float4(_mm_or_ps(a.v, b.v)); }
+
+	//Comparisons return an all-bits mask per lane, to be used with vselect
+	inline float4 operator>(float4 a, float4 b) { return float4(_mm_cmpgt_ps(a.v, b.v)); }
+	inline float4 operator<(float4 a, float4 b) { return float4(_mm_cmplt_ps(a.v, b.v)); }
+
+	inline float4 vmin(float4 a, float4 b) { return float4(_mm_min_ps(a.v, b.v)); }
+	inline float4 vmax(float4 a, float4 b) { return float4(_mm_max_ps(a.v, b.v)); }
+	inline float4 vsqrt(float4 a) { return float4(_mm_sqrt_ps(a.v)); }
+	inline float4 vabs(float4 a) { return float4(_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)); }
+
+	//Picks a where the mask is set, b everywhere else
+	inline float4 vselect(float4 mask, float4 a, float4 b) {
+		return float4(_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)));
+	}
+#else
+	//No SSE2, fall back to four plain floats so the kernels still compile and run
+	struct float4 {
+		float v[4];
+
+		float4() {}
+		float4(float val) { v[0] = v[1] = v[2] = v[3] = val; }
+
+		static const int width = 4;
+	};
+
+	inline float4 load4(const float* ptr) { float4 r; for (int i = 0; i < 4; i++) r.v[i] = ptr[i]; return r; }
+	inline void store4(float* ptr, float4 a) { for (int i = 0; i < 4; i++) ptr[i] = a.v[i]; }
+
+#define WG_FLOAT4_OP(op, expr) \
+	inline float4 op(float4 a, float4 b) { float4 r; for (int i = 0; i < 4; i++) { float x = a.v[i], y = b.v[i]; r.v[i] = (expr); } return r; }
+	WG_FLOAT4_OP(operator+, x + y)
+	WG_FLOAT4_OP(operator-, x - y)
+	WG_FLOAT4_OP(operator*, x * y)
+	WG_FLOAT4_OP(operator/, x / y)
+	WG_FLOAT4_OP(vmin, std::min(x, y))
+	WG_FLOAT4_OP(vmax, std::max(x, y))
+	WG_FLOAT4_OP(operator>, x > y ? 1.0f : 0.0f)
+	WG_FLOAT4_OP(operator<, x < y ? 1.0f : 0.0f)
+	WG_FLOAT4_OP(operator&, (x != 0.0f && y != 0.0f) ? 1.0f : 0.0f)
+	WG_FLOAT4_OP(operator|, (x != 0.0f || y != 0.0f) ? 1.0f : 0.0f)
+#undef WG_FLOAT4_OP
+
+	inline float4 vsqrt(float4 a) { float4 r; for (int i = 0; i < 4; i++) r.v[i] = sqrtf(a.v[i]); return r; }
+	inline float4 vabs(float4 a) { float4 r; for (int i = 0; i < 4; i++) r.v[i] = fabsf(a.v[i]); return r; }
+	inline float4 vselect(float4 mask, float4 a, float4 b) {
+		float4 r;
+		for (int i = 0; i < 4; i++)
+			r.v[i] = mask.v[i] != 0.0f ? a.v[i] : b.v[i];
+		return r;
+	}
+#endif
+
+	//Scalar versions, so a kernel template can also be run one cell at a time.
+	//Masks are 1.0 (true) or 0.0 (false) instead of bit patterns here.
+	inline float load1(const float* ptr) { return *ptr; }
+	inline void store1(float* ptr, float a) { *ptr = a; }
+	inline float vmin(float a, float b) { return std::min(a, b); }
+	inline float vmax(float a, float b) { return std::max(a, b); }
+	inline float vsqrt(float a) { return sqrtf(a); }
+	inline float vabs(float a) { return fabsf(a); }
+	inline float vgreater(float a, float b) { return a > b ? 1.0f : 0.0f; }
+	inline float vless(float a, float b) { return a < b ? 1.0f : 0.0f; }
+	inline float vand(float a, float b) { return (a != 0.0f && b != 0.0f) ? 1.0f : 0.0f; }
+	inline float vselect(float mask, float a, float b) { return mask != 0.0f ? a : b; }
+
+	inline float4 vgreater(float4 a, float4 b) { return a > b; }
+	inline float4 vless(float4 a, float4 b) { return a < b; }
+	inline float4 vand(float4 a, float4 b) { return a & b; }
+
+	//Lane type traits so kernels can load/store without knowing the width
+	template<typename V> struct Lanes;
+	template<> struct Lanes<float> {
+		static const int width = 1;
+		static inline float load(const float* ptr) { return load1(ptr); }
+		static inline void store(float* ptr, float a) { store1(ptr, a); }
+	};
+	template<> struct Lanes<float4> {
+		static const int width = 4;
+		static inline float4 load(const float* ptr) { return load4(ptr); }
+		static inline void store(float* ptr, float4 a) { store4(ptr, a); }
+	};
+
+	//Runs kernel<V>(i) over [begin, end), 4 lanes at a time and then one at a time for the tail
+	template<typename Kernel>
+	inline void forEachLane(int begin, int end, Kernel& kernel) {
+		int i = begin;
+		for (; i + 4 <= end; i += 4)
+			kernel.template run<float4>(i);
+		for (; i < end; i++)
+			kernel.template run<float>(i);
+	}
+}
@@ -0,0 +1,140 @@
+#pragma once
+#include "WGParallel.h"
+
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+namespace WG {
+	// How neighbors past the edge of the map are read
+	enum StencilBoundary {
+		STENCIL_CLAMP, STENCIL_WRAP
+	};
+
+	//What a stencil functor gets to look at for one cell.
+	//Reads are relative to the cell and always come from the previous iteration.
+	template<typename T>
+	struct StencilWindow {
+		const T* data; //Tile buffer
+		int stride; //Height of the tile buffer
+		int lx, ly; //Cell position in the tile buffer
+		int maxX, maxY; //Last readable position in the tile buffer
+		int x, y; //Cell position on the map
+		int size; //Size of the map
+		StencilBoundary boundary;
+
+		//Value of the neighbor at the given offset. Off the map it clamps or wraps as the boundary says
+		inline T operator()(int dx, int dy) const {
+			int tx = std::max(0, std::min(lx + dx, maxX));
+			int ty = std::max(0, std::min(ly + dy, maxY));
+			return data[tx * stride + ty];
+		}
+
+		//If the neighbor at the given offset is a real map cell (always true when wrapping)
+		inline bool inside(int dx, int dy) const {
+			if (boundary == STENCIL_WRAP)
+				return true;
+			return x + dx >= 0 && x + dx < size && y + dy >= 0 && y + dy < size;
+		}
+	};
+
+	//Runs an iterative stencil over the map using temporal blocking.
+	//
+	//A plain implementation streams the whole map through memory once per iteration. Instead the map is cut
+	//into tiles, and each tile is copied (with a halo of depth * radius cells around it) into a small buffer
+	//that fits in cache. "depth" iterations are run on that buffer, each one shrinking the valid area by the
+	//stencil radius, and then only the tile itself is written back. Tiles are spread over threads.
+	//
+	//Every iteration only reads the previous one (Jacobi style), so the result does not depend on the tile size,
+	//depth or thread count. The stencil is a functor "T stencil(const StencilWindow<T>&)" returning the new value.
+	template<typename Data, typename Stencil>
+	void runStencil(Data* data, int iterations, int radius, StencilBoundary boundary,
+		int tileSize, int depth, int threads, Stencil stencil) {
+		typedef typename std::remove_pointer<decltype(data->data)>::type T;
+
+		int size = data->size;
+		tileSize = std::max(1, std::min(tileSize, size));
+		depth = std::max(1, depth);
+		int tiles = (size + tileSize - 1) / tileSize;
+
+		std::vector<T> output(size * size);
+		T* src = data->data;
+		T* dst = output.data();
+
+		for (int done = 0; done < iterations; ) {
+			int k = std::min(depth, iterations - done);
+			int halo = k * radius;
+
+			parallelFor(0, tiles * tiles, threads, [&](int tileBegin, int tileEnd) {
+				std::vector<T> bufA, bufB;
+
+				for (int tile = tileBegin; tile < tileEnd; tile++) {
+					int x0 = (tile / tiles) * tileSize, x1 = std::min(x0 + tileSize, size);
+					int y0 = (tile % tiles) * tileSize, y1 = std::min(y0 + tileSize, size);
+
+					//Buffer area. Clamping never reads past the map so the buffer stops at the edge,
+					//wrapping pulls the halo in from the other side
+					int bx0 = x0 - halo, bx1 = x1 + halo, by0 = y0 - halo, by1 = y1 + halo;
+					if (boundary == STENCIL_CLAMP) {
+						bx0 = std::max(0, bx0);
+						by0 = std::max(0, by0);
+						bx1 = std::min(size, bx1);
+						by1 = std::min(size, by1);
+					}
+					int w = bx1 - bx0, h = by1 - by0;
+					bufA.resize(w * h);
+					bufB.resize(w * h);
+
+					for (int lx = 0; lx < w; lx++) {
+						int gx = ((bx0 + lx) % size + size) % size;
+						for (int ly = 0; ly < h; ly++) {
+							int gy = ((by0 + ly) % size + size) % size;
+							bufA[lx * h + ly] = src[gx * size + gy];
+						}
+					}
+
+					StencilWindow<T> win;
+					win.stride = h;
+					win.maxX = w - 1;
+					win.maxY = h - 1;
+					win.size = size;
+					win.boundary = boundary;
+
+					T* cur = bufA.data();
+					T* next = bufB.data();
+					for (int t = 1; t <= k; t++) {
+						//Cells still valid after this iteration. The map edge itself never goes stale
+						int shrink = t * radius;
+						int cx0 = bx0 > 0 || boundary == STENCIL_WRAP ? shrink : 0;
+						int cy0 = by0 > 0 || boundary == STENCIL_WRAP ? shrink : 0;
+						int cx1 = bx1 < size || boundary == STENCIL_WRAP ? w - shrink : w;
+						int cy1 = by1 < size || boundary == STENCIL_WRAP ? h - shrink : h;
+
+						win.data = cur;
+						for (int lx = cx0; lx < cx1; lx++) {
+							win.lx = lx;
+							win.x = ((bx0 + lx) % size + size) % size;
+							for (int ly = cy0; ly < cy1; ly++) {
+								win.ly = ly;
+								win.y = ((by0 + ly) % size + size) % size;
+								next[lx * h + ly] = stencil(win);
+							}
+						}
+						std::swap(cur, next);
+					}
+
+					for (int gx = x0; gx < x1; gx++)
+						for (int gy = y0; gy < y1; gy++)
+							dst[gx * size + gy] = cur[(gx - bx0) * h + (gy - by0)];
+				}
+			});
+
+			std::swap(src, dst);
+			done += k;
+		}
+
+		//Ended up in the scratch buffer, copy it home
+		if (src != data->data)
+			std::copy(src, src + (size * size), data->data);
+	}
+}
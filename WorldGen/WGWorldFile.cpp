@@ -0,0 +1,457 @@
+#include "WGWorldFile.h"
+#include "WGGenerator.h"
+#include "WGDeflate.h"
+#include "WGParallel.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+using namespace WG;
+
+static const char MAGIC[4] = { 'W', 'G', 'W', 'F' };
+static const uint32_t HEADER_FIXED = 48; //Header bytes before the settings
+static const uint32_t ENTRY_BYTES = 64; //Directory bytes per layer
+static const size_t NAME_BYTES = 32;
+static const uint64_t ALIGNMENT = 64; //Of the layer blobs
+static const size_t PIECE_BYTES = 1 << 20; //Written at a time by save
+static const uint32_t MAX_SIZE = 1 << 20; //Sanity limits for layers read from a file
+static const uint32_t MAX_CHANNELS = 64;
+
+static inline uint64_t alignUp(uint64_t value) {
+	return (value + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+static inline void putLE32(uint8_t* out, uint32_t value) {
+	for (int k = 0; k < 4; k++)
+		out[k] = (uint8_t)(value >> (k * 8));
+}
+static inline void putLE64(uint8_t* out, uint64_t value) {
+	putLE32(out, (uint32_t)value);
+	putLE32(out + 4, (uint32_t)(value >> 32));
+}
+static inline uint32_t readLE32(const uint8_t* in) {
+	return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+static inline uint64_t readLE64(const uint8_t* in) {
+	return (uint64_t)readLE32(in) | ((uint64_t)readLE32(in + 4) << 32);
+}
+
+//A Settings field as its 4 bytes in the file and back
+static inline uint32_t toField(int value) { return (uint32_t)value; }
+static inline uint32_t toField(unsigned int value) { return value; }
+static inline uint32_t toField(bool value) { return value ? 1 : 0; }
+static inline uint32_t toField(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, 4);
+	return bits;
+}
+template<typename Enum> static inline uint32_t toField(Enum value) { return (uint32_t)value; }
+
+static inline void fromField(int& value, uint32_t bits) { value = (int)bits; }
+static inline void fromField(unsigned int& value, uint32_t bits) { value = bits; }
+static inline void fromField(bool& value, uint32_t bits) { value = bits != 0; }
+static inline void fromField(float& value, uint32_t bits) { memcpy(&value, &bits, 4); }
+template<typename Enum> static inline void fromField(Enum& value, uint32_t bits) { value = (Enum)bits; }
+
+//Every Settings field in file order. New fields only ever go on the end, files from before them
+//leave them at their defaults
+template<typename S, typename Func>
+static void forEachSetting(S& s, Func f) {
+	f(s.worldSize);
+	f(s.seed);
+	f(s.heightModifier);
+	f(s.seaLevel);
+	f(s.oceanMinArea);
+	f(s.lakeMinArea);
+	f(s.coastSmoothing);
+	f(s.shoreWidth);
+	f(s.coastDistance);
+	f(s.coastRange);
+	f(s.coastMoisture);
+	f(s.coastTemperature);
+	f(s.thermalErosionIterations);
+	f(s.thermalErosionThreshold);
+	f(s.thermalErosionCoefficient);
+	f(s.thermalErosionTolerance);
+	f(s.thermalErosionLevels);
+	f(s.thermalErosionFineIterations);
+	f(s.climateDownsample);
+	f(s.moistureMode);
+	f(s.windDirection);
+	f(s.riverThreshold);
+	f(s.biomeFilterRadius);
+	f(s.biomeBlendRadius);
+	f(s.biomeIndex);
+	f(s.biomeRegions);
+	f(s.hydraulicErosionIterations);
+	f(s.hydraulicErosionMode);
+	f(s.hydraulicDropletsPerIteration);
+	f(s.threadCount);
+	f(s.stencilTileSize);
+	f(s.stencilBlockDepth);
+}
+
+static int createFile(const char* path) {
+#ifdef _WIN32
+	return _open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+	return ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+}
+
+static void closeFile(int fd) {
+#ifdef _WIN32
+	_close(fd);
+#else
+	::close(fd);
+#endif
+}
+
+static bool writeAll(int fd, const uint8_t* data, size_t length) {
+	while (length > 0) {
+#ifdef _WIN32
+		int written = _write(fd, data, (unsigned int)std::min(length, (size_t)1 << 30));
+#else
+		ssize_t written = ::write(fd, data, length);
+		if (written < 0 && errno == EINTR)
+			continue;
+#endif
+		if (written <= 0)
+			return false;
+		data += written;
+		length -= (size_t)written;
+	}
+	return true;
+}
+
+static bool seekStart(int fd) {
+#ifdef _WIN32
+	return _lseeki64(fd, 0, SEEK_SET) == 0;
+#else
+	return lseek(fd, 0, SEEK_SET) == 0;
+#endif
+}
+
+//CRC-32 of the header with its own checksum field counted as zeros
+static uint32_t headerChecksum(const uint8_t* header, uint32_t headerBytes) {
+	static const uint8_t zeros[4] = {};
+	uint32_t crc = crc32(0, header, 20);
+	crc = crc32(crc, zeros, 4);
+	return crc32(crc, header + 24, headerBytes - 24);
+}
+
+static WorldLayer makeLayer(const char* name, WorldLayerType type, int size, int channels, const void* data) {
+	WorldLayer layer;
+	layer.name = name;
+	layer.type = type;
+	layer.size = size;
+	layer.channels = channels;
+	layer.data = data;
+	return layer;
+}
+
+WorldFile::WorldFile() {
+	this->settings = Settings();
+}
+
+WorldFile::~WorldFile() {
+	close();
+}
+
+bool WorldFile::save(const std::string& path, const Settings& settings, const std::vector<WorldLayer>& layers, std::string& error) {
+	for (const WorldLayer& layer : layers) {
+		if (layer.name.empty() || layer.name.size() >= NAME_BYTES || layer.size <= 0 || layer.channels <= 0 || layer.data == NULL) {
+			error = "Bad layer \"" + layer.name + "\"";
+			return false;
+		}
+	}
+
+	uint32_t settingsCount = 0;
+	forEachSetting(settings, [&](const auto&) { settingsCount++; });
+	uint32_t headerBytes = (uint32_t)alignUp(HEADER_FIXED + (4 * settingsCount));
+	std::vector<uint8_t> header(headerBytes, 0);
+
+	int fd = createFile(path.c_str());
+	if (fd < 0) {
+		error = "Couldn't create " + path;
+		return false;
+	}
+	auto fail = [&](const std::string& message) {
+		closeFile(fd);
+		remove(path.c_str());
+		error = message;
+		return false;
+	};
+
+	//The header goes in last, once the directory's place is known
+	if (!writeAll(fd, header.data(), headerBytes))
+		return fail("Couldn't write " + path);
+
+	static const uint8_t padding[ALIGNMENT] = {};
+	std::vector<uint8_t> directory(layers.size() * ENTRY_BYTES, 0);
+	uint64_t position = headerBytes;
+	for (size_t l = 0; l < layers.size(); l++) {
+		const WorldLayer& layer = layers[l];
+		uint64_t offset = alignUp(position);
+		if (!writeAll(fd, padding, (size_t)(offset - position)))
+			return fail("Couldn't write " + path);
+
+		//Checksummed a piece at a time on the way out, while it's in cache
+		uint64_t bytes = layer.getBytes();
+		const uint8_t* data = (const uint8_t*)layer.data;
+		uint32_t crc = 0;
+		for (uint64_t done = 0; done < bytes; done += PIECE_BYTES) {
+			size_t piece = (size_t)std::min((uint64_t)PIECE_BYTES, bytes - done);
+			crc = crc32(crc, data + done, piece);
+			if (!writeAll(fd, data + done, piece))
+				return fail("Couldn't write " + path);
+		}
+
+		uint8_t* entry = directory.data() + (l * ENTRY_BYTES);
+		memcpy(entry, layer.name.c_str(), layer.name.size());
+		putLE32(entry + 32, (uint32_t)layer.type);
+		putLE32(entry + 36, (uint32_t)layer.size);
+		putLE32(entry + 40, (uint32_t)layer.channels);
+		putLE32(entry + 44, crc);
+		putLE64(entry + 48, offset);
+		putLE64(entry + 56, bytes);
+		position = offset + bytes;
+	}
+
+	uint64_t directoryOffset = alignUp(position);
+	if (!writeAll(fd, padding, (size_t)(directoryOffset - position)) || !writeAll(fd, directory.data(), directory.size()))
+		return fail("Couldn't write " + path);
+
+	memcpy(header.data(), MAGIC, 4);
+	putLE32(header.data() + 4, VERSION);
+	putLE32(header.data() + 8, headerBytes);
+	putLE32(header.data() + 12, settingsCount);
+	putLE32(header.data() + 16, (uint32_t)layers.size());
+	putLE64(header.data() + 24, directoryOffset);
+	putLE64(header.data() + 32, directoryOffset + directory.size());
+	putLE32(header.data() + 40, crc32(0, directory.data(), directory.size()));
+	uint8_t* field = header.data() + HEADER_FIXED;
+	forEachSetting(settings, [&](const auto& value) {
+		putLE32(field, toField(value));
+		field += 4;
+	});
+	putLE32(header.data() + 20, headerChecksum(header.data(), headerBytes));
+	if (!seekStart(fd) || !writeAll(fd, header.data(), headerBytes))
+		return fail("Couldn't write " + path);
+
+	closeFile(fd);
+	return true;
+}
+
+std::vector<WorldLayer> WorldFile::getLayers(Generator* generator) {
+	std::vector<WorldLayer> layers;
+	auto addFloat = [&](const char* name, FloatData* data) {
+		if (data != NULL)
+			layers.push_back(makeLayer(name, LAYER_FLOAT, data->size, 1, data->data));
+	};
+	auto addByte = [&](const char* name, ByteData* data) {
+		if (data != NULL)
+			layers.push_back(makeLayer(name, LAYER_BYTE, data->size, 1, data->data));
+	};
+
+	addFloat("height", generator->getHeightData());
+	addFloat("temperature", generator->getTemperatureData());
+	addFloat("moisture", generator->getMoistureData());
+	addByte("water", generator->getWaterData());
+	addByte("biomes", generator->getBiomeData());
+	addFloat("coast_distance", generator->getCoastDistanceData());
+	BiomeBlend* blend = generator->getBiomeBlend();
+	if (blend != NULL) {
+		layers.push_back(makeLayer("biome_blend_ids", LAYER_BYTE, blend->size, 4, blend->ids.data()));
+		layers.push_back(makeLayer("biome_blend_weights", LAYER_BYTE, blend->size, 4, blend->weights.data()));
+	}
+	return layers;
+}
+
+bool WorldFile::open(const std::string& path, std::string& error) {
+	close();
+
+	uint64_t fileBytes = 0;
+	void* view = NULL;
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		error = "Couldn't open " + path;
+		return false;
+	}
+	LARGE_INTEGER size;
+	HANDLE mapHandle = NULL;
+	if (GetFileSizeEx(file, &size) && size.QuadPart >= HEADER_FIXED) {
+		fileBytes = (uint64_t)size.QuadPart;
+		mapHandle = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+		if (mapHandle != NULL)
+			view = MapViewOfFile(mapHandle, FILE_MAP_COPY, 0, 0, 0);
+	}
+	if (view == NULL) {
+		if (mapHandle != NULL)
+			CloseHandle(mapHandle);
+		CloseHandle(file);
+		error = fileBytes < HEADER_FIXED ? path + " is not a world file" : "Couldn't map " + path;
+		return false;
+	}
+	this->fileHandle = file;
+	this->mappingHandle = mapHandle;
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		error = "Couldn't open " + path;
+		return false;
+	}
+	struct stat info;
+	if (fstat(fd, &info) == 0 && info.st_size >= (off_t)HEADER_FIXED) {
+		fileBytes = (uint64_t)info.st_size;
+		//Private and writable, so views can be edited without touching the file
+		view = mmap(NULL, (size_t)fileBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (view == MAP_FAILED)
+			view = NULL;
+	}
+	::close(fd);
+	if (view == NULL) {
+		error = fileBytes < HEADER_FIXED ? path + " is not a world file" : "Couldn't map " + path;
+		return false;
+	}
+#endif
+	this->mapping = (uint8_t*)view;
+	this->mappingBytes = fileBytes;
+
+	auto fail = [&](const std::string& message) {
+		close();
+		error = path + ": " + message;
+		return false;
+	};
+
+	const uint8_t* header = mapping;
+	if (memcmp(header, MAGIC, 4) != 0)
+		return fail("not a world file");
+	if (readLE32(header + 4) > VERSION)
+		return fail("made by a newer version (" + std::to_string(readLE32(header + 4)) + ")");
+	uint32_t headerBytes = readLE32(header + 8), settingsCount = readLE32(header + 12), layerCount = readLE32(header + 16);
+	uint64_t directoryOffset = readLE64(header + 24);
+	if (headerBytes < HEADER_FIXED || headerBytes > fileBytes || settingsCount > (headerBytes - HEADER_FIXED) / 4)
+		return fail("bad header");
+	if (readLE32(header + 20) != headerChecksum(header, headerBytes))
+		return fail("header checksum mismatch");
+	if (readLE64(header + 32) != fileBytes)
+		return fail("cut off or padded, " + std::to_string(fileBytes) + " bytes instead of " + std::to_string(readLE64(header + 32)));
+	if (directoryOffset < headerBytes || directoryOffset > fileBytes || layerCount > (fileBytes - directoryOffset) / ENTRY_BYTES)
+		return fail("bad directory");
+	const uint8_t* directory = mapping + directoryOffset;
+	if (readLE32(header + 40) != crc32(0, directory, (size_t)layerCount * ENTRY_BYTES))
+		return fail("directory checksum mismatch");
+
+	uint32_t index = 0;
+	forEachSetting(settings, [&](auto& value) {
+		if (index < settingsCount)
+			fromField(value, readLE32(header + HEADER_FIXED + (4 * index)));
+		index++;
+	});
+
+	for (uint32_t l = 0; l < layerCount; l++) {
+		const uint8_t* entry = directory + (l * ENTRY_BYTES);
+		if (memchr(entry, 0, NAME_BYTES) == NULL)
+			return fail("bad layer name");
+		uint32_t type = readLE32(entry + 32), size = readLE32(entry + 36), channels = readLE32(entry + 40);
+		uint64_t offset = readLE64(entry + 48), bytes = readLE64(entry + 56);
+		if (type > LAYER_BYTE || size == 0 || size > MAX_SIZE || channels == 0 || channels > MAX_CHANNELS)
+			return fail("bad layer " + std::to_string(l));
+
+		WorldLayer layer = makeLayer((const char*)entry, (WorldLayerType)type, (int)size, (int)channels, mapping + offset);
+		layer.checksum = readLE32(entry + 44);
+		if (bytes != layer.getBytes() || offset % ALIGNMENT != 0 || offset < headerBytes || offset > directoryOffset || bytes > directoryOffset - offset)
+			return fail("bad layer \"" + layer.name + "\"");
+		layers.push_back(layer);
+	}
+
+	floatViews.resize(layers.size());
+	byteViews.resize(layers.size());
+	for (size_t l = 0; l < layers.size(); l++) {
+		WorldLayer& layer = layers[l];
+		if (layer.channels != 1)
+			continue;
+		if (layer.type == LAYER_FLOAT)
+			floatViews[l].reset(new FloatData((float*)layer.data, layer.size));
+		else
+			byteViews[l].reset(new ByteData((uint8_t*)layer.data, layer.size));
+	}
+	return true;
+}
+
+void WorldFile::close() {
+	floatViews.clear();
+	byteViews.clear();
+	layers.clear();
+	settings = Settings();
+	if (mapping == NULL)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(mapping);
+	CloseHandle((HANDLE)mappingHandle);
+	CloseHandle((HANDLE)fileHandle);
+	mappingHandle = NULL;
+	fileHandle = NULL;
+#else
+	munmap(mapping, (size_t)mappingBytes);
+#endif
+	mapping = NULL;
+	mappingBytes = 0;
+}
+
+bool WorldFile::verify(std::string& error) const {
+	//Layers checked side by side, the disk is usually what limits this
+	std::vector<uint8_t> bad(layers.size(), 0);
+	parallelFor(0, (int)layers.size(), resolveThreadCount(0), [&](int l0, int l1) {
+		for (int l = l0; l < l1; l++) {
+			const WorldLayer& layer = layers[l];
+			bad[l] = crc32(0, (const uint8_t*)layer.data, (size_t)layer.getBytes()) != layer.checksum;
+		}
+	});
+	for (size_t l = 0; l < layers.size(); l++) {
+		if (bad[l]) {
+			error = "Layer \"" + layers[l].name + "\" doesn't match its checksum";
+			return false;
+		}
+	}
+	return true;
+}
+
+int WorldFile::findLayer(const std::string& name) const {
+	for (size_t l = 0; l < layers.size(); l++) {
+		if (layers[l].name == name)
+			return (int)l;
+	}
+	return -1;
+}
+
+const WorldLayer* WorldFile::getLayer(const std::string& name) const {
+	int l = findLayer(name);
+	return l >= 0 ? &layers[l] : NULL;
+}
+
+FloatData* WorldFile::getFloatData(const std::string& name) {
+	int l = findLayer(name);
+	return l >= 0 ? floatViews[l].get() : NULL;
+}
+
+ByteData* WorldFile::getByteData(const std::string& name) {
+	int l = findLayer(name);
+	return l >= 0 ? byteViews[l].get() : NULL;
+}
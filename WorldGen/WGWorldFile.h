@@ -0,0 +1,85 @@
+#pragma once
+#include "WGGeneratorSettings.h"
+#include "WGFloatData.h"
+#include "WGByteData.h"
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+
+namespace WG {
+	class Generator;
+
+	enum WorldLayerType {
+		LAYER_FLOAT = 0, //32 bit floats
+		LAYER_BYTE = 1
+	};
+
+	//One layer of a world file: size x size cells of channels values each, cell (x * size + y) * channels + channel
+	struct WorldLayer {
+		std::string name; //At most 31 characters
+		WorldLayerType type;
+		int size;
+		int channels;
+		const void* data;
+		uint32_t checksum = 0; //CRC-32 of the data, filled in by WorldFile
+
+		inline uint64_t getBytes() const { return (uint64_t)size * size * channels * (type == LAYER_FLOAT ? 4 : 1); }
+	};
+
+	//Native .wgw world files: the Settings a world was made with and its layers as raw arrays, so a world
+	//loads by mapping the file instead of reading and parsing it.
+	//
+	//The file is a header (magic, version, the Settings as 4 byte fields in a fixed order that only ever
+	//grows at the end, and where the directory is), the layer blobs each starting on a 64 byte boundary,
+	//then the directory: 64 bytes per layer with its name, type, size, channels, offset, length and CRC-32.
+	//Everything is little endian. save streams the layers out in 1 MB pieces, checksumming as it goes,
+	//and writes the directory and header last.
+	//
+	//open maps the whole file copy-on-write and only checks the header and directory, so even a multi-GB
+	//world opens in well under a millisecond. Layers come out as FloatData/ByteData views straight into the
+	//mapping: pages are read in the first time they're touched, and writing to a view changes only this
+	//process' copy. verify reads everything once to check the layer checksums.
+	//
+	//Views and layer data stay valid until the WorldFile is closed or destroyed.
+	class WorldFile {
+	public:
+		static const uint32_t VERSION = 1;
+
+		WorldFile();
+		~WorldFile();
+
+		//Writes the layers (all of them the same world's) to path. On failure error says why
+		static bool save(const std::string& path, const Settings& settings, const std::vector<WorldLayer>& layers, std::string& error);
+		//The generator's finished layers: height, temperature, moisture, water, biomes, and the coast distance
+		//and biome blend when there are those
+		static std::vector<WorldLayer> getLayers(Generator* generator);
+
+		bool open(const std::string& path, std::string& error);
+		void close();
+		//Checks every layer against its checksum, reading the whole file
+		bool verify(std::string& error) const;
+
+		inline const Settings& getSettings() const { return settings; }
+		inline const std::vector<WorldLayer>& getLayers() const { return layers; }
+		const WorldLayer* getLayer(const std::string& name) const; //NULL if there's no such layer
+		//Views of single channel layers, NULL if there's no such layer or it's another type
+		FloatData* getFloatData(const std::string& name);
+		ByteData* getByteData(const std::string& name);
+	private:
+		Settings settings;
+		std::vector<WorldLayer> layers;
+		std::vector<std::unique_ptr<FloatData> > floatViews; //By layer, NULL where it's not a float layer
+		std::vector<std::unique_ptr<ByteData> > byteViews;
+
+		uint8_t* mapping = NULL;
+		uint64_t mappingBytes = 0;
+#ifdef _WIN32
+		void* fileHandle = NULL;
+		void* mappingHandle = NULL;
+#endif
+
+		int findLayer(const std::string& name) const;
+	};
+}
@@ -1,12 +1,20 @@
 #include <iostream>
-#include <Windows.h>
 #include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <string>
 #include <memory>
+#include <vector>
 #include <math.h>
 
 #include "WGGeneratorSettings.h"
 #include "WGGenerator.h"
+#include "WGDerivedTerrain.h"
 #include "WGFloatData.h"
+#include "WGBenchmark.h"
+#include "WGImageWriter.h"
+#include "WGWorldFile.h"
+#include "WGParallel.h"
 
 #include "FastNoise.h"
 
@@ -53,176 +61,67 @@ void HSVtoRGB(float& fR, float& fG, float& fB, float& fH, float& fS, float& fV)
 	fB += fM;
 }
 
-void SaveBitmapToFile(BYTE* pBitmapBits,
-	LONG lWidth,
-	LONG lHeight,
-	WORD wBitsPerPixel,
-	const unsigned long& padding_size,
-	LPCTSTR lpszFileName)
-{
-	// Some basic bitmap parameters  
-	unsigned long headers_size = sizeof(BITMAPFILEHEADER) +
-		sizeof(BITMAPINFOHEADER);
+//Images go out in the format picked with -format, BMP by default
+WG::ImageFormat imageFormat = WG::IMAGE_BMP;
 
-	unsigned long pixel_data_size = lHeight * ((lWidth * (wBitsPerPixel / 8)) + padding_size);
-
-	BITMAPINFOHEADER bmpInfoHeader = { 0 };
-
-	// Set the size  
-	bmpInfoHeader.biSize = sizeof(BITMAPINFOHEADER);
-
-	// Bit count  
-	bmpInfoHeader.biBitCount = wBitsPerPixel;
-
-	// Use all colors  
-	bmpInfoHeader.biClrImportant = 0;
-
-	// Use as many colors according to bits per pixel  
-	bmpInfoHeader.biClrUsed = 0;
-
-	// Store as un Compressed  
-	bmpInfoHeader.biCompression = BI_RGB;
-
-	// Set the height in pixels  
-	bmpInfoHeader.biHeight = lHeight;
-
-	// Width of the Image in pixels  
-	bmpInfoHeader.biWidth = lWidth;
-
-	// Default number of planes  
-	bmpInfoHeader.biPlanes = 1;
-
-	// Calculate the image size in bytes  
-	bmpInfoHeader.biSizeImage = pixel_data_size;
-
-	BITMAPFILEHEADER bfh = { 0 };
-
-	// This value should be values of BM letters i.e 0x4D42  
-	// 0x4D = M 042 = B storing in reverse order to match with endian  
-	bfh.bfType = 0x4D42;
-	//bfh.bfType = 'B'+('M' << 8); 
-
-	// <<8 used to shift M to end  */  
-
-	// Offset to the RGBQUAD  
-	bfh.bfOffBits = headers_size;
-
-	// Total size of image including size of headers  
-	bfh.bfSize = headers_size + pixel_data_size;
-
-	// Create the file in disk to write  
-	HANDLE hFile = CreateFile(lpszFileName,
-		GENERIC_WRITE,
-		0,
-		NULL,
-		CREATE_ALWAYS,
-		FILE_ATTRIBUTE_NORMAL,
-		NULL);
-
-	// Return if error opening file  
-	if (!hFile) return;
-
-	DWORD dwWritten = 0;
-
-	// Write the File header  
-	WriteFile(hFile,
-		&bfh,
-		sizeof(bfh),
-		&dwWritten,
-		NULL);
-
-	// Write the bitmap info header  
-	WriteFile(hFile,
-		&bmpInfoHeader,
-		sizeof(bmpInfoHeader),
-		&dwWritten,
-		NULL);
-
-	// Write the RGB Data  
-	WriteFile(hFile,
-		pBitmapBits,
-		bmpInfoHeader.biSizeImage,
-		&dwWritten,
-		NULL);
-
-	// Close the file handle  
-	CloseHandle(hFile);
+//Writes name.<extension> a row at a time from source, PNGs encoded in bands on every thread
+void SaveImage(const char* name, int size, int channels, const WG::RowSource& source) {
+	std::string path = std::string(name) + WG::ImageWriter::getExtension(imageFormat, channels);
+	WG::ImageWriter image;
+	if (!image.open(path, imageFormat, size, size, channels) || !image.writeRows(source, WG::resolveThreadCount(0)) || !image.close())
+		cout << image.getError() << endl;
 }
 
 void SaveHeightmapData(WG::FloatData* data) {
-	BYTE* buffer = new BYTE[data->size * 3 * data->size];
-	int bOff = 0;
-
-	float samp = 0.0f;
-	for (int y = (data->size - 1); y >= 0; y--) {
-		for (int x = 0; x < data->size; x++) {
-			samp = data->getValue(x,y);
-
-			buffer[bOff] = (BYTE)(std::floorf(samp * 255.0f)); //B
-			buffer[bOff + 1] = (BYTE)(std::floorf(samp * 255.0f)); //G
-			buffer[bOff + 2] = (BYTE)(std::floorf(samp * 255.0f)); //R
-			bOff += 3;
-		}
-	}
-
-	SaveBitmapToFile((BYTE*)buffer, data->size, data->size, 24, 0, ".\\height.bmp");
+	SaveImage("height", data->size, 1, [data](int y, uint8_t* row) {
+		for (int x = 0; x < data->size; x++)
+			row[x] = (uint8_t)(floorf(data->getValue(x, y) * 255.0f));
+	});
 }
 
-void SaveNormalData(vector3* data) {
-	BYTE* buffer = new BYTE[512 * 3 * 512];
-	int bOff = 0;
+//Normals come straight from the generator's gradient layer, strength sets how steep the slopes look
+void SaveNormalData(WG::DerivedTerrain* terrain, float strength) {
+	int size = terrain->slope->size;
 
-	vector3 samp;
-	for (int y = (512 - 1); y >= 0; y--) {
-		for (int x = 0; x < 512; x++) {
-			samp = data[x * 512 + y];
+	SaveImage("normals", size, 3, [terrain, strength, size](int y, uint8_t* row) {
+		vector3 normal;
+		for (int x = 0; x < size; x++) {
+			normal.x = -terrain->gradientX->getValue(x, y) * strength;
+			normal.y = -terrain->gradientY->getValue(x, y) * strength;
+			normal.z = 1.0f;
+			normal.normalize();
 
-			buffer[bOff] = (BYTE) (samp.z * 255.0f); //B
-			buffer[bOff + 1] = (BYTE)(samp.y * 255.0f); //G
-			buffer[bOff + 2] = (BYTE)(samp.x * 255.0f); //R
-			bOff += 3;
+			row[(x * 3)] = (uint8_t)((normal.x * 0.5f + 0.5f) * 255.0f); //R
+			row[(x * 3) + 1] = (uint8_t)((normal.y * 0.5f + 0.5f) * 255.0f); //G
+			row[(x * 3) + 2] = (uint8_t)((normal.z * 0.5f + 0.5f) * 255.0f); //B
 		}
-	}
-
-	SaveBitmapToFile((BYTE*)buffer, 512, 512, 24, 0, ".\\normals.bmp");
+	});
 }
 
 void SaveWaterData(WG::ByteData* data) {
-	int size = data->size;
-
-	BYTE* buffer = new BYTE[size * 3 * size];
-	int bOff = 0;
-
-	uint8_t samp = 0;
-	for (int y = (size - 1); y >= 0; y--) {
-		for (int x = 0; x < size; x++) {
+	SaveImage("water", data->size, 3, [data](int y, uint8_t* row) {
+		uint8_t samp = 0;
+		for (int x = 0; x < data->size; x++) {
 			samp = data->getValue(x,y);
+			row[(x * 3)] = 0; //R
+			row[(x * 3) + 1] = (uint8_t)(samp == 3 ? 96 : 0); //G
 			if (samp == 1)
-				buffer[bOff] = (BYTE)128; //B
+				row[(x * 3) + 2] = 128; //B
 			else if (samp == 2)
-				buffer[bOff] = (BYTE)255; //B
+				row[(x * 3) + 2] = 255; //B
+			else if (samp == 3)
+				row[(x * 3) + 2] = 192; //B
 			else
-				buffer[bOff] = (BYTE)0; //B
-			
-			buffer[bOff + 1] = (BYTE)0; //G
-			buffer[bOff + 2] = (BYTE)0; //R
-			
-			bOff += 3;
+				row[(x * 3) + 2] = 0; //B
 		}
-	}
-
-	SaveBitmapToFile((BYTE*)buffer, size, size, 24, 0, ".\\water.bmp");
+	});
 }
 
 void SaveTemperatureData(WG::FloatData* data, WG::FloatData* height) {
-	int size = data->size;
-	BYTE* buffer = new BYTE[size * 3 * size];
-	int bOff = 0;
-
-	float samp = 0.0f;
-	float r = 0.0f, g = 0.0f, b = 0.0f, h = 0.0f, s = 0.0f, v=0.0f;
-	for (int y = (size - 1); y >= 0; y--) {
-		for (int x = 0; x < size; x++) {
+	SaveImage("temperature", data->size, 3, [data, height](int y, uint8_t* row) {
+		float samp = 0.0f;
+		float r = 0.0f, g = 0.0f, b = 0.0f, h = 0.0f, s = 0.0f, v=0.0f;
+		for (int x = 0; x < data->size; x++) {
 			samp = data->getValue(x,y);
 
 			s = 1.0f;
@@ -230,222 +129,220 @@ void SaveTemperatureData(WG::FloatData* data, WG::FloatData* height) {
 			h = ((1.0f - samp) * 250.0f);
 			HSVtoRGB(r, g, b, h, s, v);
 
-			buffer[bOff] = (BYTE)(std::floorf(b * 255.0f)); //B
-			buffer[bOff + 1] = (BYTE)(std::floorf(g * 255.0f)); //G
-			buffer[bOff + 2] = (BYTE)(std::floorf(r * 255.0f)); //R
-			bOff += 3;
+			row[(x * 3)] = (uint8_t)(floorf(r * 255.0f)); //R
+			row[(x * 3) + 1] = (uint8_t)(floorf(g * 255.0f)); //G
+			row[(x * 3) + 2] = (uint8_t)(floorf(b * 255.0f)); //B
 		}
-	}
-
-	SaveBitmapToFile((BYTE*)buffer, size, size, 24, 0, ".\\temperature.bmp");
+	});
 }
 
 void SaveMoistureData(WG::FloatData* data) {
-	BYTE* buffer = new BYTE[data->size * 3 * data->size];
-	int bOff = 0;
-
-	float samp = 0.0f;
-	for (int y = (data->size - 1); y >= 0; y--) {
+	SaveImage("moisture", data->size, 3, [data](int y, uint8_t* row) {
 		for (int x = 0; x < data->size; x++) {
-			samp = data->getValue(x, y);
-
-			buffer[bOff] = (BYTE)(std::floorf(samp * 255.0f)); //B
-			buffer[bOff + 1] = (BYTE)0; //G
-			buffer[bOff + 2] = (BYTE)0; //R
-			bOff += 3;
+			row[(x * 3)] = 0; //R
+			row[(x * 3) + 1] = 0; //G
+			row[(x * 3) + 2] = (uint8_t)(floorf(data->getValue(x, y) * 255.0f)); //B
 		}
-	}
-
-	SaveBitmapToFile((BYTE*)buffer, data->size, data->size, 24, 0, ".\\moisture.bmp");
+	});
 }
 
-void SaveBiomeData(WG::ByteData* data) {
-	BYTE* buffer = new BYTE[data->size * 3 * data->size];
-	int bOff = 0;
+void SaveBiomeData(WG::ByteData* data, WG::BiomeTable* table) {
+	//Colors straight from the table by id, black for ids it doesn't have
+	std::vector<uint8_t> colors(256 * 3, 0);
+	for (const WG::BiomeInfo& biome : table->getBiomes()) {
+		colors[(biome.id * 3)] = biome.red;
+		colors[(biome.id * 3) + 1] = biome.green;
+		colors[(biome.id * 3) + 2] = biome.blue;
+	}
 
-	uint8_t samp ;
-	for (int y = (data->size - 1); y >= 0; y--) {
+	SaveImage("biomes", data->size, 3, [data, &colors](int y, uint8_t* row) {
+		uint8_t samp;
 		for (int x = 0; x < data->size; x++) {
 			samp = data->getValue(x,y);
-			switch (samp) {
-			case WG::Generator::BIOME_OCEAN:
-				buffer[bOff] = (BYTE)255; //B
-				buffer[bOff + 1] = (BYTE)64; //G
-				buffer[bOff + 2] = (BYTE)0; //R
-				break;
-			case WG::Generator::BIOME_SUBTROPICAL_DESERT:
-				buffer[bOff] = (BYTE)5; //B
-				buffer[bOff + 1] = (BYTE)99; //G
-				buffer[bOff + 2] = (BYTE)226; //R
-				break;
-			case WG::Generator::BIOME_GRASSLAND:
-				buffer[bOff] = (BYTE)64; //B
-				buffer[bOff + 1] = (BYTE)210; //G
-				buffer[bOff + 2] = (BYTE)99; //R
-				break;
-			case WG::Generator::BIOME_TROPICAL_FOREST:
-				buffer[bOff] = (BYTE)111; //B
-				buffer[bOff + 1] = (BYTE)211; //G
-				buffer[bOff + 2] = (BYTE)99; //R
-				break;
-			case WG::Generator::BIOME_TROPICAL_RAIN_FOREST:
-				buffer[bOff] = (BYTE)114; //B
-				buffer[bOff + 1] = (BYTE)196; //G
-				buffer[bOff + 2] = (BYTE)2; //R
-				break;
-			case WG::Generator::BIOME_TEMPERATE_DESERT:
-				buffer[bOff] = (BYTE)23; //B
-				buffer[bOff + 1] = (BYTE)185; //G
-				buffer[bOff + 2] = (BYTE)232; //R
-				break;
-			case WG::Generator::BIOME_DECIDEOUS_FOREST:
-				buffer[bOff] = (BYTE)26; //B
-				buffer[bOff + 1] = (BYTE)176; //G
-				buffer[bOff + 2] = (BYTE)40; //R
-				break;
-			case WG::Generator::BIOME_TEMPERATE_RAIN_FOREST:
-				buffer[bOff] = (BYTE)14; //B
-				buffer[bOff + 1] = (BYTE)222; //G
-				buffer[bOff + 2] = (BYTE)3; //R
-				break;
-			case WG::Generator::BIOME_SHRUBLAND:
-				buffer[bOff] = (BYTE)131; //B
-				buffer[bOff + 1] = (BYTE)193; //G
-				buffer[bOff + 2] = (BYTE)85; //R
-				break;
-			case WG::Generator::BIOME_TAIGA:
-				buffer[bOff] = (BYTE)33; //B
-				buffer[bOff + 1] = (BYTE)88; //G
-				buffer[bOff + 2] = (BYTE)40; //R
-				break;
-			case WG::Generator::BIOME_SCORCHED:
-				buffer[bOff] = (BYTE)72; //B
-				buffer[bOff + 1] = (BYTE)75; //G
-				buffer[bOff + 2] = (BYTE)46; //R
-				break;
-			case WG::Generator::BIOME_BARE:
-				buffer[bOff] = (BYTE)82; //B
-				buffer[bOff + 1] = (BYTE)139; //G
-				buffer[bOff + 2] = (BYTE)105; //R
-				break;
-			case WG::Generator::BIOME_TUNDRA:
-				buffer[bOff] = (BYTE)164; //B
-				buffer[bOff + 1] = (BYTE)176; //G
-				buffer[bOff + 2] = (BYTE)149; //R
-				break;
-			case WG::Generator::BIOME_ARCTIC:
-				buffer[bOff] = (BYTE)255; //B
-				buffer[bOff + 1] = (BYTE)255; //G
-				buffer[bOff + 2] = (BYTE)255; //R
-				break;
-			default:
-				buffer[bOff] = (BYTE)0; //B
-				buffer[bOff + 1] = (BYTE)0; //G
-				buffer[bOff + 2] = (BYTE)0; //R
-			}
-			bOff += 3;
+			row[(x * 3)] = colors[(samp * 3)]; //R
+			row[(x * 3) + 1] = colors[(samp * 3) + 1]; //G
+			row[(x * 3) + 2] = colors[(samp * 3) + 2]; //B
 		}
+	});
+}
+
+//The biome colors mixed by the blend weights, what a renderer splatting the blend layer would show
+void SaveBiomeBlendData(WG::BiomeBlend* blend, WG::BiomeTable* table) {
+	std::vector<int> colors(256 * 3, 0);
+	for (const WG::BiomeInfo& biome : table->getBiomes()) {
+		colors[(biome.id * 3)] = biome.red;
+		colors[(biome.id * 3) + 1] = biome.green;
+		colors[(biome.id * 3) + 2] = biome.blue;
 	}
 
-	SaveBitmapToFile((BYTE*)buffer, data->size, data->size, 24, 0, ".\\biomes.bmp");
+	SaveImage("biome_blend", blend->size, 3, [blend, &colors](int y, uint8_t* row) {
+		for (int x = 0; x < blend->size; x++) {
+			int cell = (x * blend->size + y) * 4;
+			int r = 0, g = 0, b = 0;
+			for (int k = 0; k < 4; k++) {
+				int id = blend->ids[cell + k], weight = blend->weights[cell + k];
+				r += colors[(id * 3)] * weight;
+				g += colors[(id * 3) + 1] * weight;
+				b += colors[(id * 3) + 2] * weight;
+			}
+			row[(x * 3)] = (uint8_t)(r / 255); //R
+			row[(x * 3) + 1] = (uint8_t)(g / 255); //G
+			row[(x * 3) + 2] = (uint8_t)(b / 255); //B
+		}
+	});
 }
 
-void SaveCompoundData(WG::Generator* gen, int size) {
-	BYTE* buffer = new BYTE[size * 3 * size];
-	int bOff = 0;
-
-	float sampH, sampT;
-	float r = 0.0f, g = 0.0f, b = 0.0f, h = 0.0f, s = 0.0f, v = 0.0f;
-	uint8_t sampW;
-	for (int y = (size - 1); y >= 0; y--) {
+void SaveCompoundData(WG::Generator* gen, WG::FloatData* temperature, int size) {
+	SaveImage("compound", size, 3, [gen, temperature, size](int y, uint8_t* row) {
+		float sampH, sampT;
+		float r = 0.0f, g = 0.0f, b = 0.0f, h = 0.0f, s = 0.0f, v = 0.0f;
+		uint8_t sampW;
 		for (int x = 0; x < size; x++) {
 			sampH = gen->getHeightData()->getValue(x, y);
-			sampT = gen->getTemperatureData()->getValue(x, y);
+			sampT = temperature->getValue(x, y);
 			sampW = gen->getWaterData()->getValue(x, y);
+			uint8_t* pixel = row + (x * 3);
 
 			if (sampW == 1) {
-				buffer[bOff] = (BYTE)128; //B
-				buffer[bOff + 1] = (BYTE)0; //G
-				buffer[bOff + 2] = (BYTE)0; //R
+				pixel[0] = 0; //R
+				pixel[1] = 0; //G
+				pixel[2] = 128; //B
 			} else if (sampW == 2) {
-				buffer[bOff] = (BYTE)255; //B
-				buffer[bOff + 1] = (BYTE)64; //G
-				buffer[bOff + 2] = (BYTE)0; //R
+				pixel[0] = 0; //R
+				pixel[1] = 64; //G
+				pixel[2] = 255; //B
+			} else if (sampW == 3) {
+				pixel[0] = 0; //R
+				pixel[1] = 96; //G
+				pixel[2] = 192; //B
+			} else if (gen->getShoreMask() != NULL && gen->getShoreMask()->get(x, y)) {
+				pixel[0] = 235; //R
+				pixel[1] = 210; //G
+				pixel[2] = 140; //B
 			} else {
 				s = 1.0f;
 				v = sampH;
 				h = ((1.0f - sampT) * 250.0f);
 				HSVtoRGB(r, g, b, h, s, v);
 
-				buffer[bOff] = (BYTE)(std::floorf(b * 255.0f)); //B
-				buffer[bOff + 1] = (BYTE)(std::floorf(g * 255.0f)); //G
-				buffer[bOff + 2] = (BYTE)(std::floorf(r * 255.0f)); //R
+				pixel[0] = (uint8_t)(floorf(r * 255.0f)); //R
+				pixel[1] = (uint8_t)(floorf(g * 255.0f)); //G
+				pixel[2] = (uint8_t)(floorf(b * 255.0f)); //B
 			}
-
-			bOff += 3;
 		}
-	}
-
-	SaveBitmapToFile((BYTE*)buffer, size, size, 24, 0, ".\\compound.bmp");
+	});
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+	//"WorldGen -benchmark <name>" runs one of the benchmarks instead of generating
+	if (argc > 2 && strcmp(argv[1], "-benchmark") == 0) {
+		if (!WG::Benchmark::run(argv[2]))
+			cout << "Unknown benchmark: " << argv[2] << endl;
+		return 0;
+	}
+	//"WorldGen -format png" saves the images as PNG (or bmp, pgm/ppm) instead of BMP
+	if (argc > 2 && strcmp(argv[1], "-format") == 0)
+		imageFormat = WG::ImageWriter::formatFromPath(std::string(".") + argv[2]);
+
 	//Set up the config for the generator
 	WG::Settings config;
 	config.worldSize = 512;
 	config.seed = 1337;
 	config.seaLevel = 0.15f;
+	config.oceanMinArea = 4096;
+	config.lakeMinArea = 16;
+	config.coastSmoothing = 1;
+	config.shoreWidth = 2;
+
+	//Coasts are wetter and milder then inland
+	config.coastDistance = true;
+	config.coastRange = 32.0f;
+	config.coastMoisture = 0.3f;
+	config.coastTemperature = 0.3f;
 
 	//Height modifier just does a global multiply on the height data to lower the edges into the sea
 	config.heightModifier = WG::HeightModifier::PANGAEA;
 
+	//Moisture blown in off the ocean by a westerly wind, with rain shadows behind the mountains
+	config.moistureMode = WG::MoistureMode::MOISTURE_WIND;
+	config.windDirection = WG::WindDirection::WIND_FROM_WEST;
+	//Temperature and moisture only change slowly over the map, work them out at half the resolution
+	config.climateDownsample = 2;
+
+	//Land collecting the moisture of a couple hundred cells upstream becomes river
+	config.riverThreshold = 200.0f;
+
+	//Smooth out the single cell biome specks along the temperature and moisture band edges
+	config.biomeFilterRadius = 2;
+
+	//Keep the biome map indexed for "nearest tundra" and "desert in this area" queries
+	config.biomeIndex = true;
+
+	//And split into connected regions with their neighbors, for quest and spawn placement
+	config.biomeRegions = true;
+
+	//Soft biome weights for the renderer, mixing biomes within 0.05 of temperature and moisture of each other
+	config.biomeBlendRadius = 0.05f;
+
 	config.hydraulicErosionIterations = 0;
+	config.hydraulicErosionMode = WG::HydraulicErosionMode::HYDRAULIC_PIPE;
+	config.hydraulicDropletsPerIteration = 65536;
 
 	config.thermalErosionIterations = 5;
 	config.thermalErosionThreshold = 0.0005f;
 	config.thermalErosionCoefficient = 0.5f;
+	config.thermalErosionTolerance = 0.00001f;
+	config.thermalErosionLevels = 1;
+	config.thermalErosionFineIterations = 2;
+
+	//Blocked stencils run several iterations per cache sized tile instead of full map sweeps
+	config.threadCount = 0;
+	config.stencilTileSize = 128;
+	config.stencilBlockDepth = 0;
 	
 	WG::Generator generator(config);
+
+	//Biomes come from biomes.txt next to the executable when there is one, the built in table otherwise
+	std::string biomeError;
+	if (!generator.getBiomeTable()->loadFile("biomes.txt", biomeError))
+		cout << "Using the built in biome table. " << biomeError << endl;
+
+	generator.getInstrumentation()->setProgressCallback([](WG::GeneratorStage stage, float progress) {
+		std::cout << "\r" << WG::getStageName(stage) << ": " << (int)(progress * 100.0f) << "%   " << std::flush;
+	});
 	generator.generate();
 
+	//Totals counted up by the stages while they ran
+	for (int i = 0; i < WG::COUNTER_COUNT; i++)
+		std::cout << std::endl << WG::getCounterName((WG::GeneratorCounter)i) << ": " << generator.getInstrumentation()->getCount((WG::GeneratorCounter)i);
+	std::cout << std::endl;
+
 	//Save the data
 	SaveHeightmapData(generator.getHeightData());
 	SaveWaterData(generator.getWaterData());
-	SaveTemperatureData(generator.getTemperatureData(), generator.getHeightData());
-	SaveMoistureData(generator.getMoistureData());
-	SaveBiomeData(generator.getBiomeData());
-	SaveCompoundData(&generator, config.worldSize);
+	WG::FloatData* temperature = new WG::FloatData(config.worldSize);
+	WG::FloatData* moisture = new WG::FloatData(config.worldSize);
+	generator.upsampleClimate(generator.getTemperatureData(), temperature);
+	generator.upsampleClimate(generator.getMoistureData(), moisture);
+	SaveTemperatureData(temperature, generator.getHeightData());
+	SaveMoistureData(moisture);
+	SaveBiomeData(generator.getBiomeData(), generator.getBiomeTable());
+	if (generator.getBiomeBlend() != NULL)
+		SaveBiomeBlendData(generator.getBiomeBlend(), generator.getBiomeTable());
+	SaveCompoundData(&generator, temperature, config.worldSize);
+	delete temperature;
+	delete moisture;
 	
-	/*
-	//Calculate normals (This doesn't produce very good normal maps, so I commented it out)
-	vector3* norm = new vector3[512 * 512];
-	for (int y = 0; y < 512; y++) {
-		for (int x = 0; x < 512; x++) {
-			float tl = data->getValueWrapped(x - 1, y + 1),
-				t = data->getValueWrapped(x, y + 1),
-				tr = data->getValueWrapped(x + 1, y + 1);
-			float r = data->getValueWrapped(x + 1, y),
-				l = data->getValueWrapped(x - 1, y);
-			float bl = data->getValueWrapped(x - 1, y - 1),
-				b = data->getValueWrapped(x, y - 1),
-				br = data->getValueWrapped(x + 1, y - 1);
-
-			float dx = (tr + 2.0f * r + br) - (tl + 2.0f * l + bl);
-			float dy = (bl + 2.0f * b + br) - (tl + 2.0f * l + tr);
-			float dz = 1.0f / 0.5f;
-			vector3 normal;
-			normal.x = dx;
-			normal.y = dy;
-			normal.z = dz;
-			normal.normalize();
+	//Heights are 0...1 across the whole map, so scale the gradient up with the size to get visible relief
+	SaveNormalData(generator.getDerivedTerrain(), (float)config.worldSize * 0.25f);
 
-			norm[x * 512 + y] = normal;
-		}
-	}
-	SaveNormalData(norm);
-	delete[] norm;
-	*/
+	//The world itself, to load back by mapping it instead of generating it again
+	std::string worldError;
+	if (!WG::WorldFile::save("world.wgw", config, WG::WorldFile::getLayers(&generator), worldError))
+		cout << worldError << endl;
 
+#ifdef _WIN32
 	system("pause");
+#endif
 	return 0;
 }